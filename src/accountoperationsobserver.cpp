@@ -21,23 +21,26 @@
 ******************************************************************************/
 
 #include "accountoperationsobserver.h"
+#include "accountpurge.h"
 #include "notificationmanager.h"
 
 #include <TelepathyQt/PendingReady>
 
-#include <CommHistory/GroupModel>
-#include <CommHistory/CallModel>
 #include "debug.h"
 
 using namespace RTComLogger;
 
 AccountOperationsObserver::AccountOperationsObserver(Tp::AccountManagerPtr accountManager, QObject* parent) :
     QObject(parent),
-    m_pGroupModel(0),
-    m_AccountManager(accountManager)
+    m_AccountManager(accountManager),
+    m_purge(new AccountPurge(this))
 {
     DEBUG() << Q_FUNC_INFO << "START";
 
+    connect(m_purge,
+            SIGNAL(finished(QString,bool)),
+            SLOT(slotPurgeFinished(QString,bool)));
+
     if (!m_AccountManager.isNull()) {
         if (!m_AccountManager->isReady()) {
             DEBUG() << Q_FUNC_INFO << "Account manager is not ready. Making it ready...";
@@ -141,153 +144,23 @@ void AccountOperationsObserver::slotAccountRemoved()
 
         m_accounts.remove(accountPath);
 
-        /* Store paths of removed accounts into lists so that if call and/or group models are not
-           yet ready while more accounts are being removed then all of those removed accounts
-           are really handled. */
-        m_accountPathsForConvs.append(accountPath);
-
-        CommHistory::CallModel *callModel = new CommHistory::CallModel(this);
-        callModel->setPropertyMask(CommHistory::Event::PropertySet()
-                                   << CommHistory::Event::Type
-                                   << CommHistory::Event::LocalUid);
-        callModel->setFilterAccount(accountPath);
-
-        connect(callModel,
-                SIGNAL(modelReady(bool)),
-                this,
-                SLOT(slotDeleteCalls()),
-                Qt::UniqueConnection);
-
-        connect(callModel,
-                SIGNAL(rowsRemoved(const QModelIndex&,int,int)),
-                this,
-                SLOT(slotRowsRemoved(const QModelIndex&,int,int)),
-                Qt::UniqueConnection);
-
-        callModel->getEvents();
-        m_accountPathsForCalls.insert(accountPath, callModel);
-
-        if (!m_pGroupModel) {
-            // Notification manager already has a group model so using that instead of creating a separate one:
-            m_pGroupModel = NotificationManager::instance()->groupModel();
-        }
-
-        if (m_pGroupModel && !m_pGroupModel->isReady()) {
-            connect(m_pGroupModel,
-                    SIGNAL(modelReady(bool)),
-                    this,
-                    SLOT(slotDeleteConversations()),
-                    Qt::UniqueConnection);
-        } else {
-            slotDeleteConversations();
-        }
-    }
-
-    DEBUG() << Q_FUNC_INFO << "END";
-}
-
-void AccountOperationsObserver::slotDeleteConversations()
-{
-    DEBUG() << Q_FUNC_INFO << "START";
-
-    if (!m_pGroupModel)
-        return;
-
-    QList<int> groupsToBeDeleted;
-
-    foreach (QString accountPath, m_accountPathsForConvs) {
-        for (int i=0;i<m_pGroupModel->rowCount();i++) {
-            QModelIndex index = m_pGroupModel->index(i,0);
-            if (index.isValid()) {
-                CommHistory::Group group = m_pGroupModel->group(index);
-                int groupId = group.id();
-                QString localId = group.localUid();
-                if (localId == accountPath) {
-                    DEBUG() << Q_FUNC_INFO << "Group " << groupId << " to be deleted";
-                    groupsToBeDeleted.append(groupId);
-                }
-            }
-        }
-
         // delete notifcations of this account
         emit removeAccountNotifications(accountPath);
-    }
-
-    if (!groupsToBeDeleted.isEmpty()) {
-        if (!m_pGroupModel->deleteGroups(groupsToBeDeleted)) {
-            qWarning() << "Error while deleting groups: " << groupsToBeDeleted;
-        }
-    }
-
-    m_accountPathsForConvs.clear();
-
-    DEBUG() << Q_FUNC_INFO << "END";
-}
-
-void AccountOperationsObserver::slotDeleteCalls()
-{
-    DEBUG() << Q_FUNC_INFO << "START";
 
-    CommHistory::CallModel *callModel = qobject_cast<CommHistory::CallModel *>(sender());
-
-    if (!callModel) {
-        qWarning() << "Null CallModel!";
-        return;
-    }
-
-    QList<CommHistory::Event> callsToBeDeleted;
-
-    for (int i=0;i<callModel->rowCount();i++) {
-        QModelIndex index = callModel->index(i,0);
-        if (index.isValid()) {
-            CommHistory::Event callEvent = callModel->event(index);
-            DEBUG() << Q_FUNC_INFO << "Call " << callEvent.id() << " to be deleted";
-            callsToBeDeleted.append(callEvent);
-        }
-     }
-
-    foreach(CommHistory::Event callEvent, callsToBeDeleted) {
-        // No deleteEvents implemented, so calling deleteEvent for every event to be removed:
-        if (!callModel->deleteEvent(callEvent)) {
-            qWarning() << "Error while deleting call " << callEvent.id();
-        }
-     }
-
-    if (callsToBeDeleted.isEmpty()) {
-        QString accountPath = m_accountPathsForCalls.key(callModel);
-        DEBUG() << Q_FUNC_INFO << "No calls to be deleted for " << accountPath << ". We can delete the CallModel.";
-        m_accountPathsForCalls.take(accountPath)->deleteLater();
-
-        // delete notifcations of this account
-        emit removeAccountNotifications(accountPath);
+        /* Conversations and calls are deleted straight from the database, so
+           nothing of the account needs to be loaded into models first. */
+        m_purge->purge(accountPath);
     }
 
     DEBUG() << Q_FUNC_INFO << "END";
 }
 
-void AccountOperationsObserver::slotRowsRemoved(const QModelIndex& index, int start, int end)
+void AccountOperationsObserver::slotPurgeFinished(const QString &accountPath, bool success)
 {
-    Q_UNUSED(index)
-    Q_UNUSED(start)
-    Q_UNUSED(end)
-
-    DEBUG() << Q_FUNC_INFO << "start: " << start << " end: " << end;
-
-    CommHistory::CallModel *callModel = qobject_cast<CommHistory::CallModel *>(sender());
-
-    if (!callModel) {
-        qWarning() << "Null CallModel!";
+    if (!success) {
+        qWarning() << "Error while deleting conversations and calls of" << accountPath;
         return;
     }
 
-    if (callModel->rowCount() == 0) {
-        DEBUG() << Q_FUNC_INFO << "Last event in CallModel deleted. We can delete the model.";
-        QString accountPath = m_accountPathsForCalls.key(callModel);
-        m_accountPathsForCalls.take(accountPath)->deleteLater();
-
-        // delete notifcations of this account
-        emit removeAccountNotifications(accountPath);
-    }
-
-    DEBUG() << Q_FUNC_INFO << "END";
+    DEBUG() << Q_FUNC_INFO << "Conversations and calls of" << accountPath << "deleted.";
 }
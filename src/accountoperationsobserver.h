@@ -27,15 +27,10 @@
 #include <TelepathyQt/Account>
 #include <TelepathyQt/PendingOperation>
 
-namespace CommHistory
-{
-    class GroupModel;
-    class CallModel;
-    class Event;
-}
-
 namespace RTComLogger
 {
+class AccountPurge;
+
 /**
 \class AccountOperationsObserver
 \brief Listens telepathy accounts being removed and when that happens, removes both
@@ -84,39 +79,14 @@ private Q_SLOTS:
     /*!
      * \brief Slot getting called when telepathy account is removed.
      *
-     * Adds path of the removed account into a list used when calling methods to
-     * remove conversations and calls either a) directly or b) via signal from models
-     * indicating they are ready. Uses CommHistory::GroupModel from NotificationManager
-     * and creates and populates CommHistory::CallModel by itself. Additionally removes
-     * all notifications of the account.
-     *
+     * Removes all notifications of the account and queues deletion of its
+     * conversations and calls with AccountPurge.
      */
     void slotAccountRemoved();
     /*!
-     * \brief Deletes conversations of an account.
-     *
-     * Deletes all conversations of the account added into the list of removed accounts
-     * in slotAccountRemoved().
-     *
-     */
-    void slotDeleteConversations();
-    /*!
-     * \brief Deletes calls of an account.
-     *
-     * Deletes all calls of the account added into the list of removed accounts
-     * in slotAccountRemoved().
-     *
-     */
-    void slotDeleteCalls();
-    /*!
-     * \brief Slot getting called when a row is deleted from the call model.
-     *
-     * \param index Parent item under which the rows are being removed.
-     * \param start Starting row for removal.
-     * \param end   Ending row for removal.
-     *
+     * \brief Slot getting called when all events of a removed account are deleted.
      */
-    void slotRowsRemoved(const QModelIndex& index, int start, int end);
+    void slotPurgeFinished(const QString &accountPath, bool success);
 
 private:
     /*!
@@ -127,10 +97,8 @@ private:
     void connectToAccounts();
 
 private:
-    CommHistory::GroupModel *m_pGroupModel;
     Tp::AccountManagerPtr m_AccountManager;
-    QList<QString> m_accountPathsForConvs; // Conversations of these account paths should be removed.
-    QMap<QString,CommHistory::CallModel*> m_accountPathsForCalls; // Calls of these account paths should be removed.
+    AccountPurge *m_purge;
     QMap<QString, Tp::AccountPtr> m_accounts;
 };
 
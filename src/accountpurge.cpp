@@ -0,0 +1,297 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "accountpurge.h"
+#include "commhistorydatabase.h"
+#include "debug.h"
+
+#include <CommHistory/Event>
+
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDir>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTimer>
+
+#define PURGE_CHUNK_SIZE      500
+#define PURGE_CONNECTION_NAME "commhistoryd-account-purge"
+
+// eventDeleted signals sent per batch, and the pause between batches in ms
+#define DELETED_SIGNAL_BATCH    50
+#define DELETED_SIGNAL_INTERVAL 100
+
+#define COMMHISTORY_PATH      "/CommHistoryModel"
+#define COMMHISTORY_INTERFACE "com.nokia.commhistory"
+#define EVENT_DELETED_SIGNAL  "eventDeleted"
+#define GROUPS_DELETED_SIGNAL "groupsDeleted"
+
+using namespace RTComLogger;
+using namespace CommHistory;
+
+namespace {
+
+QString joinIds(const QList<int> &ids)
+{
+    QStringList values;
+    values.reserve(ids.size());
+    foreach (int id, ids)
+        values.append(QString::number(id));
+    return values.join(QLatin1Char(','));
+}
+
+}
+
+AccountPurge::AccountPurge(QObject *parent)
+    : QObject(parent),
+      m_total(0),
+      m_deleted(0),
+      m_scheduled(false),
+      m_signalsScheduled(false)
+{
+}
+
+AccountPurge::~AccountPurge()
+{
+    closeDatabase();
+}
+
+void AccountPurge::purge(const QString &accountPath)
+{
+    if (accountPath.isEmpty() || accountPath == m_accountPath || m_queue.contains(accountPath))
+        return;
+
+    m_queue.append(accountPath);
+
+    if (m_accountPath.isEmpty() && !m_scheduled) {
+        m_scheduled = true;
+        QTimer::singleShot(0, this, SLOT(processNext()));
+    }
+}
+
+bool AccountPurge::openDatabase()
+{
+    if (m_database.isOpen())
+        return true;
+
+    closeDatabase();
+    m_database = CommHistoryDatabase::open(QLatin1String(PURGE_CONNECTION_NAME),
+                                           CommHistoryDatabase::ReadWrite);
+    return m_database.isOpen();
+}
+
+void AccountPurge::closeDatabase()
+{
+    if (m_database.isValid()) {
+        m_database.close();
+        m_database = QSqlDatabase();
+        QSqlDatabase::removeDatabase(QLatin1String(PURGE_CONNECTION_NAME));
+    }
+}
+
+void AccountPurge::processNext()
+{
+    m_scheduled = false;
+
+    if (m_accountPath.isEmpty()) {
+        if (m_queue.isEmpty())
+            return;
+
+        m_accountPath = m_queue.takeFirst();
+        if (!openDatabase() || !begin()) {
+            finish(false);
+            return;
+        }
+    }
+
+    bool done = false;
+    if (!deleteChunk(&done)) {
+        finish(false);
+        return;
+    }
+
+    if (done) {
+        finish(deleteGroups());
+        return;
+    }
+
+    m_scheduled = true;
+    QTimer::singleShot(0, this, SLOT(processNext()));
+}
+
+bool AccountPurge::begin()
+{
+    m_groupIds.clear();
+    m_deleted = 0;
+    m_total = 0;
+
+    QSqlQuery query(m_database);
+    query.prepare(QLatin1String("SELECT COUNT(*) FROM Events WHERE localUid = :localUid"));
+    query.bindValue(QLatin1String(":localUid"), m_accountPath);
+    if (!query.exec() || !query.next()) {
+        qCritical() << "Failed to count events of" << m_accountPath << query.lastError().text();
+        return false;
+    }
+    m_total = query.value(0).toInt();
+
+    query.prepare(QLatin1String("SELECT id FROM Groups WHERE localUid = :localUid"));
+    query.bindValue(QLatin1String(":localUid"), m_accountPath);
+    if (!query.exec()) {
+        qCritical() << "Failed to query groups of" << m_accountPath << query.lastError().text();
+        return false;
+    }
+    while (query.next())
+        m_groupIds.append(query.value(0).toInt());
+
+    DEBUG() << Q_FUNC_INFO << "purging" << m_total << "events and" << m_groupIds.size()
+            << "groups of" << m_accountPath;
+    return true;
+}
+
+bool AccountPurge::deleteChunk(bool *done)
+{
+    QList<int> eventIds;
+    QList<int> callIds;
+    QList<int> partEventIds;
+
+    if (!m_database.transaction()) {
+        qCritical() << "Failed to start transaction:" << m_database.lastError().text();
+        return false;
+    }
+
+    QSqlQuery query(m_database);
+    query.prepare(QLatin1String("SELECT id, type FROM Events WHERE localUid = :localUid LIMIT :limit"));
+    query.bindValue(QLatin1String(":localUid"), m_accountPath);
+    query.bindValue(QLatin1String(":limit"), PURGE_CHUNK_SIZE);
+    bool ok = query.exec();
+    while (ok && query.next()) {
+        eventIds.append(query.value(0).toInt());
+        if (query.value(1).toInt() == Event::CallEvent)
+            callIds.append(query.value(0).toInt());
+    }
+
+    if (ok && !eventIds.isEmpty()) {
+        QString ids = joinIds(eventIds);
+        ok = query.exec(QString::fromLatin1("SELECT DISTINCT eventId FROM MessageParts WHERE eventId IN (%1)").arg(ids));
+        while (ok && query.next())
+            partEventIds.append(query.value(0).toInt());
+
+        if (ok)
+            ok = query.exec(QString::fromLatin1("DELETE FROM Events WHERE id IN (%1)").arg(ids));
+    }
+
+    if (!ok || !m_database.commit()) {
+        qCritical() << "Failed to delete events of" << m_accountPath << query.lastError().text();
+        m_database.rollback();
+        return false;
+    }
+
+    removeMessagePartDirectories(partEventIds);
+    // Calls aren't covered by groupsDeleted, so they are announced one by one
+    m_deletedCalls.append(callIds);
+    scheduleDeletedSignals();
+
+    m_deleted += eventIds.size();
+    *done = eventIds.size() < PURGE_CHUNK_SIZE;
+    return true;
+}
+
+bool AccountPurge::deleteGroups()
+{
+    QSqlQuery query(m_database);
+    query.prepare(QLatin1String("DELETE FROM Groups WHERE localUid = :localUid"));
+    query.bindValue(QLatin1String(":localUid"), m_accountPath);
+    if (!query.exec()) {
+        qCritical() << "Failed to delete groups of" << m_accountPath << query.lastError().text();
+        return false;
+    }
+
+    return true;
+}
+
+void AccountPurge::removeMessagePartDirectories(const QList<int> &eventIds)
+{
+    QString dataPath = CommHistoryDatabase::dataPath();
+
+    foreach (int eventId, eventIds) {
+        QDir dir(dataPath + QString::number(eventId));
+        if (dir.exists() && !dir.removeRecursively())
+            qWarning() << "Cannot remove message part directory" << dir.path();
+    }
+}
+
+void AccountPurge::notifyDeleted()
+{
+    if (!m_groupIds.isEmpty()) {
+        QDBusMessage signal = QDBusMessage::createSignal(COMMHISTORY_PATH, COMMHISTORY_INTERFACE,
+                                                         GROUPS_DELETED_SIGNAL);
+        signal << QVariant::fromValue(m_groupIds);
+        QDBusConnection::sessionBus().send(signal);
+    }
+}
+
+void AccountPurge::scheduleDeletedSignals()
+{
+    if (!m_signalsScheduled && !m_deletedCalls.isEmpty()) {
+        m_signalsScheduled = true;
+        QTimer::singleShot(DELETED_SIGNAL_INTERVAL, this, SLOT(sendDeletedSignals()));
+    }
+}
+
+void AccountPurge::sendDeletedSignals()
+{
+    m_signalsScheduled = false;
+
+    // Spread the signals out so a long call history doesn't flood the bus
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    for (int i = 0; i < DELETED_SIGNAL_BATCH && !m_deletedCalls.isEmpty(); i++) {
+        QDBusMessage signal = QDBusMessage::createSignal(COMMHISTORY_PATH, COMMHISTORY_INTERFACE,
+                                                         EVENT_DELETED_SIGNAL);
+        signal << m_deletedCalls.takeFirst();
+        bus.send(signal);
+    }
+
+    scheduleDeletedSignals();
+}
+
+void AccountPurge::finish(bool success)
+{
+    DEBUG() << Q_FUNC_INFO << m_accountPath << "deleted" << m_deleted << "of" << m_total
+            << "events" << (success ? "" : "(failed)");
+
+    // Groups are kept when deleting their events failed
+    if (success)
+        notifyDeleted();
+
+    QString accountPath = m_accountPath;
+    m_accountPath.clear();
+    m_groupIds.clear();
+
+    emit finished(accountPath, success);
+
+    if (!m_queue.isEmpty() && !m_scheduled) {
+        m_scheduled = true;
+        QTimer::singleShot(0, this, SLOT(processNext()));
+    } else if (m_queue.isEmpty()) {
+        closeDatabase();
+    }
+}
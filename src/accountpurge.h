@@ -0,0 +1,93 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef ACCOUNTPURGE_H
+#define ACCOUNTPURGE_H
+
+#include <QObject>
+#include <QStringList>
+#include <QList>
+#include <QSqlDatabase>
+
+namespace RTComLogger {
+
+/*!
+ * \class AccountPurge
+ * \brief Deletes all events and groups of removed accounts directly from the database.
+ *
+ * Events are deleted in chunks with set-based statements, each chunk in its
+ * own transaction, returning to the event loop in between. Message part
+ * directories of the deleted events are removed after each chunk, and the
+ * groups of the account at the end. Models are told about the deletions with
+ * one groupsDeleted signal for the groups and an eventDeleted signal for each
+ * deleted call, sent in small batches.
+ */
+class AccountPurge : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AccountPurge(QObject *parent = 0);
+    ~AccountPurge();
+
+    /*!
+     * Queues deletion of all events and groups with the account path as local uid.
+     */
+    void purge(const QString &accountPath);
+
+Q_SIGNALS:
+    void finished(const QString &accountPath, bool success);
+
+private Q_SLOTS:
+    void processNext();
+    void sendDeletedSignals();
+
+private:
+    bool openDatabase();
+    void closeDatabase();
+    bool begin();
+    bool deleteChunk(bool *done);
+    bool deleteGroups();
+    void removeMessagePartDirectories(const QList<int> &eventIds);
+    void notifyDeleted();
+    void scheduleDeletedSignals();
+    void finish(bool success);
+
+private:
+    QSqlDatabase m_database;
+    QStringList m_queue;
+    QString m_accountPath;
+    QList<int> m_groupIds;
+    QList<int> m_deletedCalls;
+    int m_total;
+    int m_deleted;
+    bool m_scheduled;
+    bool m_signalsScheduled;
+
+#ifdef UNIT_TEST
+    friend class Ut_AccountPurge;
+#endif
+};
+
+} // namespace RTComLogger
+
+#endif // ACCOUNTPURGE_H
@@ -0,0 +1,118 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "callcheckpointscheduler.h"
+#include "calljournal.h"
+#include "debug.h"
+
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QTimerEvent>
+
+// mce
+#include <mce/dbus-names.h>
+#include <mce/mode-names.h>
+
+#define SAVING_INTERVAL 5*60000 // 5 minute
+
+using namespace RTComLogger;
+
+CallCheckpointScheduler* CallCheckpointScheduler::m_pInstance = 0;
+
+CallCheckpointScheduler* CallCheckpointScheduler::instance()
+{
+    if (!m_pInstance)
+        m_pInstance = new CallCheckpointScheduler(QCoreApplication::instance());
+
+    return m_pInstance;
+}
+
+CallCheckpointScheduler::CallCheckpointScheduler(QObject *parent)
+    : QObject(parent),
+      m_displayOff(false),
+      m_inactive(false)
+{
+    QDBusConnection bus = QDBusConnection::systemBus();
+    bus.connect(MCE_SERVICE, MCE_SIGNAL_PATH, MCE_SIGNAL_IF, MCE_DISPLAY_SIG,
+                this, SLOT(slotDisplayStatusChanged(QString)));
+    bus.connect(MCE_SERVICE, MCE_SIGNAL_PATH, MCE_SIGNAL_IF, MCE_INACTIVITY_SIG,
+                this, SLOT(slotInactivityChanged(bool)));
+
+    QDBusMessage displayCall = QDBusMessage::createMethodCall(MCE_SERVICE, MCE_REQUEST_PATH,
+                                                              MCE_REQUEST_IF, MCE_DISPLAY_STATUS_GET);
+    bus.callWithCallback(displayCall, this, SLOT(slotDisplayStatusChanged(QString)));
+    QDBusMessage inactivityCall = QDBusMessage::createMethodCall(MCE_SERVICE, MCE_REQUEST_PATH,
+                                                                 MCE_REQUEST_IF, MCE_INACTIVITY_STATUS_GET);
+    bus.callWithCallback(inactivityCall, this, SLOT(slotInactivityChanged(bool)));
+}
+
+void CallCheckpointScheduler::add(int journalSlot)
+{
+    if (journalSlot < 0)
+        return;
+
+    m_calls.insert(journalSlot);
+
+    if (!m_timer.isActive())
+        m_timer.start(SAVING_INTERVAL, this);
+}
+
+void CallCheckpointScheduler::remove(int journalSlot)
+{
+    m_calls.remove(journalSlot);
+
+    if (m_calls.isEmpty())
+        m_timer.stop();
+}
+
+void CallCheckpointScheduler::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_timer.timerId())
+        checkpoint();
+    else
+        QObject::timerEvent(event);
+}
+
+bool CallCheckpointScheduler::shouldSkip() const
+{
+    return m_displayOff && m_inactive;
+}
+
+void CallCheckpointScheduler::checkpoint()
+{
+    if (m_calls.isEmpty() || shouldSkip())
+        return;
+
+    DEBUG() << Q_FUNC_INFO << m_calls.size() << "ongoing calls";
+    foreach (int journalSlot, m_calls)
+        CallJournal::instance()->checkpoint(journalSlot);
+}
+
+void CallCheckpointScheduler::slotDisplayStatusChanged(const QString &status)
+{
+    m_displayOff = (status == QLatin1String(MCE_DISPLAY_OFF_STRING));
+}
+
+void CallCheckpointScheduler::slotInactivityChanged(bool inactive)
+{
+    m_inactive = inactive;
+}
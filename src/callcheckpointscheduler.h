@@ -0,0 +1,81 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef CALLCHECKPOINTSCHEDULER_H
+#define CALLCHECKPOINTSCHEDULER_H
+
+#include <QObject>
+#include <QBasicTimer>
+#include <QSet>
+
+namespace RTComLogger {
+
+/*!
+ * \class CallCheckpointScheduler
+ * \brief Periodically records how long all ongoing calls have lasted.
+ *
+ * The time is written to each call's CallJournal slot, so that a call's
+ * duration survives a crash. Checkpoints are skipped while the device is
+ * inactive with the display off; the final end time is always recorded by
+ * the call listener when the call ends.
+ */
+class CallCheckpointScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    static CallCheckpointScheduler* instance();
+
+    /*!
+     * Starts checkpointing the call in a journal slot.
+     */
+    void add(int journalSlot);
+
+    /*!
+     * Stops checkpointing the call in a journal slot.
+     */
+    void remove(int journalSlot);
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+private Q_SLOTS:
+    void slotDisplayStatusChanged(const QString &status);
+    void slotInactivityChanged(bool inactive);
+
+private:
+    explicit CallCheckpointScheduler(QObject *parent = 0);
+
+    void checkpoint();
+    bool shouldSkip() const;
+
+private:
+    static CallCheckpointScheduler* m_pInstance;
+
+    QSet<int> m_calls;
+    QBasicTimer m_timer;
+    bool m_displayOff;
+    bool m_inactive;
+};
+
+} // namespace RTComLogger
+
+#endif // CALLCHECKPOINTSCHEDULER_H
@@ -0,0 +1,395 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "calljournal.h"
+#include "recentcalls.h"
+#include "debug.h"
+
+#include <CommHistory/Event>
+#include <CommHistory/EventModel>
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QTimerEvent>
+
+#include <string.h>
+#include <time.h>
+
+#define JOURNAL_MAGIC   0x434a524eu // "CJRN"
+#define JOURNAL_VERSION 2
+#define JOURNAL_SLOTS   16
+#define UID_LENGTH      128
+
+#define SAVE_RETRY_DELAY 5000 // ms, doubled after every failure
+#define MAX_SAVE_RETRY_DELAY (5 * 60 * 1000)
+
+namespace RTComLogger {
+
+enum RecordState {
+    SlotFree = 0,
+    CallStarted,
+    CallAnswered,
+    CallEnded
+};
+
+enum RecordFlags {
+    FlagOutbound  = 0x1,
+    FlagVideo     = 0x2,
+    FlagEmergency = 0x4,
+    FlagMissed    = 0x8
+};
+
+struct CallJournalHeader {
+    quint32 magic;
+    quint32 version;
+    quint32 slotCount;
+    quint32 recordSize;
+};
+
+struct CallJournalRecord {
+    quint32 state;
+    quint32 flags;
+    qint64 startTime;   // wall clock, msecs since epoch
+    qint64 startBoot;   // CLOCK_BOOTTIME, msecs
+    qint64 answerBoot;
+    qint64 checkpointBoot;
+    qint64 endBoot;
+    char localUid[UID_LENGTH];
+    char remoteUid[UID_LENGTH];
+};
+
+}
+
+using namespace RTComLogger;
+using namespace CommHistory;
+
+namespace {
+
+qint64 bootTime()
+{
+    struct timespec tp;
+#ifdef CLOCK_BOOTTIME
+    clock_gettime(CLOCK_BOOTTIME, &tp);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+#endif
+    return qint64(tp.tv_sec) * 1000 + tp.tv_nsec / 1000000;
+}
+
+void copyUid(char *dest, const QString &uid)
+{
+    QByteArray data = uid.toUtf8();
+    int length = qMin(data.size(), UID_LENGTH - 1);
+    memcpy(dest, data.constData(), length);
+    dest[length] = '\0';
+}
+
+void setFlags(CallJournalRecord *r, const Event &event)
+{
+    quint32 flags = 0;
+    if (event.direction() == Event::Outbound)
+        flags |= FlagOutbound;
+    if (event.isVideoCall())
+        flags |= FlagVideo;
+    if (event.isEmergencyCall())
+        flags |= FlagEmergency;
+    if (event.isMissedCall())
+        flags |= FlagMissed;
+    r->flags = flags;
+}
+
+}
+
+CallJournal* CallJournal::m_pInstance = 0;
+
+CallJournal* CallJournal::instance()
+{
+    if (!m_pInstance)
+        m_pInstance = new CallJournal(QCoreApplication::instance());
+
+    return m_pInstance;
+}
+
+CallJournal::CallJournal(QObject *parent)
+    : QObject(parent),
+      m_data(0),
+      m_replay(false),
+      m_nextTicket(0),
+      m_failures(0)
+{
+    m_file.setFileName(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+                       + QLatin1String("/commhistoryd/call-journal"));
+}
+
+CallJournal::~CallJournal()
+{
+    if (m_data)
+        m_file.unmap(m_data);
+}
+
+bool CallJournal::open()
+{
+    if (m_data)
+        return true;
+
+    const qint64 size = sizeof(CallJournalHeader) + JOURNAL_SLOTS * sizeof(CallJournalRecord);
+
+    QDir().mkpath(QFileInfo(m_file.fileName()).path());
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "Cannot open call journal:" << m_file.errorString();
+        return false;
+    }
+
+    bool initialize = m_file.size() != size;
+    if (initialize && !m_file.resize(size)) {
+        qWarning() << "Cannot resize call journal:" << m_file.errorString();
+        m_file.close();
+        return false;
+    }
+
+    m_data = m_file.map(0, size);
+    m_file.close();
+    if (!m_data) {
+        qWarning() << "Cannot map call journal:" << m_file.errorString();
+        return false;
+    }
+
+    CallJournalHeader *header = reinterpret_cast<CallJournalHeader*>(m_data);
+    if (initialize
+        || header->magic != JOURNAL_MAGIC
+        || header->version != JOURNAL_VERSION
+        || header->slotCount != JOURNAL_SLOTS
+        || header->recordSize != sizeof(CallJournalRecord)) {
+        memset(m_data, 0, size);
+        header->magic = JOURNAL_MAGIC;
+        header->version = JOURNAL_VERSION;
+        header->slotCount = JOURNAL_SLOTS;
+        header->recordSize = sizeof(CallJournalRecord);
+    }
+
+    for (int slot = 0; slot < JOURNAL_SLOTS; slot++) {
+        if (record(slot)->state != SlotFree)
+            m_leftover.append(slot);
+    }
+
+    return true;
+}
+
+CallJournalRecord* CallJournal::record(int slot) const
+{
+    if (!m_data || slot < 0 || slot >= JOURNAL_SLOTS)
+        return 0;
+
+    return reinterpret_cast<CallJournalRecord*>(m_data + sizeof(CallJournalHeader)) + slot;
+}
+
+int CallJournal::begin(const Event &event)
+{
+    if (!open())
+        return -1;
+
+    for (int slot = 0; slot < JOURNAL_SLOTS; slot++) {
+        CallJournalRecord *r = record(slot);
+        if (r->state != SlotFree)
+            continue;
+
+        setFlags(r, event);
+        r->startTime = event.startTime().toMSecsSinceEpoch();
+        r->startBoot = bootTime();
+        r->answerBoot = 0;
+        r->checkpointBoot = 0;
+        r->endBoot = 0;
+        copyUid(r->localUid, event.localUid());
+        copyUid(r->remoteUid, event.remoteUid());
+        // state last, so a half-written slot is never replayed
+        r->state = CallStarted;
+        return slot;
+    }
+
+    qWarning() << "Call journal is full";
+    return -1;
+}
+
+void CallJournal::update(int slot, const Event &event)
+{
+    CallJournalRecord *r = record(slot);
+    if (r && r->state != SlotFree && r->state != CallEnded)
+        setFlags(r, event);
+}
+
+void CallJournal::answered(int slot)
+{
+    CallJournalRecord *r = record(slot);
+    if (r && r->state == CallStarted) {
+        r->answerBoot = bootTime();
+        r->state = CallAnswered;
+    }
+}
+
+void CallJournal::checkpoint(int slot)
+{
+    CallJournalRecord *r = record(slot);
+    if (r && r->state == CallAnswered)
+        r->checkpointBoot = bootTime();
+}
+
+void CallJournal::ended(int slot, const Event &event)
+{
+    CallJournalRecord *r = record(slot);
+    if (r && r->state != SlotFree && r->state != CallEnded) {
+        r->endBoot = bootTime();
+        setFlags(r, event);
+        r->state = CallEnded;
+    }
+}
+
+int CallJournal::finish(int slot, const Event &event)
+{
+    Finished finished;
+    finished.ticket = m_nextTicket++;
+    finished.slot = slot;
+    finished.event = event;
+    m_finished.append(finished);
+
+    scheduleSave(0);
+    return finished.ticket;
+}
+
+void CallJournal::replay()
+{
+    if (!open() || m_leftover.isEmpty())
+        return;
+
+    DEBUG() << Q_FUNC_INFO << m_leftover.size() << "calls left in journal";
+    m_replay = true;
+    scheduleSave(0);
+}
+
+Event CallJournal::recordEvent(const CallJournalRecord *r) const
+{
+    Event event;
+    event.setType(Event::CallEvent);
+    event.setLocalUid(QString::fromUtf8(r->localUid));
+    event.setRemoteUid(QString::fromUtf8(r->remoteUid));
+    event.setDirection(r->flags & FlagOutbound ? Event::Outbound : Event::Inbound);
+    event.setIsVideoCall(r->flags & FlagVideo);
+    event.setIsEmergencyCall(r->flags & FlagEmergency);
+
+    // Boot times are only compared within the same record, so they
+    // stay valid across a reboot.
+    QDateTime startTime = QDateTime::fromMSecsSinceEpoch(r->startTime);
+    qint64 durationFrom = r->startBoot;
+    if (r->answerBoot > 0) {
+        startTime = startTime.addMSecs(r->answerBoot - r->startBoot);
+        durationFrom = r->answerBoot;
+    }
+    event.setStartTime(startTime);
+
+    // A call the daemon didn't see end lasted until its last checkpoint
+    qint64 endBoot = r->state == CallEnded ? r->endBoot : r->checkpointBoot;
+    if (r->answerBoot > 0 && endBoot > durationFrom)
+        event.setEndTime(startTime.addMSecs(endBoot - durationFrom));
+    else
+        event.setEndTime(startTime);
+
+    // Unanswered incoming calls the daemon didn't see finish are missed
+    if (r->flags & FlagMissed
+        || (r->answerBoot == 0 && !(r->flags & FlagOutbound) && r->state != CallEnded))
+        event.setIsMissedCall(true);
+
+    return event;
+}
+
+void CallJournal::scheduleSave(int delay)
+{
+    if (!m_timer.isActive() || delay == 0)
+        m_timer.start(delay, this);
+}
+
+void CallJournal::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_timer.timerId()) {
+        m_timer.stop();
+        save();
+    } else {
+        QObject::timerEvent(event);
+    }
+}
+
+void CallJournal::save()
+{
+    QList<Event> events;
+    QList<int> usedSlots;
+
+    QList<int> leftover;
+    if (m_replay) {
+        leftover = m_leftover;
+        foreach (int slot, leftover) {
+            usedSlots.append(slot);
+            events.append(recordEvent(record(slot)));
+        }
+    }
+
+    QList<Finished> finished = m_finished;
+    foreach (const Finished &f, finished) {
+        if (f.slot >= 0)
+            usedSlots.append(f.slot);
+        events.append(f.event);
+    }
+
+    if (events.isEmpty())
+        return;
+
+    DEBUG() << Q_FUNC_INFO << "saving" << finished.size() << "finished and"
+            << leftover.size() << "left over calls";
+
+    EventModel model;
+    bool ok = model.addEvents(events);
+
+    if (!ok) {
+        qCritical() << "Failed to save calls from journal";
+        // the slots keep the calls if we don't get to try again
+        qint64 delay = qMin<qint64>(qint64(SAVE_RETRY_DELAY) << qMin(m_failures, 16),
+                                    MAX_SAVE_RETRY_DELAY);
+        m_failures++;
+        scheduleSave(delay);
+    } else {
+        m_failures = 0;
+        m_replay = false;
+        m_leftover.clear();
+        m_finished = m_finished.mid(finished.size());
+
+        foreach (int slot, usedSlots) {
+            if (CallJournalRecord *r = record(slot))
+                r->state = SlotFree;
+        }
+
+        foreach (const Event &event, events)
+            RecentCalls::instance()->add(event);
+    }
+
+    // events follow the left over calls in the same order
+    for (int i = 0; i < finished.size(); i++)
+        emit callSaved(finished.at(i).ticket, events.at(leftover.size() + i), ok);
+}
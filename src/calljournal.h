@@ -0,0 +1,120 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef CALLJOURNAL_H
+#define CALLJOURNAL_H
+
+#include <QObject>
+#include <QBasicTimer>
+#include <QFile>
+#include <QList>
+
+#include <CommHistory/Event>
+
+namespace RTComLogger {
+
+struct CallJournalRecord;
+
+/*!
+ * \class CallJournal
+ * \brief Write-ahead record of calls, saved to the database off the call path.
+ *
+ * A small memory-mapped file with a fixed number of slots. A call takes a
+ * slot when its channel appears, and the start, answer, checkpoints and end
+ * of the call are stored in it with CLOCK_BOOTTIME timestamps; these are
+ * plain memory writes, so call setup never waits on the database.
+ *
+ * Finished calls are saved to the database together from an idle step,
+ * and their slots are released once saved. Slots left over from a previous
+ * run are saved the same way after replay().
+ */
+class CallJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    static CallJournal* instance();
+
+    /*!
+     * Queues the calls left in the journal by a previous run to be saved.
+     */
+    void replay();
+
+    /*!
+     * Takes a slot for a new call. Returns the slot, or -1 if the journal
+     * is not available or full.
+     */
+    int begin(const CommHistory::Event &event);
+    void update(int slot, const CommHistory::Event &event);
+    void answered(int slot);
+    void checkpoint(int slot);
+    void ended(int slot, const CommHistory::Event &event);
+
+    /*!
+     * Queues the final call event to be saved from an idle step. The slot
+     * may be -1 if the call has none. Returns a ticket identifying the call
+     * in callSaved().
+     */
+    int finish(int slot, const CommHistory::Event &event);
+
+Q_SIGNALS:
+    void callSaved(int ticket, const CommHistory::Event &event, bool success);
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+private:
+    struct Finished {
+        int ticket;
+        int slot;
+        CommHistory::Event event;
+    };
+
+    explicit CallJournal(QObject *parent = 0);
+    ~CallJournal();
+
+    bool open();
+    CallJournalRecord* record(int slot) const;
+    CommHistory::Event recordEvent(const CallJournalRecord *r) const;
+    void scheduleSave(int delay);
+    void save();
+
+private:
+    static CallJournal* m_pInstance;
+
+    QFile m_file;
+    uchar *m_data;
+    // slots in use when the journal was opened, i.e. left by a previous run
+    QList<int> m_leftover;
+    bool m_replay;
+    QList<Finished> m_finished;
+    int m_nextTicket;
+    QBasicTimer m_timer;
+    int m_failures;
+
+#ifdef UNIT_TEST
+    friend class Ut_CallJournal;
+#endif
+};
+
+} // namespace RTComLogger
+
+#endif // CALLJOURNAL_H
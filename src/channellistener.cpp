@@ -35,8 +35,18 @@
 #include <TelepathyQt/Types>
 #include <TelepathyQt/Contact>
 
+#define SMS_FLASH_PROPERTY (TP_QT_IFACE_CHANNEL_INTERFACE_SMS + QLatin1String(".Flash"))
+#define TARGET_ID_PROPERTY (TP_QT_IFACE_CHANNEL + QLatin1String(".TargetID"))
+
 using namespace RTComLogger;
 
+ChannelContext::ChannelContext()
+    : eventType(CommHistory::Event::UnknownType),
+      chatType(CommHistory::Group::ChatTypeP2P),
+      isClassZero(false)
+{
+}
+
 ChannelListener::ChannelListener(const Tp::AccountPtr &account,
                                  const Tp::ChannelPtr &channel,
                                  const Tp::MethodInvocationContextPtr<> &context,
@@ -48,6 +58,19 @@ ChannelListener::ChannelListener(const Tp::AccountPtr &account,
             SIGNAL(invalidated(Tp::DBusProxy*, const QString&, const QString&)),
             this,
             SLOT(invalidated(Tp::DBusProxy*, const QString&, const QString&)));
+
+    if (m_Account)
+        m_Context.accountPath = m_Account->objectPath();
+
+    if (m_Channel) {
+        QVariantMap properties = m_Channel->immutableProperties();
+        m_Context.persistentId = properties.value(TELEPATHY_CHANNEL_INTERFACE_PERSISTENT_ID).toString();
+        if (!m_Context.persistentId.isEmpty())
+            m_Context.targetId = m_Context.persistentId;
+        else
+            m_Context.targetId = properties.value(TARGET_ID_PROPERTY).toString();
+        m_Context.isClassZero = properties.value(SMS_FLASH_PROPERTY).toBool();
+    }
 }
 
 void ChannelListener::slotChannelReady(Tp::PendingOperation* operation)
@@ -59,6 +82,13 @@ void ChannelListener::slotChannelReady(Tp::PendingOperation* operation)
             CommHistory::Event::Outbound :
             CommHistory::Event::Inbound;
         m_Connection = m_Channel->connection(); //ready channel has ready connection
+
+        if (m_Channel->targetHandleType() == Tp::HandleTypeRoom)
+            m_Context.chatType = CommHistory::Group::ChatTypeRoom;
+        else if (m_Channel->targetHandleType() == Tp::HandleTypeNone
+                 && m_Channel->interfaces().contains(TP_QT_IFACE_CHANNEL_INTERFACE_GROUP))
+            m_Context.chatType = CommHistory::Group::ChatTypeUnnamed;
+
         channelReady();
     } else {
         qCritical() << "Channel is not ready";
@@ -153,19 +183,14 @@ CommHistory::EventModel& ChannelListener::eventModel()
     return *m_pEventModel;
 }
 
-QString ChannelListener::targetId() const
+const QString& ChannelListener::targetId() const
 {
-    QString targetId;
-
-    QVariantMap properties = m_Channel->immutableProperties();
-
-    if (properties.contains(TELEPATHY_CHANNEL_INTERFACE_PERSISTENT_ID)) {
-        targetId = properties.value(TELEPATHY_CHANNEL_INTERFACE_PERSISTENT_ID).toString();
-    } else if (properties.contains(TP_QT_IFACE_CHANNEL+QLatin1String(".TargetID"))) {
-        targetId = properties.value(TP_QT_IFACE_CHANNEL+QLatin1String(".TargetID")).toString();
-    }
+    return m_Context.targetId;
+}
 
-    return targetId;
+const ChannelContext& ChannelListener::context() const
+{
+    return m_Context;
 }
 
 void ChannelListener::channelReady()
@@ -24,6 +24,7 @@
 #define CHANNEL_LISTENER_H
 
 #include <CommHistory/Event>
+#include <CommHistory/Group>
 #include <TelepathyQt/Types>
 #include <TelepathyQt/Channel>
 #include <TelepathyQt/Account>
@@ -35,6 +36,24 @@ namespace CommHistory {
 namespace RTComLogger
 {
 
+/*!
+ * \struct ChannelContext
+ * \brief Channel details that don't change over its lifetime, read once
+ * from the immutable properties so that per-message code does no map lookups.
+ */
+struct ChannelContext
+{
+    ChannelContext();
+
+    QString targetId;
+    QString persistentId;
+    QString accountPath;
+    CommHistory::Event::EventType eventType;
+    // valid once the channel is ready
+    CommHistory::Group::ChatType chatType;
+    bool isClassZero;
+};
+
 /*!
  * \class ChannelListener
  * \brief Base class for channel listeners. Handles basic channel, connection
@@ -70,7 +89,12 @@ public:
      * \brief returns target id from immutable properties
      * \return string with target id
      */
-    QString targetId() const;
+    const QString& targetId() const;
+
+    /*!
+     * \brief returns the precomputed details of the channel
+     */
+    const ChannelContext& context() const;
 
 public Q_SLOTS:
     /*!
@@ -126,6 +150,7 @@ protected:
     Tp::MethodInvocationContextPtr<> m_InvocationContext;
     CommHistory::Event::EventDirection m_Direction;
     CommHistory::EventModel* m_pEventModel;
+    ChannelContext m_Context;
 };
 
 } // namespace RTComLogger
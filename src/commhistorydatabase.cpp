@@ -0,0 +1,114 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "commhistorydatabase.h"
+#include "debug.h"
+
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStandardPaths>
+
+#define BUSY_TIMEOUT "QSQLITE_BUSY_TIMEOUT=5000"
+
+using namespace RTComLogger;
+
+namespace {
+
+bool checkSchemaVersion(QSqlDatabase &database)
+{
+    QSqlQuery query(database);
+    if (!query.exec(QLatin1String("PRAGMA user_version")) || !query.next()) {
+        qCritical() << "Cannot read commhistory schema version:" << query.lastError().text();
+        return false;
+    }
+
+    // Zero until libcommhistory has created the tables
+    int version = query.value(0).toInt();
+    if (version <= 0) {
+        qWarning() << "Commhistory database has no schema yet";
+        return false;
+    }
+
+    return true;
+}
+
+bool deletesCascade(QSqlDatabase &database, const QString &table)
+{
+    QSqlQuery query(database);
+    if (!query.exec(QString::fromLatin1("PRAGMA foreign_key_list(%1)").arg(table))) {
+        qCritical() << "Cannot read foreign keys of" << table << query.lastError().text();
+        return false;
+    }
+
+    // Columns: id, seq, table, from, to, on_update, on_delete, match
+    while (query.next()) {
+        if (query.value(2).toString() == QLatin1String("Events")
+            && query.value(6).toString() == QLatin1String("CASCADE"))
+            return true;
+    }
+
+    qWarning() << "Deleting events does not cascade to" << table;
+    return false;
+}
+
+}
+
+QString CommHistoryDatabase::databasePath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+            + QLatin1String("/commhistory/commhistory.db");
+}
+
+QString CommHistoryDatabase::dataPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+            + QLatin1String("/commhistory/data/");
+}
+
+QSqlDatabase CommHistoryDatabase::open(const QString &connectionName, OpenMode mode)
+{
+    QSqlDatabase database = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"), connectionName);
+    database.setDatabaseName(databasePath());
+    database.setConnectOptions(mode == ReadOnly
+                               ? QLatin1String("QSQLITE_OPEN_READONLY;" BUSY_TIMEOUT)
+                               : QLatin1String(BUSY_TIMEOUT));
+
+    if (!database.open()) {
+        qCritical() << "Cannot open commhistory database:" << database.lastError().text();
+        return database;
+    }
+
+    bool ok = checkSchemaVersion(database);
+    if (ok && mode == ReadWrite) {
+        // Message parts and event properties must go with their events
+        QSqlQuery query(database);
+        ok = query.exec(QLatin1String("PRAGMA foreign_keys = ON"));
+        if (!ok)
+            qCritical() << "Cannot enable foreign keys:" << query.lastError().text();
+        ok = ok && deletesCascade(database, QLatin1String("MessageParts"))
+                && deletesCascade(database, QLatin1String("EventProperties"));
+    }
+
+    if (!ok)
+        database.close();
+
+    return database;
+}
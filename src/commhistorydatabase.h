@@ -0,0 +1,63 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORYDATABASE_H
+#define COMMHISTORYDATABASE_H
+
+#include <QSqlDatabase>
+#include <QString>
+
+namespace RTComLogger {
+
+/*!
+ * \class CommHistoryDatabase
+ * \brief Direct SQLite connections to the libcommhistory database.
+ *
+ * Only for work libcommhistory has no API for. Connections are refused
+ * unless libcommhistory has created the schema, and writable connections
+ * also unless deleting an event cascades to the tables that refer to it.
+ */
+class CommHistoryDatabase
+{
+public:
+    enum OpenMode {
+        ReadOnly,
+        ReadWrite
+    };
+
+    static QString databasePath();
+
+    /*!
+     * Directory holding the message part directories of events, by event id.
+     */
+    static QString dataPath();
+
+    /*!
+     * Adds and opens a connection with the given name. Returns a closed
+     * connection if opening or the schema check failed; the caller removes
+     * the connection in either case.
+     */
+    static QSqlDatabase open(const QString &connectionName, OpenMode mode);
+};
+
+} // namespace RTComLogger
+
+#endif // COMMHISTORYDATABASE_H
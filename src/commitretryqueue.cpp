@@ -0,0 +1,351 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "commitretryqueue.h"
+#include "expungeaggregator.h"
+#include "messagetokencheck.h"
+#include "debug.h"
+
+#include <CommHistory/EventModel>
+#include <CommHistory/DatabaseIO>
+
+#include <QCoreApplication>
+#include <QtConcurrentRun>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTimerEvent>
+
+#define QUEUE_MAGIC          0x43525451u // "CRTQ"
+#define QUEUE_VERSION        2
+#define RETRY_INTERVAL       5000 //msec
+#define MAX_RETRY_INTERVAL   10*60000 //msec
+#define AVAILABLE_RETRY_DELAY 500 //msec
+#define MAX_RETRY_ATTEMPTS   8
+
+using namespace RTComLogger;
+using namespace CommHistory;
+
+CommitRetryQueue* CommitRetryQueue::m_pInstance = 0;
+
+CommitRetryQueue* CommitRetryQueue::instance()
+{
+    if (!m_pInstance)
+        m_pInstance = new CommitRetryQueue(QCoreApplication::instance());
+
+    return m_pInstance;
+}
+
+CommitRetryQueue::CommitRetryQueue(QObject *parent)
+    : QObject(parent),
+      m_failures(0),
+      m_due(0),
+      m_check(0),
+      m_checkCount(0),
+      m_model(0)
+{
+    qsrand(QDateTime::currentMSecsSinceEpoch());
+    m_clock.start();
+    m_path = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+            + QLatin1String("/commhistoryd/failed-events");
+    load();
+
+    // Events left by the previous run are saved before connections become
+    // ready, so the reviver finds them stored.
+    if (!m_entries.isEmpty())
+        start(0);
+}
+
+int CommitRetryQueue::size() const
+{
+    return m_entries.size();
+}
+
+void CommitRetryQueue::add(const QList<Event> &events, const Tp::ConnectionPtr &connection)
+{
+    if (events.isEmpty())
+        return;
+
+    foreach (const Event &event, events) {
+        Entry entry;
+        entry.event = event;
+        entry.event.setId(-1);
+        if (!connection.isNull()) {
+            entry.connectionPath = connection->objectPath();
+            entry.connection = connection;
+        }
+        m_entries.append(entry);
+    }
+
+    DEBUG() << Q_FUNC_INFO << events.size() << "events queued," << m_entries.size() << "in total";
+    save();
+
+    if (!m_timer.isActive() && !m_check)
+        schedule();
+}
+
+void CommitRetryQueue::databaseAvailable()
+{
+    // Retrying right here would hold up the listener, and use up attempts
+    // if the events still can't be saved; just don't wait for the back-off.
+    if (m_entries.isEmpty() || m_check)
+        return;
+
+    m_failures = 0;
+    if (!m_timer.isActive() || m_due > m_clock.elapsed() + AVAILABLE_RETRY_DELAY)
+        start(AVAILABLE_RETRY_DELAY);
+}
+
+void CommitRetryQueue::schedule()
+{
+    int interval = RETRY_INTERVAL << qMin(m_failures, 16);
+    interval = qMin(interval, MAX_RETRY_INTERVAL);
+    // +-25% so the daemon doesn't retry in step with other database users
+    interval += (qrand() % (interval / 2 + 1)) - interval / 4;
+
+    DEBUG() << Q_FUNC_INFO << "retrying" << m_entries.size() << "events in" << interval << "ms";
+    start(interval);
+}
+
+void CommitRetryQueue::start(int interval)
+{
+    m_due = m_clock.elapsed() + interval;
+    m_timer.start(interval, this);
+}
+
+void CommitRetryQueue::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_timer.timerId()) {
+        m_timer.stop();
+        retry();
+    } else {
+        QObject::timerEvent(event);
+    }
+}
+
+void CommitRetryQueue::retry()
+{
+    m_timer.stop();
+
+    if (m_entries.isEmpty() || m_check)
+        return;
+
+    // Skip events that got saved another way, e.g. revived after a restart
+    QSet<QString> tokens;
+    foreach (const Entry &entry, m_entries) {
+        if (!entry.event.messageToken().isEmpty())
+            tokens.insert(entry.event.messageToken());
+    }
+
+    m_checkCount = m_entries.size();
+    if (tokens.isEmpty()) {
+        commit(QSet<QString>());
+        return;
+    }
+
+    m_check = new QFutureWatcher<MessageTokenCheck>(this);
+    connect(m_check, SIGNAL(finished()), SLOT(onTokensChecked()));
+    m_check->setFuture(QtConcurrent::run(checkMessageTokens, QString(), tokens));
+}
+
+void CommitRetryQueue::onTokensChecked()
+{
+    MessageTokenCheck result = m_check->result();
+    m_check->deleteLater();
+    m_check = 0;
+
+    if (!result.ok) {
+        // The database can't be read either, so there's no point in writing
+        qWarning() << "Cannot check tokens of" << m_checkCount << "queued events";
+        m_failures++;
+        schedule();
+        return;
+    }
+
+    commit(result.existing.toSet());
+}
+
+void CommitRetryQueue::commit(const QSet<QString> &existing)
+{
+    if (!m_model)
+        m_model = new EventModel(this);
+
+    DatabaseIO &db = m_model->databaseIO();
+
+    QList<Event> saved;
+    QList<Entry> done;
+    QList<Tp::ConnectionPtr> failedConnections;
+    bool failed = false;
+
+    int count = qMin(m_checkCount, m_entries.size());
+
+    // The whole backlog goes in one transaction. Only if that fails are the
+    // events committed one by one, so one bad event can't hold back the rest.
+    QList<Event> batch;
+    for (int i = 0; i < count; i++) {
+        if (!existing.contains(m_entries.at(i).event.messageToken())) {
+            Event event = m_entries.at(i).event;
+            event.setId(-1);
+            batch.append(event);
+        }
+    }
+
+    bool batched = batch.isEmpty();
+    if (!batched && db.transaction()) {
+        batched = true;
+        for (int i = 0; batched && i < batch.size(); i++)
+            batched = db.addEvent(batch[i]);
+        batched = batched && db.commit();
+        if (!batched) {
+            db.rollback();
+            qWarning() << "Failed to save" << batch.size() << "queued events together, saving one by one";
+        }
+    }
+
+    if (batched) {
+        saved = batch;
+        for (int i = 0; i < count; i++)
+            done.append(m_entries.takeFirst());
+    } else {
+        for (int i = 0; i < count; i++) {
+            Entry &entry = m_entries.first();
+            if (!existing.contains(entry.event.messageToken())) {
+                Event event = entry.event;
+                event.setId(-1);
+                if (!db.transaction() || !db.addEvent(event) || !db.commit()) {
+                    db.rollback();
+                    failed = true;
+                    entry.attempts++;
+
+                    if (entry.attempts >= MAX_RETRY_ATTEMPTS) {
+                        qCritical() << "Giving up saving queued event after" << entry.attempts << "attempts:"
+                                    << entry.event.toString();
+                        if (!entry.connection.isNull() && !failedConnections.contains(entry.connection))
+                            failedConnections.append(entry.connection);
+                        m_entries.removeFirst();
+                    } else {
+                        qWarning() << "Failed to save queued event, attempt" << entry.attempts;
+                        // Don't let it hold back the events behind it
+                        m_entries.move(0, m_entries.size() - 1);
+                    }
+
+                    // Most likely the database is unavailable; back off
+                    break;
+                }
+                saved.append(event);
+            }
+            done.append(m_entries.takeFirst());
+        }
+    }
+
+    DEBUG() << Q_FUNC_INFO << "saved" << saved.size() << "queued events," << m_entries.size() << "left";
+
+    // Show the events in models; they are already in the database
+    if (!saved.isEmpty())
+        m_model->addEvents(saved, true);
+
+    foreach (const Entry &entry, done) {
+        if (entry.event.messageToken().isEmpty() || entry.connectionPath.isEmpty())
+            continue;
+
+        // Without a connection the token waits for the next one with this path
+        ExpungeAggregator *aggregator = entry.connection.isNull()
+                ? ExpungeAggregator::forConnectionPath(entry.connectionPath)
+                : ExpungeAggregator::forConnection(entry.connection);
+        aggregator->expunge(entry.event.messageToken());
+    }
+
+    save();
+
+    m_failures = failed ? m_failures + 1 : 0;
+    if (!m_entries.isEmpty())
+        schedule();
+
+    // try to redeliver the messages from the connection
+    foreach (const Tp::ConnectionPtr &connection, failedConnections)
+        emit savingFailed(connection);
+}
+
+void CommitRetryQueue::load()
+{
+    QFile file(m_path);
+    if (!file.exists())
+        return;
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Cannot open failed events queue:" << file.errorString();
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic, version;
+    qint32 count;
+    stream >> magic >> version >> count;
+    // Version 1 had no attempt counts
+    if (stream.status() != QDataStream::Ok || magic != QUEUE_MAGIC || version < 1 || version > QUEUE_VERSION) {
+        qWarning() << "Ignoring invalid failed events queue" << m_path;
+        return;
+    }
+
+    for (int i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        Entry entry;
+        stream >> entry.connectionPath >> entry.event;
+        if (version >= 2)
+            stream >> entry.attempts;
+        if (stream.status() == QDataStream::Ok)
+            m_entries.append(entry);
+    }
+
+    DEBUG() << Q_FUNC_INFO << "loaded" << m_entries.size() << "events";
+}
+
+void CommitRetryQueue::save()
+{
+    if (m_entries.isEmpty()) {
+        if (QFile::exists(m_path) && !QFile::remove(m_path))
+            qWarning() << "Cannot remove failed events queue" << m_path;
+        return;
+    }
+
+    QDir().mkpath(QFileInfo(m_path).path());
+
+    QSaveFile file(m_path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot open failed events queue:" << file.errorString();
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << quint32(QUEUE_MAGIC) << quint32(QUEUE_VERSION) << qint32(m_entries.size());
+    foreach (const Entry &entry, m_entries)
+        stream << entry.connectionPath << entry.event << qint32(entry.attempts);
+
+    if (!file.commit())
+        qWarning() << "Writing failed events queue failed:" << file.errorString();
+}
@@ -0,0 +1,129 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef COMMITRETRYQUEUE_H
+#define COMMITRETRYQUEUE_H
+
+#include <QObject>
+#include <QBasicTimer>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QList>
+#include <QSet>
+
+#include <TelepathyQt/Connection>
+#include <CommHistory/Event>
+
+#include "messagetokencheck.h"
+
+namespace CommHistory {
+    class EventModel;
+}
+
+namespace RTComLogger {
+
+/*!
+ * \class CommitRetryQueue
+ * \brief Daemon-wide queue of incoming events that failed to be saved.
+ *
+ * Events are written to a file under the data directory
+ * ("commhistoryd/failed-events") with their number of failed attempts, so
+ * they survive the listener that received them and a restart of the daemon.
+ *
+ * Each event is saved in its own transaction, so one that can't be saved
+ * doesn't hold back the others. A retry stops at the first failure, which
+ * moves that event to the end of the queue, and the next retry follows
+ * with exponential back-off and some jitter, or soon after another commit
+ * succeeds. Events whose message token is already in the database are
+ * skipped; the tokens are checked in a worker thread. The stored message
+ * tokens of saved events are expunged. An event that fails
+ * MAX_RETRY_ATTEMPTS times is dropped, and savingFailed() is emitted so
+ * the message can be revived from the connection instead.
+ */
+class CommitRetryQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    static CommitRetryQueue* instance();
+
+    /*!
+     * Queues events whose commit failed.
+     */
+    void add(const QList<CommHistory::Event> &events, const Tp::ConnectionPtr &connection);
+
+    /*!
+     * A commit succeeded, so the database is usable again; retries soon.
+     */
+    void databaseAvailable();
+
+    int size() const;
+
+Q_SIGNALS:
+    void savingFailed(const Tp::ConnectionPtr &connection);
+
+private Q_SLOTS:
+    void onTokensChecked();
+
+private:
+    struct Entry {
+        Entry() : attempts(0) {}
+
+        CommHistory::Event event;
+        QString connectionPath;
+        int attempts;
+        Tp::ConnectionPtr connection; // not stored
+    };
+
+    explicit CommitRetryQueue(QObject *parent = 0);
+
+    void load();
+    void save();
+    void retry();
+    void commit(const QSet<QString> &existing);
+    void schedule();
+    void start(int interval);
+    void timerEvent(QTimerEvent *event);
+
+private:
+    static CommitRetryQueue* m_pInstance;
+
+    QString m_path;
+    QList<Entry> m_entries;
+    // retries in a row that failed, for the back-off
+    int m_failures;
+    QBasicTimer m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_due;
+    QFutureWatcher<MessageTokenCheck> *m_check;
+    // entries at the start of the token check; later ones wait for the next retry
+    int m_checkCount;
+    CommHistory::EventModel *m_model;
+
+#ifdef UNIT_TEST
+    friend class Ut_CommitRetryQueue;
+#endif
+};
+
+} // namespace RTComLogger
+
+#endif // COMMITRETRYQUEUE_H
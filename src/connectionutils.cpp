@@ -26,14 +26,22 @@
 #include <TelepathyQt/PendingReady>
 #include <TelepathyQt/AccountSet>
 
+#include <QTimer>
+
 #include "debug.h"
 
+#define RING_ACCOUNT_PREFIX "/org/freedesktop/Telepathy/Account/ring/"
+#define RING_PRIORITY_TIMEOUT 3000 //msec
+
 using namespace RTComLogger;
 
-ConnectionUtils::ConnectionUtils(QObject* parent) : QObject(parent)
+ConnectionUtils::ConnectionUtils(QObject* parent) : QObject(parent),
+    m_HoldConnections(false)
 {
     DEBUG() << Q_FUNC_INFO;
 
+    m_Clock.start();
+
     Tp::registerTypes();
 
     m_AccountManager = Tp::AccountManager::create();
@@ -53,6 +61,16 @@ Tp::AccountManagerPtr ConnectionUtils::accountManager() const
     return m_AccountManager;
 }
 
+QMap<QString, AccountReadiness> ConnectionUtils::readiness() const
+{
+    return m_Readiness;
+}
+
+bool ConnectionUtils::isRingAccount(const QString &accountPath)
+{
+    return accountPath.startsWith(QLatin1String(RING_ACCOUNT_PREFIX));
+}
+
 void ConnectionUtils::prepareAccounts()
 {
     DEBUG() << Q_FUNC_INFO;
@@ -64,8 +82,21 @@ void ConnectionUtils::prepareAccounts()
                 SLOT(slotAddAccount(const Tp::AccountPtr &)),
                 Qt::UniqueConnection);
 
-        // initialise valid accounts
+        // initialise valid accounts, all at once with ring first
+        QList<Tp::AccountPtr> accounts;
         foreach(const Tp::AccountPtr &account, m_AccountManager->validAccounts()->accounts()) {
+            if (!account.isNull() && isRingAccount(account->objectPath()))
+                accounts.prepend(account);
+            else
+                accounts.append(account);
+        }
+
+        if (!accounts.isEmpty() && isRingAccount(accounts.first()->objectPath())) {
+            m_HoldConnections = true;
+            QTimer::singleShot(RING_PRIORITY_TIMEOUT, this, SLOT(releaseConnections()));
+        }
+
+        foreach(const Tp::AccountPtr &account, accounts) {
             prepareAccount(account);
         }
     }
@@ -84,7 +115,11 @@ void ConnectionUtils::slotAccountManagerReady(Tp::PendingOperation *op)
 
 void ConnectionUtils::prepareAccount(const Tp::AccountPtr &account)
 {
+    if (!account.isNull() && !m_Readiness.contains(account->objectPath()))
+        m_Readiness.insert(account->objectPath(), AccountReadiness());
+
     if(!account.isNull() && account->isReady()) {
+        m_Readiness[account->objectPath()].accountReady = m_Clock.elapsed();
         prepareConnection(account);
     } else if(!account.isNull() && !account->isReady()) {
         Tp::PendingOperation* po = account->becomeReady();
@@ -105,6 +140,9 @@ void ConnectionUtils::slotAccountReady( Tp::PendingOperation *op )
         Tp::AccountPtr account =
                 Tp::AccountPtr::qObjectCast(pr->proxy());
         if ( !account.isNull() && account->isReady() ) {
+            qint64 elapsed = m_Clock.elapsed();
+            m_Readiness[account->objectPath()].accountReady = elapsed;
+            DEBUG() << Q_FUNC_INFO << account->objectPath() << "ready after" << elapsed << "ms";
             prepareConnection(account);
         }
     }
@@ -138,9 +176,8 @@ void ConnectionUtils::prepareConnection(const Tp::AccountPtr &account)
 
     if(!connection.isNull()) {
         DEBUG() << Q_FUNC_INFO << "Connection object exists";
-        connect(connection->becomeReady(Tp::Connection::FeatureSimplePresence),
-                SIGNAL(finished(Tp::PendingOperation*)),
-                SLOT(slotConnectionReady(Tp::PendingOperation*)));
+        m_ConnectionAccounts.insert(connection->objectPath(), account->objectPath());
+        becomeReady(connection);
     } else {
         connect(account.data(),
                 SIGNAL(connectionChanged(const Tp::ConnectionPtr &)),
@@ -157,9 +194,8 @@ void ConnectionUtils::slotConnectionChanged(const Tp::ConnectionPtr &connection)
     if(account != 0 && account->isValid()) {
         if(!connection.isNull()) {
             DEBUG() << Q_FUNC_INFO << "Connection object exists";
-            connect(connection->becomeReady(Tp::Connection::FeatureSimplePresence),
-                    SIGNAL(finished(Tp::PendingOperation*)),
-                    SLOT(slotConnectionReady(Tp::PendingOperation*)));
+            m_ConnectionAccounts.insert(connection->objectPath(), account->objectPath());
+            becomeReady(connection);
         }
     }
 }
@@ -174,8 +210,44 @@ void ConnectionUtils::slotConnectionReady(Tp::PendingOperation* operation)
             Tp::ConnectionPtr connection = Tp::ConnectionPtr::qObjectCast(pr->proxy());
 
             if (!connection.isNull() && connection->isValid()) {
-                emit connectionReady(connection);
+                QString accountPath = m_ConnectionAccounts.value(connection->objectPath());
+                qint64 elapsed = m_Clock.elapsed();
+                if (m_Readiness.contains(accountPath))
+                    m_Readiness[accountPath].connectionReady = elapsed;
+                DEBUG() << Q_FUNC_INFO << connection->objectPath() << "ready after" << elapsed << "ms";
+
+                if (isRingAccount(accountPath)) {
+                    emit connectionReady(connection);
+                    releaseConnections();
+                } else if (m_HoldConnections) {
+                    m_HeldConnections.append(connection);
+                } else {
+                    emit connectionReady(connection);
+                }
             }
         }
     }
 }
+
+void ConnectionUtils::becomeReady(const Tp::ConnectionPtr &connection)
+{
+    connect(connection->becomeReady(Tp::Connection::FeatureSimplePresence),
+            SIGNAL(finished(Tp::PendingOperation*)),
+            SLOT(slotConnectionReady(Tp::PendingOperation*)));
+}
+
+void ConnectionUtils::releaseConnections()
+{
+    if (!m_HoldConnections)
+        return;
+
+    DEBUG() << Q_FUNC_INFO << m_HeldConnections.size() << "connections";
+    m_HoldConnections = false;
+
+    QList<Tp::ConnectionPtr> connections = m_HeldConnections;
+    m_HeldConnections.clear();
+    foreach (const Tp::ConnectionPtr &connection, connections) {
+        if (connection->isValid())
+            emit connectionReady(connection);
+    }
+}
@@ -24,6 +24,9 @@
 #define CONNECTIONUTILS_H
 
 #include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
 
 // Tp includes
 #include <TelepathyQt/Connection>
@@ -34,6 +37,30 @@
 namespace RTComLogger
 {
 
+/*!
+ * Startup timing of one account, in msecs since the ConnectionUtils
+ * instance was created (not since the daemon started); -1 if the step
+ * hasn't completed.
+ */
+struct AccountReadiness
+{
+    AccountReadiness() : accountReady(-1), connectionReady(-1) {}
+
+    qint64 accountReady;
+    qint64 connectionReady;
+};
+
+/*!
+ * \class ConnectionUtils
+ * \brief Makes all valid accounts and their connections ready and announces
+ * ready connections.
+ *
+ * All accounts are made ready in parallel, the ring account first. Until
+ * the ring connection is ready, or RING_PRIORITY_TIMEOUT has passed, other
+ * connections are held back, so that SMS revival doesn't queue behind slow
+ * IM accounts. The time each account and connection took is kept for
+ * startup profiling.
+ */
 class ConnectionUtils : public QObject
 {
     Q_OBJECT
@@ -43,6 +70,11 @@ public:
 
     Tp::AccountManagerPtr accountManager() const;
 
+    /*!
+     * Time to ready of each account seen so far, by account object path.
+     */
+    QMap<QString, AccountReadiness> readiness() const;
+
 Q_SIGNALS:
     void connectionReady(const Tp::ConnectionPtr& connection);
 
@@ -53,14 +85,24 @@ private Q_SLOTS:
         void slotAccountValidityChanged(bool valid);
         void slotConnectionChanged(const Tp::ConnectionPtr &connection);
         void slotConnectionReady(Tp::PendingOperation* operation);
+        void releaseConnections();
 
 private:
         void prepareAccounts();
         void prepareAccount(const Tp::AccountPtr &account);
         void prepareConnection(const Tp::AccountPtr &account);
+        void becomeReady(const Tp::ConnectionPtr &connection);
+        static bool isRingAccount(const QString &accountPath);
 
 private:
         Tp::AccountManagerPtr m_AccountManager;
+        QElapsedTimer m_Clock;
+        QMap<QString, AccountReadiness> m_Readiness;
+        // connection path to account path
+        QHash<QString, QString> m_ConnectionAccounts;
+        // other connections wait for the ring connection
+        QList<Tp::ConnectionPtr> m_HeldConnections;
+        bool m_HoldConnections;
 };
 
 } // namespace RTComLogger
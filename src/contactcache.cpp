@@ -0,0 +1,363 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "contactcache.h"
+#include "debug.h"
+
+#include <TelepathyQt/ContactManager>
+#include <TelepathyQt/PendingContacts>
+#include <TelepathyQt/Presence>
+
+#include <QCoreApplication>
+#include <QTimerEvent>
+
+using namespace RTComLogger;
+
+QHash<QString, ContactCache*> ContactCache::m_caches;
+
+namespace {
+
+Tp::Features contactFeatures()
+{
+    Tp::Features features;
+    features << Tp::Contact::FeatureSimplePresence;
+    features << Tp::Contact::FeatureAlias;
+    return features;
+}
+
+}
+
+ContactCache* ContactCache::forConnection(const Tp::ConnectionPtr &connection)
+{
+    if (connection.isNull())
+        return 0;
+
+    ContactCache *cache = m_caches.value(connection->objectPath());
+    if (cache && cache->m_connection != connection) {
+        // A new connection object for the path; nothing carries over
+        m_caches.remove(connection->objectPath());
+        cache->deleteLater();
+        cache = 0;
+    }
+
+    if (!cache) {
+        cache = new ContactCache(connection, QCoreApplication::instance());
+        m_caches.insert(connection->objectPath(), cache);
+    }
+
+    return cache;
+}
+
+ContactCache::ContactCache(const Tp::ConnectionPtr &connection, QObject *parent)
+    : QObject(parent),
+      m_connection(connection)
+{
+    connect(m_connection.data(),
+            SIGNAL(invalidated(Tp::DBusProxy*,QString,QString)),
+            SLOT(onConnectionInvalidated()));
+}
+
+QList<Tp::ContactPtr> ContactCache::contactsForHandles(ContactCacheListener *listener,
+                                                       const Tp::UIntList &handles)
+{
+    QList<Tp::ContactPtr> ready;
+
+    foreach (uint handle, handles) {
+        Tp::ContactPtr contact = m_contacts.value(handle);
+        if (!contact.isNull()) {
+            ready << contact;
+            continue;
+        }
+
+        addWaiting(listener, handle);
+        if (!m_pending.contains(handle)) {
+            m_pending.insert(handle);
+            m_queuedHandles << handle;
+        }
+    }
+
+    if (!m_queuedHandles.isEmpty() && !m_timer.isActive())
+        m_timer.start(0, this);
+
+    return ready;
+}
+
+QList<Tp::ContactPtr> ContactCache::upgradeContacts(ContactCacheListener *listener,
+                                                    const QList<Tp::ContactPtr> &contacts)
+{
+    QList<Tp::ContactPtr> ready;
+
+    foreach (const Tp::ContactPtr &contact, contacts) {
+        if (contact.isNull())
+            continue;
+
+        uint handle = contact->handle().first();
+        Tp::ContactPtr known = m_contacts.value(handle);
+        if (!known.isNull()) {
+            ready << known;
+            continue;
+        }
+
+        addWaiting(listener, handle);
+        if (!m_pending.contains(handle)) {
+            m_pending.insert(handle);
+            m_queuedContacts << contact;
+        }
+    }
+
+    if (!m_queuedContacts.isEmpty() && !m_timer.isActive())
+        m_timer.start(0, this);
+
+    return ready;
+}
+
+void ContactCache::addWaiting(ContactCacheListener *listener, uint handle)
+{
+    if (listener && !m_waiting.contains(handle, listener))
+        m_waiting.insert(handle, listener);
+}
+
+void ContactCache::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_timer.timerId()) {
+        m_timer.stop();
+        fetch();
+    } else {
+        QObject::timerEvent(event);
+    }
+}
+
+void ContactCache::fetch()
+{
+    if (m_connection.isNull())
+        return;
+
+    Tp::ContactManagerPtr contactManager = m_connection->contactManager();
+
+    if (!m_queuedHandles.isEmpty()) {
+        DEBUG() << Q_FUNC_INFO << "fetching" << m_queuedHandles.size() << "contacts";
+        Tp::PendingContacts *pc = contactManager->contactsForHandles(m_queuedHandles,
+                                                                     contactFeatures());
+        connect(pc, SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(onContactsFinished(Tp::PendingOperation*)));
+        m_requests.insert(pc, m_queuedHandles);
+        m_queuedHandles.clear();
+    }
+
+    if (!m_queuedContacts.isEmpty()) {
+        DEBUG() << Q_FUNC_INFO << "upgrading" << m_queuedContacts.size() << "contacts";
+        Tp::PendingContacts *pc = contactManager->upgradeContacts(m_queuedContacts,
+                                                                  contactFeatures());
+        connect(pc, SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(onContactsFinished(Tp::PendingOperation*)));
+        QList<uint> handles;
+        foreach (const Tp::ContactPtr &contact, m_queuedContacts)
+            handles << contact->handle().first();
+        m_requests.insert(pc, handles);
+        m_queuedContacts.clear();
+    }
+}
+
+void ContactCache::onContactsFinished(Tp::PendingOperation *operation)
+{
+    QList<uint> handles = m_requests.take(operation);
+    Tp::PendingContacts *pc = qobject_cast<Tp::PendingContacts*>(operation);
+    if (!pc)
+        return;
+
+    QHash<ContactCacheListener*, QList<Tp::ContactPtr> > ready;
+    QHash<ContactCacheListener*, QList<uint> > failed;
+
+    if (pc->isError()) {
+        qWarning() << "No presence contacts" << pc->errorMessage();
+    } else {
+        foreach (const Tp::ContactPtr &contact, pc->contacts()) {
+            if (contact.isNull())
+                continue;
+
+            uint handle = contact->handle().first();
+            m_pending.remove(handle);
+            addContact(contact);
+            foreach (ContactCacheListener *listener, m_waiting.values(handle))
+                ready[listener] << contact;
+            m_waiting.remove(handle);
+            handles.removeAll(handle);
+        }
+    }
+
+    // The rest of the request failed; let the handles be requested again
+    foreach (uint handle, handles) {
+        if (!m_pending.remove(handle))
+            continue;
+
+        m_pendingOwners.remove(handle);
+        foreach (ContactCacheListener *listener, m_waiting.values(handle))
+            failed[listener] << handle;
+        m_waiting.remove(handle);
+    }
+
+    if (!handles.isEmpty())
+        DEBUG() << Q_FUNC_INFO << "failed to get" << handles.size() << "contacts";
+
+    QHashIterator<ContactCacheListener*, QList<Tp::ContactPtr> > r(ready);
+    while (r.hasNext()) {
+        r.next();
+        r.key()->contactsReady(r.value());
+    }
+
+    QHashIterator<ContactCacheListener*, QList<uint> > f(failed);
+    while (f.hasNext()) {
+        f.next();
+        f.key()->contactsFailed(f.value());
+    }
+}
+
+void ContactCache::addContact(const Tp::ContactPtr &contact)
+{
+    uint handle = contact->handle().first();
+    if (!m_contacts.contains(handle)) {
+        m_contacts.insert(handle, contact);
+        m_presences.insert(contact->id(), Presence(contact->presence().status(),
+                                                   contact->presence().statusMessage()));
+        connect(contact.data(), SIGNAL(presenceChanged(const Tp::Presence &)),
+                SLOT(onPresenceChanged(const Tp::Presence &)));
+    }
+
+    QList<uint> owned = m_pendingOwners.values(handle);
+    foreach (uint ownedHandle, owned) {
+        m_handleOwnerIds.insert(ownedHandle, contact->id());
+        DEBUG() << Q_FUNC_INFO << "added handle owner:" << ownedHandle << contact->id();
+    }
+    m_pendingOwners.remove(handle);
+}
+
+void ContactCache::onPresenceChanged(const Tp::Presence &presence)
+{
+    Tp::Contact *contact = qobject_cast<Tp::Contact *>(sender());
+    if (!contact) {
+        qWarning() << Q_FUNC_INFO << ": invalid contact";
+        return;
+    }
+
+    Presence previous = m_presences.value(contact->id());
+    m_presences.insert(contact->id(), Presence(presence.status(), presence.statusMessage()));
+
+    foreach (ContactCacheListener *listener, m_presenceListeners.values(contact->id()))
+        listener->presenceChanged(contact->id(), contact->handle().first(), previous.first, previous.second);
+}
+
+bool ContactCache::hasPresence(const QString &contactId) const
+{
+    return m_presences.contains(contactId);
+}
+
+ContactCache::Presence ContactCache::presence(const QString &contactId) const
+{
+    return m_presences.value(contactId);
+}
+
+void ContactCache::subscribePresence(ContactCacheListener *listener, const QString &contactId)
+{
+    if (!m_presenceListeners.contains(contactId, listener))
+        m_presenceListeners.insert(contactId, listener);
+}
+
+void ContactCache::unsubscribePresence(ContactCacheListener *listener, const QString &contactId)
+{
+    m_presenceListeners.remove(contactId, listener);
+}
+
+void ContactCache::unsubscribe(ContactCacheListener *listener)
+{
+    QMutableHashIterator<uint, ContactCacheListener*> w(m_waiting);
+    while (w.hasNext()) {
+        if (w.next().value() == listener)
+            w.remove();
+    }
+
+    QMutableHashIterator<QString, ContactCacheListener*> p(m_presenceListeners);
+    while (p.hasNext()) {
+        if (p.next().value() == listener)
+            p.remove();
+    }
+}
+
+void ContactCache::addHandleOwners(const Tp::HandleOwnerMap &handleOwners)
+{
+    Tp::UIntList fetchOwners;
+
+    QMapIterator<uint, uint> i(handleOwners);
+    while (i.hasNext()) {
+        i.next();
+        if (!i.value())
+            continue;
+
+        Tp::ContactPtr owner = m_contacts.value(i.value());
+        if (!owner.isNull()) {
+            m_handleOwnerIds.insert(i.key(), owner->id());
+        } else {
+            m_pendingOwners.insert(i.value(), i.key());
+            fetchOwners << i.value();
+        }
+    }
+
+    if (!fetchOwners.isEmpty())
+        contactsForHandles(0, fetchOwners);
+}
+
+void ContactCache::removeHandleOwners(const Tp::UIntList &handles)
+{
+    foreach (uint handle, handles)
+        m_handleOwnerIds.remove(handle);
+}
+
+QString ContactCache::handleOwnerId(uint handle) const
+{
+    return m_handleOwnerIds.value(handle);
+}
+
+void ContactCache::onConnectionInvalidated()
+{
+    DEBUG() << Q_FUNC_INFO << m_connection->objectPath() << "dropping" << m_contacts.size() << "contacts";
+
+    if (m_caches.value(m_connection->objectPath()) == this)
+        m_caches.remove(m_connection->objectPath());
+
+    QSet<ContactCacheListener*> listeners = m_waiting.values().toSet();
+    listeners.unite(m_presenceListeners.values().toSet());
+
+    m_timer.stop();
+    m_contacts.clear();
+    m_presences.clear();
+    m_pending.clear();
+    m_queuedHandles.clear();
+    m_queuedContacts.clear();
+    m_requests.clear();
+    m_waiting.clear();
+    m_presenceListeners.clear();
+    m_handleOwnerIds.clear();
+    m_pendingOwners.clear();
+    deleteLater();
+
+    foreach (ContactCacheListener *listener, listeners)
+        listener->contactsDropped();
+}
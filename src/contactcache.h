@@ -0,0 +1,168 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef CONTACTCACHE_H
+#define CONTACTCACHE_H
+
+#include <QObject>
+#include <QBasicTimer>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QSet>
+#include <QString>
+
+#include <TelepathyQt/Connection>
+#include <TelepathyQt/Contact>
+#include <TelepathyQt/Types>
+
+namespace Tp {
+    class PendingOperation;
+    class Presence;
+}
+
+namespace RTComLogger {
+
+/*!
+ * \class ContactCacheListener
+ * \brief Receives the contacts and presence changes it asked a ContactCache for.
+ */
+class ContactCacheListener
+{
+public:
+    virtual ~ContactCacheListener() {}
+
+    virtual void contactsReady(const QList<Tp::ContactPtr> &contacts) { Q_UNUSED(contacts); }
+    virtual void contactsFailed(const QList<uint> &handles) { Q_UNUSED(handles); }
+    virtual void presenceChanged(const QString &contactId, uint handle,
+                                 const QString &previousStatus, const QString &previousMessage)
+    {
+        Q_UNUSED(contactId); Q_UNUSED(handle);
+        Q_UNUSED(previousStatus); Q_UNUSED(previousMessage);
+    }
+    // The cache was dropped with its connection; all presence is unknown
+    virtual void contactsDropped() {}
+};
+
+/*!
+ * \class ContactCache
+ * \brief Contacts, presence and handle owners of one connection, shared by its channels.
+ *
+ * Contacts are kept with presence and alias. Requests made by channels in
+ * the same event loop iteration are merged into one contact manager call,
+ * and contacts already known or being fetched are not requested again.
+ * A contact becoming ready, or failing to, is reported only to the
+ * listeners that asked for its handle, and a presence change only to the
+ * listeners subscribed to the contact id. Each contact's presence is
+ * tracked once, however many channels it is in.
+ *
+ * The cache is dropped when its connection is invalidated.
+ */
+class ContactCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    // status, status message
+    typedef QPair<QString,QString> Presence;
+
+    /*!
+     * Returns the cache of the connection, creating it if needed.
+     */
+    static ContactCache* forConnection(const Tp::ConnectionPtr &connection);
+
+    /*!
+     * Returns the contacts of the handles that are ready; the others are
+     * fetched and reported to the listener, which may be null.
+     */
+    QList<Tp::ContactPtr> contactsForHandles(ContactCacheListener *listener,
+                                             const Tp::UIntList &handles);
+
+    /*!
+     * Returns the contacts that are ready; the others are upgraded and
+     * reported to the listener.
+     */
+    QList<Tp::ContactPtr> upgradeContacts(ContactCacheListener *listener,
+                                          const QList<Tp::ContactPtr> &contacts);
+
+    bool hasPresence(const QString &contactId) const;
+    Presence presence(const QString &contactId) const;
+
+    void subscribePresence(ContactCacheListener *listener, const QString &contactId);
+    void unsubscribePresence(ContactCacheListener *listener, const QString &contactId);
+
+    /*!
+     * Removes all requests and subscriptions of the listener.
+     */
+    void unsubscribe(ContactCacheListener *listener);
+
+    /*!
+     * Resolves the owners of channel specific handles, mapped to their owner
+     * handles. The owner ids are available from handleOwnerId() once ready.
+     */
+    void addHandleOwners(const Tp::HandleOwnerMap &handleOwners);
+    void removeHandleOwners(const Tp::UIntList &handles);
+    QString handleOwnerId(uint handle) const;
+
+private Q_SLOTS:
+    void onContactsFinished(Tp::PendingOperation *operation);
+    void onPresenceChanged(const Tp::Presence &presence);
+    void onConnectionInvalidated();
+
+private:
+    explicit ContactCache(const Tp::ConnectionPtr &connection, QObject *parent = 0);
+
+    void timerEvent(QTimerEvent *event);
+    void fetch();
+    void addContact(const Tp::ContactPtr &contact);
+    void addWaiting(ContactCacheListener *listener, uint handle);
+
+private:
+    static QHash<QString, ContactCache*> m_caches;
+
+    Tp::ConnectionPtr m_connection;
+    QHash<uint, Tp::ContactPtr> m_contacts;
+    QHash<QString, Presence> m_presences;
+    // handles in a request, or queued for the next one
+    QSet<uint> m_pending;
+    Tp::UIntList m_queuedHandles;
+    QList<Tp::ContactPtr> m_queuedContacts;
+    // handles of each contact manager call in flight
+    QHash<Tp::PendingOperation*, QList<uint> > m_requests;
+    QBasicTimer m_timer;
+
+    // pending handle -> listeners waiting for its contact
+    QMultiHash<uint, ContactCacheListener*> m_waiting;
+    // contact id -> listeners of its presence
+    QMultiHash<QString, ContactCacheListener*> m_presenceListeners;
+
+    QHash<uint, QString> m_handleOwnerIds;
+    // owner handle -> channel specific handles waiting for it
+    QMultiHash<uint, uint> m_pendingOwners;
+#ifdef UNIT_TEST
+    friend class Ut_TextChannelListener;
+#endif
+};
+
+} // namespace RTComLogger
+
+#endif // CONTACTCACHE_H
@@ -0,0 +1,534 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "conversationindex.h"
+#include "debug.h"
+
+#include <CommHistory/EventModel>
+#include <CommHistory/DatabaseIO>
+#include <CommHistory/groupmanager.h>
+#include <CommHistory/commonutils.h>
+
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusMetaType>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QScopedPointer>
+#include <QStandardPaths>
+#include <QTimer>
+#include <QTimerEvent>
+
+#include <string.h>
+
+using namespace RTComLogger;
+using namespace CommHistory;
+
+// Give the daemon time to get its D-Bus services up before loading groups
+#define INDEX_LOAD_DELAY 2000
+
+#define SNAPSHOT_MAGIC       0x43494458u // "CIDX"
+#define SNAPSHOT_VERSION     2
+#define SNAPSHOT_WRITE_DELAY 5000
+
+#define COMMHISTORY_INTERFACE "com.nokia.commhistory"
+#define GROUPS_DELETED_SIGNAL "groupsDeleted"
+
+namespace {
+
+/* The snapshot is a SnapshotHeader followed by recordCount records. Each
+ * record is a SnapshotRecord followed by the UTF-8 local uid and chat name,
+ * and remoteCount remote uids, each a quint16 length and UTF-8 data.
+ * Values are in host byte order; the file never leaves the device.
+ */
+struct SnapshotHeader {
+    quint32 magic;
+    quint32 version;
+    quint32 recordCount;
+    quint32 dataSize;       // bytes following the header
+};
+
+struct SnapshotRecord {
+    qint32 id;
+    qint32 chatType;
+    quint16 localUidLength;
+    quint16 chatNameLength;
+    quint16 remoteCount;
+    quint16 reserved;
+};
+
+class SnapshotReader
+{
+public:
+    SnapshotReader(const uchar *data, quint32 size)
+        : m_pos(data), m_end(data + size)
+    {
+    }
+
+    bool read(void *dest, quint32 size)
+    {
+        if (quint32(m_end - m_pos) < size)
+            return false;
+        memcpy(dest, m_pos, size);
+        m_pos += size;
+        return true;
+    }
+
+    bool readString(quint32 size, QString *dest)
+    {
+        if (quint32(m_end - m_pos) < size)
+            return false;
+        *dest = QString::fromUtf8(reinterpret_cast<const char*>(m_pos), size);
+        m_pos += size;
+        return true;
+    }
+
+private:
+    const uchar *m_pos;
+    const uchar *m_end;
+};
+
+void appendString(QByteArray &data, const QByteArray &string)
+{
+    data.append(string.constData(), string.size());
+}
+
+}
+
+ConversationIndex* ConversationIndex::m_pInstance = 0;
+
+ConversationIndex* ConversationIndex::instance()
+{
+    if (!m_pInstance)
+        m_pInstance = new ConversationIndex(QCoreApplication::instance());
+
+    return m_pInstance;
+}
+
+ConversationIndex::ConversationIndex(QObject *parent)
+    : QObject(parent),
+      m_manager(0),
+      m_ready(false),
+      m_warm(false)
+{
+    m_snapshotPath = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+            + QLatin1String("/commhistoryd/conversation-index");
+}
+
+void ConversationIndex::prewarm()
+{
+    if (m_manager)
+        return;
+
+    QTimer::singleShot(INDEX_LOAD_DELAY, this, SLOT(load()));
+}
+
+void ConversationIndex::load()
+{
+    if (m_manager)
+        return;
+
+    DEBUG() << Q_FUNC_INFO;
+
+    m_manager = new GroupManager(this);
+    m_manager->setQueryMode(EventModel::AsyncQuery);
+    connect(m_manager, &GroupManager::modelReady, this, &ConversationIndex::slotModelReady);
+    connect(m_manager, &GroupManager::groupAdded, this, &ConversationIndex::slotGroupAdded);
+    connect(m_manager, &GroupManager::groupUpdated, this, &ConversationIndex::slotGroupUpdated);
+    connect(m_manager, &GroupManager::groupDeleted, this, &ConversationIndex::slotGroupDeleted);
+
+    if (!m_manager->getGroups()) {
+        qCritical() << "Failed to load conversation index";
+        delete m_manager;
+        m_manager = 0;
+    }
+}
+
+bool ConversationIndex::isReady() const
+{
+    return m_ready;
+}
+
+bool ConversationIndex::isWarm() const
+{
+    return m_ready || m_warm;
+}
+
+void ConversationIndex::loadSnapshot()
+{
+    if (isWarm())
+        return;
+
+    QFile file(m_snapshotPath);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    const qint64 size = file.size();
+    if (size < qint64(sizeof(SnapshotHeader))) {
+        qWarning() << "Ignoring truncated conversation index snapshot";
+        return;
+    }
+
+    uchar *data = file.map(0, size);
+    file.close();
+    if (!data) {
+        qWarning() << "Cannot map conversation index snapshot:" << file.errorString();
+        return;
+    }
+
+    SnapshotHeader header;
+    memcpy(&header, data, sizeof(SnapshotHeader));
+
+    if (header.magic != SNAPSHOT_MAGIC
+        || header.version != SNAPSHOT_VERSION
+        || header.dataSize != size - sizeof(SnapshotHeader)) {
+        qWarning() << "Ignoring invalid conversation index snapshot";
+    } else {
+        SnapshotReader reader(data + sizeof(SnapshotHeader), header.dataSize);
+        bool ok = true;
+        for (quint32 i = 0; ok && i < header.recordCount; i++) {
+            SnapshotRecord record;
+            QString localUid, chatName;
+            QStringList remoteUids;
+            ok = reader.read(&record, sizeof(SnapshotRecord))
+                 && reader.readString(record.localUidLength, &localUid)
+                 && reader.readString(record.chatNameLength, &chatName);
+            for (quint16 j = 0; ok && j < record.remoteCount; j++) {
+                quint16 length;
+                QString remoteUid;
+                ok = reader.read(&length, sizeof(length)) && reader.readString(length, &remoteUid);
+                remoteUids.append(remoteUid);
+            }
+            if (!ok)
+                break;
+
+            Group group;
+            group.setId(record.id);
+            group.setLocalUid(localUid);
+            group.setRemoteUids(remoteUids);
+            group.setChatType(static_cast<Group::ChatType>(record.chatType));
+            group.setChatName(chatName);
+            insert(group);
+        }
+
+        if (ok) {
+            m_warm = true;
+            DEBUG() << Q_FUNC_INFO << m_groups.size() << "groups from snapshot";
+        } else {
+            qWarning() << "Ignoring corrupted conversation index snapshot";
+            m_groups.clear();
+            m_index.clear();
+        }
+    }
+
+    file.unmap(data);
+
+    if (m_warm) {
+        // Until the full load, nothing else tells us about groups deleted
+        // by other processes
+        qDBusRegisterMetaType<QList<int> >();
+        QDBusConnection::sessionBus().connect(QString(), QString(),
+                                              COMMHISTORY_INTERFACE, GROUPS_DELETED_SIGNAL,
+                                              this, SLOT(slotGroupsDeleted(QList<int>)));
+    }
+}
+
+void ConversationIndex::scheduleSnapshot()
+{
+    if (m_ready && !m_snapshotTimer.isActive())
+        m_snapshotTimer.start(SNAPSHOT_WRITE_DELAY, this);
+}
+
+void ConversationIndex::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_snapshotTimer.timerId()) {
+        m_snapshotTimer.stop();
+        writeSnapshot();
+    } else {
+        QObject::timerEvent(event);
+    }
+}
+
+void ConversationIndex::writeSnapshot()
+{
+    if (!m_ready || !m_manager)
+        return;
+
+    SnapshotHeader header;
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.recordCount = 0;
+
+    QByteArray data;
+    QHash<int, Group>::const_iterator it = m_groups.constBegin();
+    for (; it != m_groups.constEnd(); ++it) {
+        QByteArray localUid = it->localUid().toUtf8().left(0xffff);
+        QByteArray chatName = it->chatName().toUtf8().left(0xffff);
+        QStringList remoteUids = it->remoteUids().mid(0, 0xffff);
+
+        SnapshotRecord record;
+        record.id = it->id();
+        record.chatType = it->chatType();
+        record.localUidLength = localUid.size();
+        record.chatNameLength = chatName.size();
+        record.remoteCount = remoteUids.size();
+        record.reserved = 0;
+        data.append(reinterpret_cast<const char*>(&record), sizeof(SnapshotRecord));
+        appendString(data, localUid);
+        appendString(data, chatName);
+        foreach (const QString &remoteUid, remoteUids) {
+            QByteArray remote = remoteUid.toUtf8().left(0xffff);
+            quint16 length = remote.size();
+            data.append(reinterpret_cast<const char*>(&length), sizeof(length));
+            appendString(data, remote);
+        }
+        header.recordCount++;
+    }
+    header.dataSize = data.size();
+
+    QDir().mkpath(QFileInfo(m_snapshotPath).path());
+    QSaveFile file(m_snapshotPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot open conversation index snapshot:" << file.errorString();
+        return;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(SnapshotHeader));
+    file.write(data);
+    if (!file.commit())
+        qWarning() << "Writing conversation index snapshot failed:" << file.errorString();
+    else
+        DEBUG() << Q_FUNC_INFO << header.recordCount << "groups written";
+}
+
+QString ConversationIndex::normalizedAddress(const QString &localUid, const QString &remoteUid)
+{
+    // Phone numbers in different formats must land in the same bucket;
+    // candidates are still confirmed with remoteAddressMatch.
+    if (localUidComparesPhoneNumbers(localUid))
+        return minimizePhoneNumber(remoteUid);
+
+    return remoteUid.toLower();
+}
+
+QString ConversationIndex::indexKey(const QString &localUid, const QStringList &remoteUids)
+{
+    if (remoteUids.size() == 1)
+        return localUid + QLatin1Char('\n') + normalizedAddress(localUid, remoteUids.first());
+
+    // Multi-party groups are keyed on all members, independent of order
+    QStringList addresses;
+    addresses.reserve(remoteUids.size());
+    foreach (const QString &remoteUid, remoteUids)
+        addresses.append(normalizedAddress(localUid, remoteUid));
+    addresses.sort();
+
+    return localUid + QLatin1Char('\n') + addresses.join(QLatin1Char(';'));
+}
+
+bool ConversationIndex::remoteUidsMatch(const Group &group, const QStringList &remoteUids)
+{
+    if (group.remoteUids().size() != remoteUids.size())
+        return false;
+
+    foreach (const QString &remoteUid, remoteUids) {
+        bool found = false;
+        foreach (const QString &member, group.remoteUids()) {
+            if (remoteAddressMatch(group.localUid(), member, remoteUid)) {
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            return false;
+    }
+
+    return true;
+}
+
+Group ConversationIndex::fromGroupObject(GroupObject *object)
+{
+    Group group;
+    group.setId(object->id());
+    group.setLocalUid(object->localUid());
+    group.setRemoteUids(object->remoteUids());
+    group.setChatType(object->chatType());
+    group.setChatName(object->chatName());
+    return group;
+}
+
+void ConversationIndex::insert(const Group &group)
+{
+    if (!group.isValid() || group.remoteUids().isEmpty())
+        return;
+
+    remove(group.id());
+    m_groups.insert(group.id(), group);
+    m_index.insert(indexKey(group.localUid(), group.remoteUids()), group.id());
+    scheduleSnapshot();
+}
+
+void ConversationIndex::remove(int groupId)
+{
+    QHash<int, Group>::iterator it = m_groups.find(groupId);
+    if (it == m_groups.end())
+        return;
+
+    m_index.remove(indexKey(it->localUid(), it->remoteUids()), groupId);
+    m_groups.erase(it);
+    scheduleSnapshot();
+}
+
+Group ConversationIndex::lookup(const QString &localUid, const QStringList &remoteUids) const
+{
+    const QString key = indexKey(localUid, remoteUids);
+    QMultiHash<QString, int>::const_iterator it = m_index.constFind(key);
+    for (; it != m_index.constEnd() && it.key() == key; ++it) {
+        const Group &group = m_groups[it.value()];
+        if (remoteUidsMatch(group, remoteUids))
+            return group;
+    }
+
+    return Group();
+}
+
+Group ConversationIndex::findGroup(const QString &localUid, const QString &remoteUid)
+{
+    return findGroup(localUid, QStringList() << remoteUid);
+}
+
+Group ConversationIndex::findGroup(const QString &localUid, const QStringList &remoteUids)
+{
+    if (remoteUids.isEmpty())
+        return Group();
+
+    if (m_ready)
+        return lookup(localUid, remoteUids);
+
+    if (m_warm) {
+        Group group = confirmSnapshot(lookup(localUid, remoteUids));
+        if (group.localUid() == localUid && remoteUidsMatch(group, remoteUids))
+            return group;
+        // may have been added or changed after the snapshot was written
+    }
+
+    // Not loaded yet: query only the groups of this remote address, or of
+    // the account for multi-party groups. Not cached, nothing would keep
+    // the entry up to date until loaded.
+    DEBUG() << Q_FUNC_INFO << "index not ready, querying" << localUid << remoteUids;
+    GroupManager manager;
+    if (!manager.getGroups(localUid, remoteUids.size() == 1 ? remoteUids.first() : QString()))
+        return Group();
+
+    foreach (GroupObject *object, manager.groups()) {
+        Group group = fromGroupObject(object);
+        if (group.localUid() == localUid && remoteUidsMatch(group, remoteUids))
+            return group;
+    }
+
+    return Group();
+}
+
+Group ConversationIndex::confirmSnapshot(const Group &candidate)
+{
+    if (!candidate.isValid())
+        return Group();
+
+    // The snapshot may be older than the database; other processes can have
+    // renamed, changed or deleted the group, or reused its address since.
+    Group group;
+    EventModel model;
+    if (!model.databaseIO().getGroup(candidate.id(), group) || !group.isValid()) {
+        DEBUG() << Q_FUNC_INFO << "group" << candidate.id() << "is gone";
+        remove(candidate.id());
+        return Group();
+    }
+
+    remove(candidate.id());
+    insert(group);
+    return group;
+}
+
+bool ConversationIndex::addGroup(Group &group)
+{
+    GroupManager *manager = m_manager;
+    QScopedPointer<GroupManager> tempManager;
+    if (!manager) {
+        tempManager.reset(new GroupManager);
+        manager = tempManager.data();
+    }
+
+    if (!manager->addGroup(group))
+        return false;
+
+    // Index right away; the change notification for it is handled as an update.
+    // Before loading has finished, the loaded state will include the group.
+    if (isWarm())
+        insert(group);
+    return true;
+}
+
+void ConversationIndex::slotModelReady(bool successful)
+{
+    if (!successful) {
+        qCritical() << "Failed to load conversation index";
+        return;
+    }
+
+    // Replaces whatever the snapshot had
+    m_groups.clear();
+    m_index.clear();
+    foreach (GroupObject *object, m_manager->groups())
+        insert(fromGroupObject(object));
+
+    m_ready = true;
+    m_warm = false;
+    DEBUG() << Q_FUNC_INFO << m_groups.size() << "groups indexed";
+    scheduleSnapshot();
+}
+
+void ConversationIndex::slotGroupAdded(GroupObject *group)
+{
+    if (m_ready)
+        insert(fromGroupObject(group));
+}
+
+void ConversationIndex::slotGroupUpdated(GroupObject *group)
+{
+    if (m_ready)
+        insert(fromGroupObject(group));
+}
+
+void ConversationIndex::slotGroupDeleted(GroupObject *group)
+{
+    remove(group->id());
+}
+
+void ConversationIndex::slotGroupsDeleted(const QList<int> &groupIds)
+{
+    if (m_ready)
+        return;
+
+    foreach (int groupId, groupIds)
+        remove(groupId);
+}
@@ -0,0 +1,143 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef CONVERSATIONINDEX_H
+#define CONVERSATIONINDEX_H
+
+#include <QObject>
+#include <QBasicTimer>
+#include <QHash>
+#include <QList>
+#include <QMultiHash>
+
+#include <CommHistory/Group>
+
+namespace CommHistory {
+    class GroupManager;
+    class GroupObject;
+}
+
+namespace RTComLogger {
+
+/*!
+ * \class ConversationIndex
+ * \brief Daemon-wide lookup of conversations by (localUid, remoteUid).
+ *
+ * Groups are loaded once in the background after startup and kept up to date
+ * from libcommhistory change notifications. Lookups hash the normalised remote
+ * address instead of scanning every group. Until the index is loaded, lookups
+ * fall back to a query limited to the requested remote address.
+ *
+ * The loaded index is also written to a snapshot file in the cache directory
+ * ("commhistoryd/conversation-index") a few seconds after each change. At
+ * startup the snapshot is memory-mapped and used for lookups until the full
+ * load has finished. Until then a group found in the snapshot is only a
+ * candidate: it is read back by id from the database and used only if it
+ * still matches.
+ */
+class ConversationIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ConversationIndex* instance();
+
+    /*!
+     * Starts loading the index in the background, if not done already.
+     */
+    void prewarm();
+
+    /*!
+     * Loads the snapshot written by a previous run.
+     */
+    void loadSnapshot();
+
+    bool isReady() const;
+
+    /*!
+     * True once lookups are served from memory, either from the snapshot or
+     * from the loaded index.
+     */
+    bool isWarm() const;
+
+    /*!
+     * Returns the group with the given local uid and a single remote uid
+     * matching remoteUid, or an invalid group if there is none.
+     */
+    CommHistory::Group findGroup(const QString &localUid, const QString &remoteUid);
+
+    /*!
+     * Returns the group with the given local uid and the same set of
+     * remote uids, in any order, or an invalid group if there is none.
+     */
+    CommHistory::Group findGroup(const QString &localUid, const QStringList &remoteUids);
+
+    /*!
+     * Stores a new group and adds it to the index.
+     */
+    bool addGroup(CommHistory::Group &group);
+
+private Q_SLOTS:
+    void load();
+    void slotModelReady(bool successful);
+    void slotGroupAdded(CommHistory::GroupObject *group);
+    void slotGroupUpdated(CommHistory::GroupObject *group);
+    void slotGroupDeleted(CommHistory::GroupObject *group);
+    void slotGroupsDeleted(const QList<int> &groupIds);
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+private:
+    explicit ConversationIndex(QObject *parent = 0);
+
+    static QString normalizedAddress(const QString &localUid, const QString &remoteUid);
+    static QString indexKey(const QString &localUid, const QStringList &remoteUids);
+    static bool remoteUidsMatch(const CommHistory::Group &group, const QStringList &remoteUids);
+    static CommHistory::Group fromGroupObject(CommHistory::GroupObject *group);
+
+    void insert(const CommHistory::Group &group);
+    void remove(int groupId);
+    CommHistory::Group lookup(const QString &localUid, const QStringList &remoteUids) const;
+    CommHistory::Group confirmSnapshot(const CommHistory::Group &candidate);
+
+    void scheduleSnapshot();
+    void writeSnapshot();
+
+private:
+    static ConversationIndex* m_pInstance;
+
+    CommHistory::GroupManager *m_manager;
+    QHash<int, CommHistory::Group> m_groups;
+    QMultiHash<QString, int> m_index;
+    bool m_ready;
+    bool m_warm;
+    QString m_snapshotPath;
+    QBasicTimer m_snapshotTimer;
+
+#ifdef UNIT_TEST
+    friend class Ut_ConversationIndex;
+#endif
+};
+
+} // namespace RTComLogger
+
+#endif // CONVERSATIONINDEX_H
@@ -0,0 +1,177 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "expungeaggregator.h"
+#include "debug.h"
+
+#include <TpExtensions/Connection> // stored messages if
+#include <TelepathyQt/PendingReady>
+
+#include <QCoreApplication>
+#include <QTimerEvent>
+
+#define EXPUNGE_BATCH_SIZE  50
+#define EXPUNGE_FLUSH_DELAY 500 //msec
+
+using namespace RTComLogger;
+
+QHash<QString, ExpungeAggregator*> ExpungeAggregator::m_aggregators;
+
+ExpungeAggregator* ExpungeAggregator::forConnection(const Tp::ConnectionPtr &connection)
+{
+    if (connection.isNull())
+        return 0;
+
+    ExpungeAggregator *aggregator = forConnectionPath(connection->objectPath());
+    aggregator->setConnection(connection);
+    return aggregator;
+}
+
+ExpungeAggregator* ExpungeAggregator::forConnectionPath(const QString &path)
+{
+    ExpungeAggregator *aggregator = m_aggregators.value(path);
+    if (!aggregator) {
+        aggregator = new ExpungeAggregator(path, QCoreApplication::instance());
+        m_aggregators.insert(path, aggregator);
+    }
+
+    return aggregator;
+}
+
+ExpungeAggregator::ExpungeAggregator(const QString &path, QObject *parent)
+    : QObject(parent),
+      m_path(path),
+      m_waitingReady(false)
+{
+}
+
+void ExpungeAggregator::setConnection(const Tp::ConnectionPtr &connection)
+{
+    if (m_connection == connection)
+        return;
+
+    if (!m_connection.isNull())
+        disconnect(m_connection.data(), 0, this, 0);
+
+    m_connection = connection;
+    m_waitingReady = false;
+    connect(m_connection.data(),
+            SIGNAL(invalidated(Tp::DBusProxy*,QString,QString)),
+            SLOT(onConnectionInvalidated()));
+
+    // Tokens left from the previous connection object
+    if (!m_tokens.isEmpty() && !m_timer.isActive())
+        m_timer.start(EXPUNGE_FLUSH_DELAY, this);
+}
+
+void ExpungeAggregator::expunge(const QString &token)
+{
+    if (token.isEmpty() || m_queued.contains(token))
+        return;
+
+    m_queued.insert(token);
+    m_tokens.append(token);
+
+    if (m_tokens.size() >= EXPUNGE_BATCH_SIZE)
+        flush();
+    else if (!m_timer.isActive())
+        m_timer.start(EXPUNGE_FLUSH_DELAY, this);
+}
+
+void ExpungeAggregator::expunge(const QStringList &tokens)
+{
+    foreach (const QString &token, tokens)
+        expunge(token);
+}
+
+void ExpungeAggregator::flush()
+{
+    m_timer.stop();
+
+    if (m_tokens.isEmpty() || m_connection.isNull())
+        return;
+
+    if (!m_connection->isReady()) {
+        // Keep the tokens until the connection is ready
+        if (!m_waitingReady) {
+            m_waitingReady = true;
+            connect(m_connection->becomeReady(),
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(onConnectionReady(Tp::PendingOperation*)));
+        }
+        return;
+    }
+
+    if (!m_connection->hasInterface(CommHistoryTp::Client::ConnectionInterfaceStoredMessagesInterface::staticInterfaceName())) {
+        DEBUG() << Q_FUNC_INFO << "No stored messages interface, dropping" << m_tokens.size() << "tokens";
+        m_tokens.clear();
+        m_queued.clear();
+        return;
+    }
+
+    CommHistoryTp::Client::ConnectionInterfaceStoredMessagesInterface* storedMessages =
+            m_connection->interface<CommHistoryTp::Client::ConnectionInterfaceStoredMessagesInterface>();
+
+    if (storedMessages) {
+        DEBUG() << Q_FUNC_INFO << m_tokens;
+        storedMessages->ExpungeMessages(m_tokens);
+        m_tokens.clear();
+        m_queued.clear();
+    } else {
+        qCritical() << Q_FUNC_INFO << "No stored messages interface present";
+    }
+}
+
+void ExpungeAggregator::onConnectionReady(Tp::PendingOperation *op)
+{
+    Tp::PendingReady *pr = qobject_cast<Tp::PendingReady*>(op);
+    // Readiness of a connection object that was since replaced
+    if (!pr || pr->proxy().data() != m_connection.data())
+        return;
+
+    m_waitingReady = false;
+    if (op->isError()) {
+        qWarning() << Q_FUNC_INFO << m_path << "not ready:" << op->errorName() << op->errorMessage();
+        return;
+    }
+
+    flush();
+}
+
+void ExpungeAggregator::onConnectionInvalidated()
+{
+    DEBUG() << Q_FUNC_INFO << m_path << "keeping" << m_tokens.size() << "tokens";
+
+    // The tokens wait for the next connection object of the path
+    m_timer.stop();
+    disconnect(m_connection.data(), 0, this, 0);
+    m_connection.reset();
+    m_waitingReady = false;
+}
+
+void ExpungeAggregator::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_timer.timerId())
+        flush();
+    else
+        QObject::timerEvent(event);
+}
@@ -0,0 +1,95 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef EXPUNGEAGGREGATOR_H
+#define EXPUNGEAGGREGATOR_H
+
+#include <QObject>
+#include <QBasicTimer>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+
+#include <TelepathyQt/Connection>
+
+namespace RTComLogger {
+
+/*!
+ * \class ExpungeAggregator
+ * \brief Collects stored message tokens to expunge for one connection.
+ *
+ * There is one aggregator per connection object path, shared by all text
+ * channel listeners and the message reviver. Tokens are sent in a single
+ * ExpungeMessages call once EXPUNGE_BATCH_SIZE of them are queued or
+ * EXPUNGE_FLUSH_DELAY has passed since the first one. Tokens are kept
+ * while the connection is not ready and sent once it becomes ready. When
+ * the connection goes away the aggregator keeps its tokens and sends them
+ * once forConnection() gives it the next connection object of the path.
+ */
+class ExpungeAggregator : public QObject
+{
+    Q_OBJECT
+
+public:
+    /*!
+     * Returns the aggregator for the connection's object path, creating it
+     * if needed. The aggregator switches to the given connection object.
+     */
+    static ExpungeAggregator* forConnection(const Tp::ConnectionPtr &connection);
+    /*!
+     * Returns the aggregator for a connection object path, creating it if
+     * needed. Tokens queued before a connection is attached wait for it.
+     */
+    static ExpungeAggregator* forConnectionPath(const QString &path);
+
+    void expunge(const QString &token);
+    void expunge(const QStringList &tokens);
+
+    /*!
+     * Sends queued tokens now, if the connection is ready.
+     */
+    void flush();
+
+private Q_SLOTS:
+    void onConnectionReady(Tp::PendingOperation *op);
+    void onConnectionInvalidated();
+
+private:
+    explicit ExpungeAggregator(const QString &path, QObject *parent = 0);
+
+    void setConnection(const Tp::ConnectionPtr &connection);
+    void timerEvent(QTimerEvent *event);
+
+private:
+    static QHash<QString, ExpungeAggregator*> m_aggregators;
+
+    QString m_path;
+    Tp::ConnectionPtr m_connection;
+    bool m_waitingReady;
+    QStringList m_tokens;
+    QSet<QString> m_queued;
+    QBasicTimer m_timer;
+};
+
+} // namespace RTComLogger
+
+#endif // EXPUNGEAGGREGATOR_H
@@ -0,0 +1,206 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "groupchangedispatcher.h"
+#include "debug.h"
+
+#include <CommHistory/Group>
+#include <CommHistory/GroupModel>
+#include <CommHistory/commonutils.h>
+
+#include <QModelIndex>
+
+#define DISPATCHER_OBJECT_NAME "commhistoryd-group-change-dispatcher"
+
+using namespace RTComLogger;
+using namespace CommHistory;
+
+GroupChangeDispatcher* GroupChangeDispatcher::forModel(GroupModel *model)
+{
+    if (!model)
+        return 0;
+
+    GroupChangeDispatcher *dispatcher =
+            model->findChild<GroupChangeDispatcher*>(QLatin1String(DISPATCHER_OBJECT_NAME),
+                                                     Qt::FindDirectChildrenOnly);
+    if (!dispatcher)
+        dispatcher = new GroupChangeDispatcher(model);
+
+    return dispatcher;
+}
+
+GroupChangeDispatcher::GroupChangeDispatcher(GroupModel *model)
+    : QObject(model),
+      m_model(model)
+{
+    setObjectName(QLatin1String(DISPATCHER_OBJECT_NAME));
+
+    connect(m_model, SIGNAL(rowsInserted(const QModelIndex&, int, int)),
+            SLOT(slotRowsInserted(const QModelIndex&, int, int)));
+    connect(m_model, SIGNAL(rowsAboutToBeRemoved(const QModelIndex&, int, int)),
+            SLOT(slotRowsAboutToBeRemoved(const QModelIndex&, int, int)));
+    connect(m_model, SIGNAL(dataChanged(const QModelIndex&, const QModelIndex&)),
+            SLOT(slotDataChanged(const QModelIndex&, const QModelIndex&)));
+}
+
+QString GroupChangeDispatcher::addressKey(const QString &localUid, const QString &remoteUid)
+{
+    // Same bucket for phone numbers in different formats; candidates are
+    // confirmed with remoteAddressMatch.
+    if (localUidComparesPhoneNumbers(localUid))
+        return localUid + QLatin1Char('\n') + minimizePhoneNumber(remoteUid);
+
+    return localUid + QLatin1Char('\n') + remoteUid.toLower();
+}
+
+void GroupChangeDispatcher::addListener(GroupChangeListener *listener)
+{
+    m_listeners[listener]++;
+}
+
+void GroupChangeDispatcher::subscribe(GroupChangeListener *listener, int groupId)
+{
+    if (!listener || groupId < 0)
+        return;
+
+    m_groupListeners.insert(groupId, listener);
+    addListener(listener);
+}
+
+void GroupChangeDispatcher::subscribe(GroupChangeListener *listener,
+                                      const QString &localUid, const QString &remoteUid)
+{
+    if (!listener || localUid.isEmpty() || remoteUid.isEmpty())
+        return;
+
+    AddressSubscription subscription;
+    subscription.listener = listener;
+    subscription.localUid = localUid;
+    subscription.remoteUid = remoteUid;
+    m_addressListeners.insert(addressKey(localUid, remoteUid), subscription);
+    addListener(listener);
+}
+
+void GroupChangeDispatcher::subscribeAll(GroupChangeListener *listener)
+{
+    if (!listener)
+        return;
+
+    m_allListeners.append(listener);
+    addListener(listener);
+}
+
+void GroupChangeDispatcher::unsubscribe(GroupChangeListener *listener)
+{
+    if (!m_listeners.remove(listener))
+        return;
+
+    QMultiHash<int, GroupChangeListener*>::iterator it = m_groupListeners.begin();
+    while (it != m_groupListeners.end()) {
+        if (it.value() == listener)
+            it = m_groupListeners.erase(it);
+        else
+            ++it;
+    }
+
+    QMultiHash<QString, AddressSubscription>::iterator ait = m_addressListeners.begin();
+    while (ait != m_addressListeners.end()) {
+        if (ait->listener == listener)
+            ait = m_addressListeners.erase(ait);
+        else
+            ++ait;
+    }
+
+    m_allListeners.removeAll(listener);
+}
+
+void GroupChangeDispatcher::slotRowsInserted(const QModelIndex &parent, int start, int end)
+{
+    dispatch(parent, start, end, Inserted);
+}
+
+void GroupChangeDispatcher::slotRowsAboutToBeRemoved(const QModelIndex &parent, int start, int end)
+{
+    dispatch(parent, start, end, Removed);
+}
+
+void GroupChangeDispatcher::slotDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    if (!topLeft.isValid() || !bottomRight.isValid()) {
+        qWarning() << Q_FUNC_INFO << "Invalid indexes";
+        return;
+    }
+
+    dispatch(topLeft.parent(), topLeft.row(), bottomRight.row(), Changed);
+}
+
+void GroupChangeDispatcher::dispatch(const QModelIndex &parent, int start, int end, Change change)
+{
+    if (m_listeners.isEmpty())
+        return;
+
+    for (int i = start; i <= end; i++) {
+        Group group = m_model->group(m_model->index(i, 0, parent));
+        if (group.isValid())
+            deliver(group, change);
+    }
+}
+
+void GroupChangeDispatcher::deliver(const Group &group, Change change)
+{
+    QList<GroupChangeListener*> listeners = m_groupListeners.values(group.id());
+
+    if (!group.remoteUids().isEmpty()) {
+        const QString &remoteUid = group.remoteUids().first();
+        const QString key = addressKey(group.localUid(), remoteUid);
+        QMultiHash<QString, AddressSubscription>::const_iterator it = m_addressListeners.constFind(key);
+        for (; it != m_addressListeners.constEnd() && it.key() == key; ++it) {
+            if (it->localUid == group.localUid()
+                && remoteAddressMatch(group.localUid(), remoteUid, it->remoteUid)
+                && !listeners.contains(it->listener))
+                listeners.append(it->listener);
+        }
+    }
+
+    foreach (GroupChangeListener *listener, m_allListeners) {
+        if (!listeners.contains(listener))
+            listeners.append(listener);
+    }
+
+    foreach (GroupChangeListener *listener, listeners) {
+        // an earlier listener may have unsubscribed or deleted another one
+        if (!m_listeners.contains(listener))
+            continue;
+
+        switch (change) {
+        case Inserted:
+            listener->groupInserted(group);
+            break;
+        case Changed:
+            listener->groupChanged(group);
+            break;
+        case Removed:
+            listener->groupRemoved(group);
+            break;
+        }
+    }
+}
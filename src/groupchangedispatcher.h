@@ -0,0 +1,120 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef GROUPCHANGEDISPATCHER_H
+#define GROUPCHANGEDISPATCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QMultiHash>
+#include <QString>
+
+namespace CommHistory {
+    class Group;
+    class GroupModel;
+}
+
+class QModelIndex;
+
+namespace RTComLogger {
+
+/*!
+ * \class GroupChangeListener
+ * \brief Receives the group changes it subscribed to from a GroupChangeDispatcher.
+ */
+class GroupChangeListener
+{
+public:
+    virtual ~GroupChangeListener() {}
+
+    virtual void groupInserted(const CommHistory::Group &group) { Q_UNUSED(group); }
+    virtual void groupChanged(const CommHistory::Group &group) { Q_UNUSED(group); }
+    virtual void groupRemoved(const CommHistory::Group &group) { Q_UNUSED(group); }
+};
+
+/*!
+ * \class GroupChangeDispatcher
+ * \brief Delivers GroupModel row changes to the listeners of the affected groups.
+ *
+ * Every changed row is read from the model once, and passed only to the
+ * listeners subscribed to its group id or to its (localUid, first remote uid)
+ * address, plus those subscribed to all groups. Address subscriptions also
+ * see groups that are inserted after subscribing.
+ */
+class GroupChangeDispatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    /*!
+     * Returns the dispatcher of the model, creating it on first use.
+     */
+    static GroupChangeDispatcher* forModel(CommHistory::GroupModel *model);
+
+    void subscribe(GroupChangeListener *listener, int groupId);
+    void subscribe(GroupChangeListener *listener, const QString &localUid, const QString &remoteUid);
+    void subscribeAll(GroupChangeListener *listener);
+
+    /*!
+     * Removes all subscriptions of the listener.
+     */
+    void unsubscribe(GroupChangeListener *listener);
+
+private Q_SLOTS:
+    void slotRowsInserted(const QModelIndex &parent, int start, int end);
+    void slotRowsAboutToBeRemoved(const QModelIndex &parent, int start, int end);
+    void slotDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+
+private:
+    enum Change {
+        Inserted,
+        Changed,
+        Removed
+    };
+
+    struct AddressSubscription {
+        GroupChangeListener *listener;
+        QString localUid;
+        QString remoteUid;
+    };
+
+    explicit GroupChangeDispatcher(CommHistory::GroupModel *model);
+
+    static QString addressKey(const QString &localUid, const QString &remoteUid);
+
+    void addListener(GroupChangeListener *listener);
+    void dispatch(const QModelIndex &parent, int start, int end, Change change);
+    void deliver(const CommHistory::Group &group, Change change);
+
+private:
+    CommHistory::GroupModel *m_model;
+    QMultiHash<int, GroupChangeListener*> m_groupListeners;
+    QMultiHash<QString, AddressSubscription> m_addressListeners;
+    QList<GroupChangeListener*> m_allListeners;
+    // number of subscriptions of each listener
+    QHash<GroupChangeListener*, int> m_listeners;
+};
+
+} // namespace RTComLogger
+
+#endif // GROUPCHANGEDISPATCHER_H
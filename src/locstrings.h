@@ -84,6 +84,10 @@
 #define txt_qtn_msg_group_chat_remote_joined(STR) qtTrId("qtn_msg_group_chat_remote_joined").arg(STR)
 //% "%1 has left"
 #define txt_qtn_msg_group_chat_remote_left(STR) qtTrId("qtn_msg_group_chat_remote_left").arg(STR)
+//% "%n people have joined"
+#define txt_qtn_msg_group_chat_remote_joined_count(NUM) qtTrId("qtn_msg_group_chat_remote_joined_count", NUM)
+//% "%n people have left"
+#define txt_qtn_msg_group_chat_remote_left_count(NUM) qtTrId("qtn_msg_group_chat_remote_left_count", NUM)
 //% "%1 removed you from this chat"
 #define txt_qtn_msg_group_chat_you_removed(STR) qtTrId("qtn_msg_group_chat_you_removed").arg(STR)
 //% "%1 removed %2 from this chat"
@@ -33,6 +33,7 @@
 #include "streamchannellistener.h"
 #include "loggerclientobserver.h"
 #include "messagereviver.h"
+#include "commitretryqueue.h"
 #include "debug.h"
 
 #define COMMHISTORY_CHANNEL_OBSERVER QLatin1String("CommHistory")
@@ -51,6 +52,10 @@ Logger::Logger(const Tp::AccountManagerPtr &accountManager,
     Tp::enableWarnings(true);
 #endif
 
+    // revive messages that couldn't be saved even after retrying
+    connect(CommitRetryQueue::instance(), SIGNAL(savingFailed(const Tp::ConnectionPtr&)),
+            m_Reviver, SLOT(checkConnection(const Tp::ConnectionPtr&)));
+
     m_Registrar = ClientRegistrar::create(accountManager);
 
     ChannelClassSpecList channelFilters;
@@ -101,8 +106,6 @@ void Logger::createChannelListener(const QString &channelType,
     ChannelListener* listener = 0;
     if( channelType == QLatin1String(TP_QT_IFACE_CHANNEL_TYPE_TEXT) ) {
         listener = new TextChannelListener(account, channel, context, this);
-        connect(listener, SIGNAL(savingFailed(const Tp::ConnectionPtr&)),
-                m_Reviver, SLOT(checkConnection(const Tp::ConnectionPtr&)));
     } else if ( channelType == QLatin1String(TP_QT_IFACE_CHANNEL_TYPE_STREAMED_MEDIA) ) {
         listener = new StreamChannelListener(account, channel, context, this);
     }
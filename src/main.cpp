@@ -24,22 +24,17 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <syslog.h>
+#include <unistd.h>
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QLocale>
+#include <QScopedPointer>
+#include <QSocketNotifier>
+#include <QTranslator>
 
 // Our includes
-#include "logger.h"
-#include "notificationmanager.h"
-#include "commhistoryservice.h"
-#include "commhistoryifadaptor.h"
-#include "accountpresenceservice.h"
-#include "accountpresenceifadaptor.h"
-#include "messagereviver.h"
-#include "contactauthorizationlistener.h"
-#include "connectionutils.h"
-#include "lastdialedcache.h"
-#include "accountoperationsobserver.h"
-#include "mmshandler.h"
-#include "mmshandler_adaptor.h"
-#include "smartmessaging_adaptor.h"
+#include "startupsequence.h"
 #include "debug.h"
 
 using namespace RTComLogger;
@@ -146,48 +141,12 @@ Q_DECL_EXPORT int main(int argc, char **argv)
     app.installTranslator(engineeringEnglish.data());
     app.installTranslator(translator.data());
 
-    CommHistoryService *chService = CommHistoryService::instance();
-    if (!chService->isRegistered()) {
-        qCritical() << "CommHistoryService registration failed (already running or DBus not found), exiting";
+    StartupSequence *startup = new StartupSequence(&app);
+    if (!startup->registerServices())
         _exit(1);
-    }
-    new CommHistoryIfAdaptor(chService);
-    DEBUG() << "CommHistoryService created";
-
-    ConnectionUtils *utils = new ConnectionUtils(&app);
-
-    // ContactAuthorizationListener needs to be updated with nemo-notifications and new UI handling
-    //new ContactAuthorizationListener(utils, chService);
-
-    AccountPresenceService *apService = new AccountPresenceService(utils->accountManager(), &app);
-    if (!apService->isRegistered()) {
-        qCritical() << "AccountPresenceService registration failed (already running or DBus not found), exiting";
-        _exit(1);
-    }
-    new AccountPresenceIfAdaptor(apService);
-    DEBUG() << "AccountPresenceService created";
-
-    MessageReviver *reviver = new MessageReviver(utils, &app);
-    DEBUG() << "Message reviver created, starting main loop";
-
-    new Logger(utils->accountManager(),
-               reviver,
-               &app);
-    DEBUG() << "Logger created";
-
-    NotificationManager::instance();
-    DEBUG() << "NotificationManager created";
-
-    new LastDialedCache(&app);
-    DEBUG() << "LastDialedCache created";
-
-    // Init account operations observer to monitor account removals and to react to them.
-    new AccountOperationsObserver(utils->accountManager(), &app);
-
-    MmsHandler *mmsHandler = new MmsHandler(&app);
-    new MmsHandlerAdaptor(mmsHandler);
 
-    new SmartMessagingAgentAdaptor(new SmartMessaging(&app));
+    startup->start();
+    DEBUG() << "Starting main loop";
 
     int result = app.exec();
 
@@ -0,0 +1,165 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "messagedata.h"
+#include "constants.h"
+
+#include <CommHistory/Event>
+
+#include <TelepathyQt/Message>
+
+#include <QDateTime>
+#include <QHash>
+
+// header keys, see the Telepathy Message_Part specification
+#define MESSAGE_TOKEN        QLatin1String("message-token")
+#define MESSAGE_TYPE         QLatin1String("message-type")
+#define MESSAGE_SENT         QLatin1String("message-sent")
+#define MESSAGE_RECEIVED     QLatin1String("message-received")
+#define PENDING_MESSAGE_ID   QLatin1String("pending-message-id")
+#define SCROLLBACK           QLatin1String("scrollback")
+#define SUPERSEDES_TOKEN     QLatin1String("supersedes")
+#define EXISTING_EVENT_ID    QLatin1String("x-commhistory-event-id")
+
+// voicemail
+#define TXT_VOICE            QLatin1String("voice")
+#define MAILBOX_NOTIFICATION QLatin1String("x-nokia-mailbox-notification")
+#define VOICEMAIL_TYPE       QLatin1String("x-nokia-voicemail-type")
+#define MAILBOX_UNREAD_COUNT QLatin1String("x-nokia-mailbox-unread-count")
+#define MAILBOX_HAS_UNREAD   QLatin1String("x-nokia-mailbox-has-unread")
+
+// content
+#define PART_CONTENT         QLatin1String("content")
+#define PART_CONTENT_TYPE    QLatin1String("content-type")
+#define VCARD_CONTENT_TYPE   QLatin1String("text/x-vcard")
+
+using namespace RTComLogger;
+
+MessageData::MessageData(const Tp::Message &message)
+    : isReceived(false)
+{
+    read(message);
+}
+
+MessageData::MessageData(const Tp::ReceivedMessage &message)
+    : isReceived(true)
+{
+    read(message);
+}
+
+void MessageData::read(const Tp::Message &message)
+{
+    type = Tp::ChannelTextMessageTypeNormal;
+    pendingId = 0;
+    sent = 0;
+    received = 0;
+    mailboxUnreadCount = 0;
+    eventId = -1;
+    isScrollback = false;
+    isVoicemail = false;
+    mailboxHasUnread = false;
+
+    // Keys are compared against latin1 literals while iterating, which
+    // unlike QMap::value() doesn't build a key string for each lookup
+    const Tp::MessagePartList parts = message.parts();
+    if (parts.isEmpty())
+        return;
+
+    const Tp::MessagePart &header = parts.at(0);
+    for (Tp::MessagePart::const_iterator it = header.constBegin(); it != header.constEnd(); ++it) {
+        const QString &key = it.key();
+        const QVariant value = it.value().variant();
+
+        if (key == MESSAGE_TOKEN) {
+            token = value.toString();
+        } else if (key == MESSAGE_TYPE) {
+            uint raw = value.toUInt();
+            if (raw < static_cast<uint>(Tp::NUM_CHANNEL_TEXT_MESSAGE_TYPES))
+                type = Tp::ChannelTextMessageType(raw);
+        } else if (key == MESSAGE_SENT) {
+            sent = value.toUInt();
+        } else if (key == MESSAGE_RECEIVED) {
+            received = value.toUInt();
+        } else if (key == PENDING_MESSAGE_ID) {
+            pendingId = value.toUInt();
+        } else if (key == SCROLLBACK) {
+            isScrollback = value.type() == QVariant::Bool && value.toBool();
+        } else if (key == REPLACE_TYPE) {
+            replaceType = value.toString();
+        } else if (key == SUPERSEDES_TOKEN) {
+            supersedes = value.toString();
+        } else if (key == EXISTING_EVENT_ID) {
+            eventId = value.toInt();
+        } else if (key == MAILBOX_NOTIFICATION) {
+            isVoicemail = value.toString() == TXT_VOICE;
+        } else if (key == VOICEMAIL_TYPE) {
+            voicemailType = value.toString();
+        } else if (key == MAILBOX_HAS_UNREAD) {
+            mailboxHasUnread = value.toBool();
+        } else if (key == MAILBOX_UNREAD_COUNT) {
+            mailboxUnreadCount = value.toUInt();
+        }
+    }
+
+    for (int i = 1; i < parts.size() && vcard.isNull(); i++) {
+        const Tp::MessagePart &part = parts.at(i);
+        bool isVCard = false;
+        QVariant content;
+        for (Tp::MessagePart::const_iterator it = part.constBegin(); it != part.constEnd(); ++it) {
+            if (it.key() == PART_CONTENT_TYPE)
+                isVCard = it.value().variant().toString() == VCARD_CONTENT_TYPE;
+            else if (it.key() == PART_CONTENT)
+                content = it.value().variant();
+        }
+        if (isVCard)
+            vcard = content.toByteArray();
+    }
+
+    text = message.text().trimmed();
+}
+
+void MessageData::fillEvent(CommHistory::Event &event) const
+{
+    event.setFreeText(text);
+    event.setMessageToken(token);
+
+    if (!replaceType.isEmpty()) {
+        QHash<QString, QString> headers;
+        headers.insert(REPLACE_TYPE, replaceType);
+        event.setHeaders(headers);
+    }
+
+    QDateTime sentTime;
+    if (sent)
+        sentTime = QDateTime::fromTime_t(sent);
+
+    if (isReceived) {
+        QDateTime receivedTime = received ? QDateTime::fromTime_t(received)
+                                          : QDateTime::currentDateTime();
+        event.setStartTime(sentTime.isValid() ? sentTime : receivedTime);
+        event.setEndTime(receivedTime);
+    } else {
+        if (!sentTime.isValid())
+            sentTime = QDateTime::currentDateTime();
+        event.setStartTime(sentTime);
+        event.setEndTime(sentTime);
+    }
+}
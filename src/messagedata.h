@@ -0,0 +1,84 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef MESSAGEDATA_H
+#define MESSAGEDATA_H
+
+#include <QString>
+#include <QByteArray>
+#include <TelepathyQt/Constants>
+
+namespace Tp {
+    class Message;
+    class ReceivedMessage;
+}
+
+namespace CommHistory {
+    class Event;
+}
+
+namespace RTComLogger {
+
+/*!
+ * \class MessageData
+ * \brief The parts of a Tp::Message that are logged, read in one pass.
+ *
+ * Tp::Message looks up each header by building a key string and searching
+ * the header map. MessageData walks the header once and picks out every
+ * field used by the listeners, so a message is decoded once however many
+ * times its fields are needed. Strings share data with the message.
+ */
+struct MessageData
+{
+    explicit MessageData(const Tp::Message &message);
+    explicit MessageData(const Tp::ReceivedMessage &message);
+
+    /*!
+     * Sets the event type-independent fields: free text, message token,
+     * start/end time and the sms replace type header. Times fall back to
+     * the current time for received messages without timestamps.
+     */
+    void fillEvent(CommHistory::Event &event) const;
+
+    Tp::ChannelTextMessageType type;
+    QString text;           // trimmed
+    QString token;
+    QString replaceType;
+    QString supersedes;
+    QString voicemailType;
+    QByteArray vcard;
+    uint pendingId;
+    uint sent;              // seconds since epoch, 0 if not set
+    uint received;
+    uint mailboxUnreadCount;
+    int eventId;            // x-commhistory-event-id, -1 if not set
+    bool isReceived;
+    bool isScrollback;
+    bool isVoicemail;
+    bool mailboxHasUnread;
+
+private:
+    void read(const Tp::Message &message);
+};
+
+} // namespace RTComLogger
+
+#endif // MESSAGEDATA_H
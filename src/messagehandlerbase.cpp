@@ -21,24 +21,31 @@
 
 #include "messagehandlerbase.h"
 #include "constants.h"
+#include "conversationindex.h"
 #include "debug.h"
 
 #include <CommHistory/event.h>
-#include <CommHistory/groupmanager.h>
+#include <CommHistory/Group>
+#include <CommHistory/messagepart.h>
+#include <CommHistory/EventModel>
+#include <CommHistory/DatabaseIO>
 
 #include <QDBusConnection>
 #include <QDBusError>
 #include <QRegularExpression>
 #include <QStandardPaths>
 #include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QUuid>
 
 using namespace CommHistory;
+using namespace RTComLogger;
 
 MessageHandlerBase::MessageHandlerBase(QObject* parent, QString objectPath,
     QString serviceName) :
     QObject(parent),
-    m_isRegistered(false),
-    groupManager(NULL)
+    m_isRegistered(false)
 {
     QDBusConnection dbus = QDBusConnection::systemBus();
     if (!dbus.isConnected()) {
@@ -68,28 +75,100 @@ QString MessageHandlerBase::messagePartPath(int eventId, QString contentId)
     }
 }
 
-bool MessageHandlerBase::setGroupForEvent(Event& event)
+QString MessageHandlerBase::stagingPartPath(QString contentId)
+{
+    QDir stagingDir(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QStringLiteral("/commhistory/data/.staging/"));
+    if (stagingDir.exists() || stagingDir.mkpath(".")) {
+        QString uuid = QUuid::createUuid().toString().mid(1, 36);
+        return stagingDir.filePath(uuid + QLatin1Char('-') + sanitizeName(contentId));
+    } else {
+        qCritical() << "Cannot create staging directory for message parts:" << stagingDir.path();
+        return QString();
+    }
+}
+
+bool MessageHandlerBase::addEventWithPart(Event &event, const QString &contentId,
+                                          const QString &contentType, const QByteArray &data)
 {
-    if (!groupManager) {
-        groupManager = new GroupManager(this);
-        if (!groupManager->getGroups(RING_ACCOUNT_PATH)) {
-            delete groupManager;
-            groupManager = NULL;
-            return false;
+    // Write the part before touching the database, so the transaction only
+    // covers the insert and a rename on the same filesystem.
+    QString stagingPath = stagingPartPath(contentId);
+    if (stagingPath.isEmpty())
+        return false;
+
+    QFile file(stagingPath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) {
+        qCritical() << "Failed writing message part to" << stagingPath;
+        file.close();
+        QFile::remove(stagingPath);
+        return false;
+    }
+    file.close();
+
+    EventModel model;
+    DatabaseIO &db = model.databaseIO();
+    if (!db.transaction()) {
+        qCritical() << "Failed to start transaction for event" << event.toString();
+        QFile::remove(stagingPath);
+        return false;
+    }
+
+    QString path;
+    bool ok = db.addEvent(event);
+    if (ok) {
+        path = messagePartPath(event.id(), contentId);
+        ok = !path.isEmpty() && QFile::rename(stagingPath, path);
+    }
+
+    if (ok) {
+        MessagePart part;
+        part.setContentType(contentType);
+        part.setContentId(contentId);
+        part.setPath(path);
+        event.setMessageParts(QList<MessagePart>() << part);
+        ok = db.modifyEvent(event);
+    }
+
+    if (!ok || !db.commit()) {
+        qCritical() << "Failed to store event with message part:" << event.toString();
+        db.rollback();
+        QFile::remove(stagingPath);
+        if (!path.isEmpty()) {
+            QFile::remove(path);
+            QDir().rmdir(QFileInfo(path).path());
         }
+        event.setId(-1);
+        return false;
     }
 
-    GroupObject* group = groupManager->findGroup(RING_ACCOUNT_PATH, event.remoteUid());
-    if (group) {
-        event.setGroupId(group->id());
+    DEBUG() << "Stored" << contentType << "part to" << path;
+
+    // Already committed; only let other models know about the new event
+    model.addEvent(event, true);
+    return true;
+}
+
+bool MessageHandlerBase::setGroupForEvent(Event& event)
+{
+    return setGroupForEvent(event, QStringList(event.remoteUid()));
+}
+
+bool MessageHandlerBase::setGroupForEvent(Event& event, const QStringList &remoteUids)
+{
+    ConversationIndex *index = ConversationIndex::instance();
+    Group group = index->findGroup(RING_ACCOUNT_PATH, remoteUids);
+    if (group.isValid()) {
+        event.setGroupId(group.id());
         return true;
     }
 
-    DEBUG() << "Creating new group for event" << event.remoteUid();
+    DEBUG() << "Creating new group for event" << remoteUids;
     Group newGroup;
     newGroup.setLocalUid(RING_ACCOUNT_PATH);
-    newGroup.setRemoteUids(QStringList(event.remoteUid()));
-    if (!groupManager->addGroup(newGroup)) {
+    newGroup.setRemoteUids(remoteUids);
+    if (remoteUids.size() > 1)
+        newGroup.setChatType(Group::ChatTypeUnnamed);
+    if (!index->addGroup(newGroup)) {
         qCritical() << "Failed adding new group for event" << newGroup.toString();
         return false;
     }
@@ -23,12 +23,14 @@
 #define MESSAGEHANDLERBASE_H
 
 #include <QObject>
+#include <QStringList>
 
 namespace CommHistory {
     class Event;
-    class GroupManager;
 }
 
+class QByteArray;
+
 // Base class for MmsHandler and SmartMessaging
 class MessageHandlerBase : public QObject
 {
@@ -39,13 +41,21 @@ protected:
 
     bool isRegistered() const { return m_isRegistered; }
     bool setGroupForEvent(CommHistory::Event& event);
+    // Set the group having exactly remoteUids as members, creating it if needed
+    bool setGroupForEvent(CommHistory::Event& event, const QStringList &remoteUids);
+
+    // Store a finished incoming event with a single message part. The part data
+    // is written to a staging file first, and the event is inserted, the file
+    // moved to its final location and the part attached in one transaction.
+    bool addEventWithPart(CommHistory::Event &event, const QString &contentId,
+                          const QString &contentType, const QByteArray &data);
 
     static QString sanitizeName(QString name);
     static QString messagePartPath(int eventId, QString contentId);
+    static QString stagingPartPath(QString contentId);
 
 private:
     bool m_isRegistered;
-    CommHistory::GroupManager* groupManager;
 };
 
 #endif // MESSAGEHANDLERBASE_H
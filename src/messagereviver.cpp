@@ -20,8 +20,7 @@
 **
 ******************************************************************************/
 
-#include <CommHistory/EventModel>
-#include <CommHistory/DatabaseIO>
+#include <QtConcurrent/QtConcurrentRun>
 
 #include <TpExtensions/Connection> // stored messages if
 
@@ -29,18 +28,22 @@
 #include "constants.h"
 #include "messagereviver.h"
 #include "connectionutils.h"
+#include "expungeaggregator.h"
 #include "debug.h"
 
 using namespace RTComLogger;
 using namespace CommHistory;
 
-#define STORED_MESSAGES_CHECK_INTERVAL 30000 //msec
+#define STORED_MESSAGES_MIN_INTERVAL 5000 //msec
+#define STORED_MESSAGES_MAX_INTERVAL 60000 //msec
 #define MAX_RETRIES 10
 
 MessageReviver::MessageReviver(ConnectionUtils *connectionUtils,
                                QObject *parent) :
     QObject(parent)
 {
+    m_Clock.start();
+
     connect(connectionUtils,
             SIGNAL(connectionReady(Tp::ConnectionPtr)),
             SLOT(checkConnection(Tp::ConnectionPtr)));
@@ -53,6 +56,19 @@ void MessageReviver::checkConnection(const Tp::ConnectionPtr& connection)
         && connection->hasInterface(CommHistoryTp::Client::ConnectionInterfaceStoredMessagesInterface::staticInterfaceName())
         && !isConnectionHandled(connection)
         && m_Retries[connection->objectPath()] < MAX_RETRIES) {
+        Revival &revival = m_Revivals[connection->objectPath()];
+        revival.connection = connection;
+        revival.interval = STORED_MESSAGES_MIN_INTERVAL;
+
+        CommHistoryTp::Client::ConnectionInterfaceStoredMessagesInterface* storedMessages =
+                connection->interface<CommHistoryTp::Client::ConnectionInterfaceStoredMessagesInterface>();
+        if (storedMessages) {
+            connect(storedMessages,
+                    SIGNAL(MessagesExpunged(QStringList)),
+                    SLOT(onMessagesExpunged(QStringList)),
+                    Qt::UniqueConnection);
+        }
+
         fetchMessages(connection);
         m_Retries[connection->objectPath()] = m_Retries[connection->objectPath()] + 1;
     }
@@ -60,8 +76,8 @@ void MessageReviver::checkConnection(const Tp::ConnectionPtr& connection)
 
 bool MessageReviver::isConnectionHandled(const Tp::ConnectionPtr &connection)
 {
-    return m_Connections.key(connection) != 0
-           || m_TimerConnections.key(connection) != 0;
+    return m_Revivals.contains(connection->objectPath())
+           || m_TokenChecks.key(connection) != 0;
 }
 
 void MessageReviver::fetchMessages(const Tp::ConnectionPtr &connection)
@@ -86,95 +102,186 @@ void MessageReviver::onGetStoredMessages(QDBusPendingCallWatcher *call)
 
     if (reply.isError()) {
         qWarning() << reply.error().name() << "-" << reply.error().message();
+        if (!connection.isNull())
+            m_Revivals.remove(connection->objectPath());
+        updateTimer();
         call->deleteLater();
         return;
     }
 
-    updateTokens(reply.value().variant().toStringList(), connection);
+    // Ignore replies for connections that were dropped in the meantime
+    if (!connection.isNull() && m_Revivals.contains(connection->objectPath()))
+        updateTokens(reply.value().variant().toStringList(), connection);
 
     call->deleteLater();
 }
 
+void MessageReviver::onMessagesExpunged(const QStringList &tokens)
+{
+    QHash<QString, Revival>::iterator it = m_Revivals.begin();
+    for (; it != m_Revivals.end(); ++it) {
+        if (it->connection.isNull()
+            || it->connection->interface<CommHistoryTp::Client::ConnectionInterfaceStoredMessagesInterface>() != sender())
+            continue;
+
+        foreach (const QString &token, tokens)
+            it->tokens.remove(token);
+
+        // Still delivering; start the quiet period over
+        it->changed = true;
+        it->interval = STORED_MESSAGES_MIN_INTERVAL;
+        if (it->due >= 0)
+            schedule(*it, it->interval);
+        break;
+    }
+}
+
 void MessageReviver::updateTokens(const QStringList &tokens,
                                   Tp::ConnectionPtr &connection)
 {
-    QSet<QString> currentTokens = tokens.toSet();
-    QSet<QString> initialTokens = m_MessageTokens.take(connection->objectPath());
-    bool modified = false;
-
     if (connection.isNull() || !connection->isValid()) {
         DEBUG() << "Connection is not valid anymore, abort";
+        if (!connection.isNull())
+            m_Revivals.remove(connection->objectPath());
+        updateTimer();
         return;
     }
 
-    if (initialTokens.isEmpty()) { // it's empty
-        // only if m_MessageTokens didn't have it
-        initialTokens = currentTokens;
+    QString path = connection->objectPath();
+    Revival &revival = m_Revivals[path];
+    revival.connection = connection;
+    if (revival.interval == 0)
+        revival.interval = STORED_MESSAGES_MIN_INTERVAL;
+
+    QSet<QString> currentTokens = tokens.toSet();
+    bool modified = false;
+
+    if (!revival.fetched || revival.tokens.isEmpty()) {
+        revival.tokens = currentTokens;
+        revival.fetched = true;
         modified = true;
     } else {
-        int setSize = initialTokens.size();
-        initialTokens.intersect(currentTokens);
-        modified = (setSize != initialTokens.size());
+        int setSize = revival.tokens.size();
+        revival.tokens.intersect(currentTokens);
+        modified = revival.changed || setSize != revival.tokens.size();
     }
+    revival.changed = false;
 
-    if (modified) {
-        if (!initialTokens.isEmpty()) {
-            m_MessageTokens.insert(connection->objectPath(), initialTokens);
-
-            int timerId = startTimer(STORED_MESSAGES_CHECK_INTERVAL);
-            if (timerId > 0) {
-                m_TimerConnections.insert(timerId, connection);
-            } else {
-                qWarning() << "Failed to start timer";
-            }
-        }
-    } else if (!initialTokens.isEmpty()) {
-        m_MessageTokens.insert(connection->objectPath(), initialTokens);
+    if (revival.tokens.isEmpty()) {
+        m_Revivals.remove(path);
+        m_Retries.remove(path);
+        updateTimer();
+    } else if (modified) {
+        // Back off while the channels are still working through the messages
+        schedule(revival, revival.interval);
+        revival.interval = qMin(revival.interval * 2, STORED_MESSAGES_MAX_INTERVAL);
+    } else {
+        QSet<QString> messageTokens = revival.tokens;
+        m_Revivals.remove(path);
+        updateTimer();
         // get tp-glib connection to finally expunge/deliver messages
-        handleMessages(connection);
+        handleMessages(connection, messageTokens);
     }
 }
 
-void MessageReviver::timerEvent(QTimerEvent *event)
+void MessageReviver::schedule(Revival &revival, int delay)
 {
-    Tp::ConnectionPtr connection = m_TimerConnections.take(event->timerId());
+    revival.due = m_Clock.elapsed() + delay;
+    updateTimer();
+}
 
-    if (!connection.isNull() && connection->isValid())
-        fetchMessages(connection);
+void MessageReviver::updateTimer()
+{
+    qint64 next = -1;
+    foreach (const Revival &revival, m_Revivals) {
+        if (revival.due >= 0 && (next < 0 || revival.due < next))
+            next = revival.due;
+    }
 
-    killTimer(event->timerId());
+    if (next < 0)
+        m_Timer.stop();
+    else
+        m_Timer.start(qMax<qint64>(0, next - m_Clock.elapsed()), this);
 }
 
-void MessageReviver::handleMessages(Tp::ConnectionPtr &connection)
+void MessageReviver::timerEvent(QTimerEvent *event)
 {
-    QStringList toRevive;
-    QStringList toBury;
+    if (event->timerId() != m_Timer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
 
-    EventModel model;
-    QSet<QString> messageTokens = m_MessageTokens.take(connection->objectPath());
+    qint64 now = m_Clock.elapsed();
+    QList<Tp::ConnectionPtr> due;
 
-    foreach (QString token, messageTokens) {
-        Event event;
-        if (model.databaseIO().getEventByMessageToken(token, event)) {
-            DEBUG() << "bury " << token;
-            toBury << token;
+    QHash<QString, Revival>::iterator it = m_Revivals.begin();
+    while (it != m_Revivals.end()) {
+        if (it->due < 0 || it->due > now) {
+            ++it;
+        } else if (it->connection.isNull() || !it->connection->isValid()) {
+            it = m_Revivals.erase(it);
         } else {
-            DEBUG() << "revive " << token;
-            toRevive << token;
+            it->due = -1;
+            due.append(it->connection);
+            ++it;
         }
     }
 
+    updateTimer();
+
+    foreach (const Tp::ConnectionPtr &connection, due)
+        fetchMessages(connection);
+}
+
+void MessageReviver::handleMessages(const Tp::ConnectionPtr &connection,
+                                    const QSet<QString> &messageTokens)
+{
+    // Checking thousands of tokens can take a while, so the database is
+    // queried in a worker thread.
+    QFutureWatcher<MessageTokenCheck> *watcher = new QFutureWatcher<MessageTokenCheck>(this);
+    connect(watcher, SIGNAL(finished()), SLOT(onTokensChecked()));
+    m_TokenChecks.insert(watcher, connection);
+    watcher->setFuture(QtConcurrent::run(checkMessageTokens, connection->objectPath(), messageTokens));
+}
+
+void MessageReviver::onTokensChecked()
+{
+    QFutureWatcher<MessageTokenCheck> *watcher =
+            static_cast<QFutureWatcher<MessageTokenCheck>*>(sender());
+    Tp::ConnectionPtr connection = m_TokenChecks.take(watcher);
+    MessageTokenCheck result = watcher->result();
+    watcher->deleteLater();
+
+    if (!result.ok) {
+        qWarning() << "Failed to check stored messages of" << result.connectionPath;
+        return;
+    }
+
+    if (connection.isNull() || !connection->isValid()) {
+        DEBUG() << "Connection is not valid anymore, abort";
+        return;
+    }
+
+    DEBUG() << "bury " << result.existing;
+    DEBUG() << "revive " << result.missing;
+
     CommHistoryTp::Client::ConnectionInterfaceStoredMessagesInterface* storedMessages =
             connection->interface<CommHistoryTp::Client::ConnectionInterfaceStoredMessagesInterface>();
 
     if (storedMessages) {
-        if (!toBury.isEmpty())
-            storedMessages->ExpungeMessages(toBury);
+        if (!result.existing.isEmpty()) {
+            // Goes out together with anything the channels have queued
+            ExpungeAggregator *aggregator = ExpungeAggregator::forConnection(connection);
+            aggregator->expunge(result.existing);
+            aggregator->flush();
+        }
+
+        if (!result.missing.isEmpty())
+            storedMessages->DeliverStoredMessages(result.missing);
 
-        if (!toRevive.isEmpty())
-            storedMessages->DeliverStoredMessages(toRevive);
+        // Handled; later connections of the path get their full retries
+        m_Retries.remove(result.connectionPath);
     } else {
         qCritical() << Q_FUNC_INFO << "No StoredMessage if";
     }
 }
-
@@ -24,11 +24,13 @@
 #define MESSAGE_REVIVER_H
 
 #include <QObject>
+#include <QBasicTimer>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QSet>
 #include <TelepathyQt/Connection>
 
-namespace CommHistory {
-    class EventModel;
-}
+#include "messagetokencheck.h"
 
 namespace RTComLogger
 {
@@ -38,7 +40,13 @@ class ConnectionUtils;
  * \class MessageReviver
  * \brief class responsible for checking any unhandled messages and redelivering them
  *  using stored messages interface
- *  Once all stored messages are processed, the object will delete itself.
+ *
+ *  Stored messages that are still being delivered through text channels get
+ *  expunged by the channel listeners. The reviver waits until the stored
+ *  message set stops changing: it re-reads StoredMessages after a quiet
+ *  period that doubles while the set keeps shrinking, and restarts the
+ *  quiet period whenever the connection reports MessagesExpunged. All
+ *  connections share one timer.
  */
 class MessageReviver : public QObject
 {
@@ -53,22 +61,42 @@ public Q_SLOTS:
 
 private Q_SLOTS:
     void onGetStoredMessages(QDBusPendingCallWatcher *call);
+    void onMessagesExpunged(const QStringList &tokens);
+    void onTokensChecked();
 private:
+    struct Revival {
+        Revival() : interval(0), due(-1), fetched(false), changed(false) {}
+
+        Tp::ConnectionPtr connection;
+        QSet<QString> tokens;
+        int interval;   // quiet period before the next check
+        qint64 due;     // next check, -1 while fetching
+        bool fetched;
+        bool changed;   // messages were expunged since the last check
+    };
+
     void updateTokens(const QStringList &tokens, Tp::ConnectionPtr &connection);
     void fetchMessages(const Tp::ConnectionPtr &connection);
+    void schedule(Revival &revival, int delay);
+    void updateTimer();
     void timerEvent(QTimerEvent *event);
-    void handleMessages(Tp::ConnectionPtr &connection);
+    void handleMessages(const Tp::ConnectionPtr &connection, const QSet<QString> &tokens);
     bool isConnectionHandled(const Tp::ConnectionPtr &connection);
 
 protected:
     // keep connections while fetching stored messages
     QHash<QDBusPendingCallWatcher*, Tp::ConnectionPtr> m_Connections;
-    // keep connections while waiting timer time outs
-    QHash<int, Tp::ConnectionPtr> m_TimerConnections;
-    QHash<QString, QSet<QString> > m_MessageTokens;
+    // connections waiting for their stored messages to settle, by object path
+    QHash<QString, Revival> m_Revivals;
+    // keep connections while their tokens are looked up in a worker thread
+    QHash<QFutureWatcher<MessageTokenCheck>*, Tp::ConnectionPtr> m_TokenChecks;
 
+    // revivals started since the last one that completed, by object path
     QHash<QString,int> m_Retries;
 
+    QBasicTimer m_Timer;
+    QElapsedTimer m_Clock;
+
 #ifdef UNIT_TEST
     friend class Ut_MessageReviver;
 #endif
@@ -0,0 +1,115 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "messagetokencheck.h"
+#include "commhistorydatabase.h"
+#include "debug.h"
+
+#include <QAtomicInt>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+
+// SQLite allows 999 bound parameters per statement
+#define TOKEN_CHUNK_SIZE 500
+
+using namespace RTComLogger;
+
+namespace {
+
+QAtomicInt connectionCounter;
+
+bool queryExisting(QSqlDatabase &database, const QStringList &tokens, QSet<QString> &existing)
+{
+    QStringList placeholders;
+    placeholders.reserve(tokens.size());
+    for (int i = 0; i < tokens.size(); i++)
+        placeholders.append(QStringLiteral("?"));
+
+    QSqlQuery query(database);
+    query.setForwardOnly(true);
+    if (!query.prepare(QString::fromLatin1("SELECT messageToken FROM Events WHERE messageToken IN (%1)")
+                       .arg(placeholders.join(QLatin1Char(','))))) {
+        qCritical() << "Failed to prepare message token query:" << query.lastError().text();
+        return false;
+    }
+
+    foreach (const QString &token, tokens)
+        query.addBindValue(token);
+
+    if (!query.exec()) {
+        qCritical() << "Failed to query message tokens:" << query.lastError().text();
+        return false;
+    }
+
+    while (query.next())
+        existing.insert(query.value(0).toString());
+
+    return true;
+}
+
+}
+
+MessageTokenCheck RTComLogger::checkMessageTokens(const QString &connectionPath,
+                                                  const QSet<QString> &tokens)
+{
+    MessageTokenCheck result;
+    result.connectionPath = connectionPath;
+
+    QSet<QString> existing;
+    QString connectionName = QString::fromLatin1("commhistoryd-tokens-%1")
+            .arg(connectionCounter.fetchAndAddRelaxed(1));
+
+    {
+        QSqlDatabase database = CommHistoryDatabase::open(connectionName, CommHistoryDatabase::ReadOnly);
+        if (database.isOpen()) {
+            result.ok = true;
+            QStringList chunk;
+            QSet<QString>::const_iterator it = tokens.constBegin();
+            for (; result.ok && it != tokens.constEnd(); ++it) {
+                chunk.append(*it);
+                if (chunk.size() == TOKEN_CHUNK_SIZE) {
+                    result.ok = queryExisting(database, chunk, existing);
+                    chunk.clear();
+                }
+            }
+            if (result.ok && !chunk.isEmpty())
+                result.ok = queryExisting(database, chunk, existing);
+            database.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+
+    if (!result.ok)
+        return result;
+
+    foreach (const QString &token, tokens) {
+        if (existing.contains(token))
+            result.existing.append(token);
+        else
+            result.missing.append(token);
+    }
+
+    DEBUG() << Q_FUNC_INFO << connectionPath << result.existing.size() << "stored,"
+            << result.missing.size() << "missing";
+    return result;
+}
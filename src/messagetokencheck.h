@@ -0,0 +1,55 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef MESSAGETOKENCHECK_H
+#define MESSAGETOKENCHECK_H
+
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+namespace RTComLogger {
+
+/*!
+ * Result of checkMessageTokens(): which of the tokens already have an
+ * event in the database.
+ */
+struct MessageTokenCheck
+{
+    MessageTokenCheck() : ok(false) {}
+
+    QString connectionPath;
+    QStringList existing;
+    QStringList missing;
+    bool ok;
+};
+
+/*!
+ * Looks up which message tokens already have an event, with a few chunked
+ * queries on a private database connection. Safe to call from a worker
+ * thread; the event itself is never loaded.
+ */
+MessageTokenCheck checkMessageTokens(const QString &connectionPath, const QSet<QString> &tokens);
+
+} // namespace RTComLogger
+
+#endif // MESSAGETOKENCHECK_H
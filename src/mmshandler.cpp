@@ -21,6 +21,7 @@
 
 #include "mmshandler.h"
 #include "mmspart.h"
+#include "mmsretryscheduler.h"
 #include "constants.h"
 #include "notificationmanager.h"
 #include "debug.h"
@@ -33,19 +34,30 @@
 #include <QDBusMessage>
 #include <QDBusPendingCall>
 #include <QDBusPendingCallWatcher>
+#include <QDBusInterface>
+#include <QStandardPaths>
+#include <QTimer>
 #include <contextproperty.h>
 #include <mgconfitem.h>
+#include "qofonomanager.h"
+#include "qofonosimmanager.h"
 
 using namespace RTComLogger;
 using namespace CommHistory;
 
+// How long unfinished transactions wait for the cellular status at startup
+#define RESUME_STATUS_TIMEOUT 10000
+
 MmsHandler::MmsHandler(QObject* parent)
     : MessageHandlerBase(parent, "/", "org.nemomobile.MmsHandler")
     , m_cellularStatusProperty(new ContextProperty("Cellular.Status", this))
     , m_roamingAllowedProperty(new ContextProperty("Cellular.DataRoamingAllowed", this))
     , m_subscriberIdentityProperty(new ContextProperty("Cellular.SubscriberIdentity", this))
+    , m_retryScheduler(new MmsRetryScheduler(this))
     , m_sendMessageFlags(NULL)
     , m_automaticDownload(NULL)
+    , m_journal(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + "/commhistoryd/mms-transactions")
+    , m_ofonoManager(new QOfonoManager(this))
 {
     qDBusRegisterMetaType<MmsPart>();
     qDBusRegisterMetaType<MmsPartList>();
@@ -53,6 +65,149 @@ MmsHandler::MmsHandler(QObject* parent)
     connect(m_roamingAllowedProperty, SIGNAL(valueChanged()), SLOT(onDataProhibitedChanged()));
     connect(m_subscriberIdentityProperty, SIGNAL(valueChanged()), SLOT(onSubscriberIdentityChanged()));
     onSubscriberIdentityChanged();
+
+    // Own numbers are cached from the SIM managers and kept up to date from
+    // their change signals, so that received messages never wait on oFono
+    connect(m_ofonoManager, SIGNAL(modemAdded(QString)), SLOT(onModemAdded(QString)));
+    connect(m_ofonoManager, SIGNAL(modemRemoved(QString)), SLOT(onModemRemoved(QString)));
+    connect(m_ofonoManager, SIGNAL(availableChanged(bool)), SLOT(onOfonoAvailableChanged(bool)));
+    foreach (const QString &path, m_ofonoManager->modems())
+        onModemAdded(path);
+
+    connect(m_retryScheduler, SIGNAL(dispatch(CommHistory::Event)), SLOT(dispatchDeferredSend(CommHistory::Event)));
+    connect(m_retryScheduler, SIGNAL(depthChanged(int)), SIGNAL(queueDepthChanged(int)));
+
+    // Read the journal before any new transactions are recorded
+    m_resumable = m_journal.replay();
+    m_resumeClock.start();
+    QTimer::singleShot(0, this, SLOT(resumeTransactions()));
+    QTimer::singleShot(RESUME_STATUS_TIMEOUT, this, SLOT(resumeTransactions()));
+}
+
+void MmsHandler::setEventActive(int eventId, MmsTransactionJournal::State state)
+{
+    if (!m_activeEvents.contains(eventId))
+        m_activeEvents.append(eventId);
+    m_journal.record(eventId, state);
+}
+
+void MmsHandler::setEventDone(int eventId)
+{
+    m_activeEvents.removeOne(eventId);
+    m_activeSends.remove(eventId);
+    m_journal.record(eventId, MmsTransactionJournal::Done);
+}
+
+// Pick up transactions that were in progress when the daemon last exited
+void MmsHandler::resumeTransactions()
+{
+    if (m_resumable.isEmpty())
+        return;
+
+    // Roaming restrictions decide how to resume. Wait for the cellular status
+    // to be delivered instead of blocking startup on the subscription; this is
+    // called again when it changes, and once more after the timeout.
+    if (m_cellularStatusProperty->value().isNull() && m_resumeClock.elapsed() < RESUME_STATUS_TIMEOUT)
+        return;
+
+    QHash<int, MmsTransactionJournal::State> pending;
+    pending.swap(m_resumable);
+
+    QHash<int, MmsTransactionJournal::State>::const_iterator it = pending.constBegin();
+    for (; it != pending.constEnd(); ++it) {
+        Event event;
+        SingleEventModel model;
+        if (model.getEventById(it.key()))
+            event = model.event(model.index(0, 0));
+
+        if (!event.isValid()) {
+            setEventDone(it.key());
+            continue;
+        }
+
+        bool unfinished;
+        if (it.value() == MmsTransactionJournal::Sending)
+            unfinished = event.status() == Event::SendingStatus;
+        else
+            unfinished = event.status() == Event::WaitingStatus || event.status() == Event::DownloadingStatus;
+
+        if (unfinished)
+            cancelStaleTransaction(event);
+        else
+            setEventDone(event.id());
+    }
+}
+
+QDBusPendingCall MmsHandler::cancelEngineTransaction(int eventId)
+{
+    QDBusMessage call = QDBusMessage::createMethodCall("org.nemomobile.MmsEngine", "/", "org.nemomobile.MmsEngine", "cancel");
+    call.setArguments(QVariantList() << eventId);
+    return QDBusConnection::systemBus().asyncCall(call);
+}
+
+// The engine may still hold a transaction from before the restart. Cancel it
+// and wait for the reply before starting over with the same id, so that the
+// message isn't sent or downloaded twice.
+void MmsHandler::cancelStaleTransaction(const Event &event)
+{
+    m_staleTransactions.insert(event.id(), event);
+
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(cancelEngineTransaction(event.id()), this);
+    watcher->setProperty("mms-event-id", event.id());
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), SLOT(staleTransactionCancelled(QDBusPendingCallWatcher*)));
+}
+
+void MmsHandler::staleTransactionCancelled(QDBusPendingCallWatcher *call)
+{
+    int eventId = call->property("mms-event-id").toInt();
+    call->deleteLater();
+
+    // Finished by the engine before it was cancelled
+    if (!m_staleTransactions.contains(eventId))
+        return;
+
+    Event event = m_staleTransactions.take(eventId);
+    bool dataProhibited = isDataProhibited();
+
+    if (event.direction() == Event::Outbound) {
+        if (dataProhibited) {
+            DEBUG() << "Not resuming MMS send due to data roaming restrictions:" << event.id();
+            event.setStatus(Event::TemporarilyFailedStatus);
+            EventModel model;
+            model.modifyEvent(event);
+            setEventDone(event.id());
+            NotificationManager::instance()->showNotification(event, event.remoteUid(), Group::ChatTypeP2P);
+        } else {
+            DEBUG() << "Resuming MMS send:" << event.id();
+            sendMessageFromEvent(event);
+        }
+    } else {
+        if (dataProhibited) {
+            // Leave it to the user to download later, as for a new notification
+            DEBUG() << "Not resuming MMS receive due to data roaming restrictions:" << event.id();
+            event.setStatus(Event::ManualNotificationStatus);
+            EventModel model;
+            model.modifyEvent(event);
+            setEventDone(event.id());
+            NotificationManager::instance()->showNotification(event, event.remoteUid(), Group::ChatTypeP2P);
+        } else {
+            DEBUG() << "Resuming MMS receive:" << event.id();
+            receiveMessageFromEvent(event);
+        }
+    }
+}
+
+void MmsHandler::receiveMessageFromEvent(const Event &event)
+{
+    QVariantList args;
+    args << event.id() << event.extraProperty("mms-notification-imsi").toString() << true
+         << QByteArray::fromBase64(event.extraProperty("mms-push-data").toByteArray());
+
+    setEventActive(event.id(), MmsTransactionJournal::Notification);
+
+    QDBusMessage call = QDBusMessage::createMethodCall("org.nemomobile.MmsEngine", "/", "org.nemomobile.MmsEngine", "receiveMessage");
+    call.setArguments(args);
+    QDBusConnection::systemBus().asyncCall(call);
 }
 
 QString MmsHandler::messageNotification(const QString &imsi, const QString &from,
@@ -86,7 +241,7 @@ QString MmsHandler::messageNotification(const QString &imsi, const QString &from
     }
 
     if (!manualDownload) {
-        m_activeEvents.append(event.id());
+        setEventActive(event.id(), MmsTransactionJournal::Notification);
     } else {
         // Show a notification when manual download is needed
         NotificationManager::instance()->showNotification(event, from, Group::ChatTypeP2P);
@@ -107,6 +262,11 @@ enum MessageReceiveState {
 
 void MmsHandler::messageReceiveStateChanged(const QString &recId, int state)
 {
+    // Reported for a transaction that is being cancelled, or that was
+    // cancelled and held due to roaming
+    if (m_staleTransactions.contains(recId.toInt()) || m_suspendedReceives.contains(recId.toInt()))
+        return;
+
     Event event;
     SingleEventModel model;
     if (model.getEventById(recId.toInt()))
@@ -114,7 +274,7 @@ void MmsHandler::messageReceiveStateChanged(const QString &recId, int state)
 
     if (!event.isValid()) {
         qWarning() << "Ignoring MMS message receive state for unknown event" << recId;
-        m_activeEvents.removeOne(recId.toInt());
+        setEventDone(recId.toInt());
         return;
     }
 
@@ -126,12 +286,15 @@ void MmsHandler::messageReceiveStateChanged(const QString &recId, int state)
         case Receiving:
         case Decoding:
             newStatus = Event::DownloadingStatus;
+            setEventActive(event.id(), MmsTransactionJournal::Receiving);
             break;
         case NoSpace:
         case RecvError:
             // Avoid overwriting the status for cancelled receive calls
-            if (event.status() == Event::ManualNotificationStatus)
+            if (event.status() == Event::ManualNotificationStatus) {
+                setEventDone(event.id());
                 return;
+            }
             newStatus = Event::TemporarilyFailedStatus;
             break;
         case Garbage:
@@ -145,7 +308,7 @@ void MmsHandler::messageReceiveStateChanged(const QString &recId, int state)
             qWarning() << "Failed updating MMS event status for" << recId;
 
         if (newStatus != Event::WaitingStatus && newStatus != Event::DownloadingStatus) {
-            m_activeEvents.removeOne(event.id());
+            setEventDone(event.id());
             NotificationManager::instance()->showNotification(event, event.remoteUid(), Group::ChatTypeP2P);
         }
     }
@@ -155,12 +318,15 @@ void MmsHandler::messageReceived(const QString &recId, const QString &mmsId, con
         const QStringList &to, const QStringList &cc, const QString &subj, uint date, int priority,
         const QString &cls, bool readReport, MmsPartList parts)
 {
+    m_staleTransactions.remove(recId.toInt());
+    m_suspendedReceives.remove(recId.toInt());
+
     Event event;
     SingleEventModel model;
     if (model.getEventById(recId.toInt()))
         event = model.event(model.index(0, 0));
 
-    m_activeEvents.removeOne(recId.toInt());
+    setEventDone(recId.toInt());
 
     if (!event.isValid()) {
         // Create new event
@@ -186,16 +352,21 @@ void MmsHandler::messageReceived(const QString &recId, const QString &mmsId, con
     Q_UNUSED(priority);
     Q_UNUSED(cls);
 
+    // SIM the notification was received on
+    QString imsi = event.extraProperty("mms-notification-imsi").toString();
+
     // Remove MMS notification properties
     event.setExtraProperty("mms-notification-imsi", QVariant());
     event.setExtraProperty("mms-expiry", QVariant());
     event.setExtraProperty("mms-push-data", QVariant());
 
-    // Change UID/group if necessary
-    if (event.remoteUid() != from) {
+    // Change UID/group if necessary; messages to several recipients
+    // belong to a conversation with the sender and the other recipients.
+    QStringList remoteUids = conversationMembers(from, to + cc, imsi);
+    if (event.remoteUid() != from || remoteUids.size() > 1) {
         int oldGroup = event.groupId();
         event.setRemoteUid(from);
-        if (!setGroupForEvent(event))
+        if (!setGroupForEvent(event, remoteUids))
             qCritical() << "Failed handling group for MMS received event";
 
         if (oldGroup != event.groupId()) {
@@ -307,6 +478,11 @@ void MmsHandler::messageSendStateChanged(const QString &recId, int state)
         Refused
     };
 
+    // Reported for a transaction that is being cancelled, or that was
+    // cancelled and deferred due to roaming; it isn't a failure to notify.
+    if (m_staleTransactions.contains(recId.toInt()) || m_retryScheduler->isDeferred(recId.toInt()))
+        return;
+
     Event event;
     SingleEventModel model;
     if (model.getEventById(recId.toInt()))
@@ -314,7 +490,7 @@ void MmsHandler::messageSendStateChanged(const QString &recId, int state)
 
     if (!event.isValid()) {
         qWarning() << "Ignoring MMS message send state for unknown event" << recId;
-        m_activeEvents.removeOne(recId.toInt());
+        setEventDone(recId.toInt());
         return;
     }
 
@@ -341,20 +517,32 @@ void MmsHandler::messageSendStateChanged(const QString &recId, int state)
             qWarning() << "Failed updating MMS event status for" << recId;
 
         if (newStatus != Event::SendingStatus) {
-            m_activeEvents.removeOne(event.id());
-            NotificationManager::instance()->showNotification(event, event.remoteUid(), Group::ChatTypeP2P);
+            setEventDone(event.id());
+
+            bool retrying = false;
+            if (newStatus == Event::TemporarilyFailedStatus)
+                retrying = m_retryScheduler->sendFailed(event.id());
+            else
+                m_retryScheduler->sendFinished(event.id());
+
+            if (!retrying)
+                NotificationManager::instance()->showNotification(event, event.remoteUid(), Group::ChatTypeP2P);
         }
     }
 }
 
 void MmsHandler::messageSent(const QString &recId, const QString &mmsId)
 {
+    m_staleTransactions.remove(recId.toInt());
+
     Event event;
     SingleEventModel model;
     if (model.getEventById(recId.toInt()))
         event = model.event(model.index(0, 0));
 
-    m_activeEvents.removeOne(recId.toInt());
+    setEventDone(recId.toInt());
+    // Also when it was deferred after the engine finished sending
+    m_retryScheduler->remove(recId.toInt());
 
     if (!event.isValid()) {
         qWarning() << "Ignoring MMS message sent state for unknown event" << recId;
@@ -445,6 +633,91 @@ static QStringList normalizeNumberList(const QStringList &in)
     return out;
 }
 
+void MmsHandler::onModemAdded(const QString &path)
+{
+    onModemRemoved(path);
+
+    QOfonoSimManager *sim = new QOfonoSimManager(this);
+    sim->setModemPath(path);
+    m_simManagers.insert(path, sim);
+    connect(sim, SIGNAL(subscriberIdentityChanged(QString)), SLOT(updateOwnNumbers()));
+    connect(sim, SIGNAL(subscriberNumbersChanged(QStringList)), SLOT(updateOwnNumbers()));
+    connect(sim, SIGNAL(validChanged(bool)), SLOT(updateOwnNumbers()));
+    updateOwnNumbers();
+}
+
+void MmsHandler::onModemRemoved(const QString &path)
+{
+    QOfonoSimManager *sim = m_simManagers.take(path);
+    if (sim) {
+        delete sim;
+        updateOwnNumbers();
+    }
+}
+
+void MmsHandler::onOfonoAvailableChanged(bool available)
+{
+    if (!available) {
+        foreach (const QString &path, m_simManagers.keys())
+            onModemRemoved(path);
+    }
+}
+
+void MmsHandler::updateOwnNumbers()
+{
+    m_ownNumbers.clear();
+    foreach (QOfonoSimManager *sim, m_simManagers) {
+        // Subscriber numbers are only available if stored on the SIM
+        QStringList numbers = sim->subscriberNumbers();
+        if (!numbers.isEmpty())
+            m_ownNumbers[sim->subscriberIdentity()].append(numbers);
+    }
+
+    DEBUG() << "MmsHandler: own numbers" << m_ownNumbers;
+}
+
+QStringList MmsHandler::ownNumbers(const QString &imsi) const
+{
+    if (!imsi.isEmpty() && m_ownNumbers.contains(imsi))
+        return m_ownNumbers.value(imsi);
+
+    QStringList numbers;
+    foreach (const QStringList &simNumbers, m_ownNumbers)
+        numbers.append(simNumbers);
+    return numbers;
+}
+
+QStringList MmsHandler::conversationMembers(const QString &from, const QStringList &recipients, const QString &imsi) const
+{
+    QStringList members(from);
+    if (recipients.size() < 2)
+        return members;
+
+    // One of the recipients is most likely this device. Without knowing the
+    // own number it can't be told apart, and including it would give a
+    // different conversation from the one replies are sent to.
+    QStringList own = ownNumbers(imsi);
+    if (own.isEmpty()) {
+        DEBUG() << "MmsHandler: own number unknown; keeping MMS with several recipients in the sender's conversation";
+        return members;
+    }
+
+    foreach (const QString &recipient, recipients) {
+        bool skip = false;
+        foreach (const QString &number, members + own) {
+            if (CommHistory::remoteAddressMatch(RING_ACCOUNT_PATH, number, recipient)) {
+                skip = true;
+                break;
+            }
+        }
+
+        if (!skip)
+            members.append(CommHistory::normalizePhoneNumber(recipient, false));
+    }
+
+    return members;
+}
+
 int MmsHandler::sendMessage(const QStringList &to, const QStringList &cc, const QStringList &bcc,
         const QString &subject, MmsPartList parts)
 {
@@ -458,18 +731,24 @@ int MmsHandler::sendMessage(const QStringList &to, const QStringList &cc, const
     event.setStatus(Event::SendingStatus);
     event.setIsRead(true);
 
-    event.setRemoteUid(CommHistory::normalizePhoneNumber(to[0], false)); // XXX Wrong for group conversations!
     event.setToList(normalizeNumberList(to));
     event.setCcList(normalizeNumberList(cc));
     event.setBccList(normalizeNumberList(bcc));
 
-    // XXX Group conversations not yet supported
-    if (to.size() + cc.size() + bcc.size() > 1) {
-        qCritical() << "Ignoring outgoing group MMS event; this is not yet implemented:" << event.toString();
+    // All recipients share one event. The conversation is with the visible
+    // recipients, which is also how the recipients see it; BCC recipients
+    // only make one up when there are no others.
+    QStringList remoteUids = event.toList() + event.ccList();
+    if (remoteUids.isEmpty())
+        remoteUids = event.bccList();
+    remoteUids.removeDuplicates();
+    if (remoteUids.isEmpty()) {
+        qCritical() << "Ignoring outgoing MMS event with no recipients";
         return -1;
     }
+    event.setRemoteUid(remoteUids.first());
 
-    if (!setGroupForEvent(event)) {
+    if (!setGroupForEvent(event, remoteUids)) {
         qCritical() << "Failed to handle group for MMS send event; message dropped:" << event.toString();
         return -1;
     }
@@ -508,9 +787,11 @@ int MmsHandler::sendMessage(const QStringList &to, const QStringList &cc, const
             }
         }
     } else if (isDataProhibited()) {
-        qWarning() << "Refusing to send MMS message due to data roaming restrictions";
+        qWarning() << "Deferring MMS message due to data roaming restrictions";
         event.setStatus(Event::TemporarilyFailedStatus);
         model.modifyEvent(event);
+        m_retryScheduler->suspend();
+        m_retryScheduler->defer(event);
     } else {
         sendMessageFromEvent(event);
     }
@@ -542,6 +823,21 @@ void MmsHandler::sendMessageFromEvent(int eventId)
         return;
     }
 
+    if (isDataProhibited()) {
+        qWarning() << "Deferring MMS message due to data roaming restrictions";
+        if (event.status() != Event::TemporarilyFailedStatus) {
+            event.setStatus(Event::TemporarilyFailedStatus);
+            model.modifyEvent(event);
+        }
+        m_retryScheduler->suspend();
+        m_retryScheduler->defer(event);
+        return;
+    }
+
+    // Sent by request now, don't retry from the queue or resume as well
+    m_retryScheduler->remove(eventId);
+    m_staleTransactions.remove(eventId);
+
     if (event.status() != Event::SendingStatus) {
         event.setStatus(Event::SendingStatus);
         model.modifyEvent(event);
@@ -550,6 +846,28 @@ void MmsHandler::sendMessageFromEvent(int eventId)
     sendMessageFromEvent(event);
 }
 
+void MmsHandler::dispatchDeferredSend(const Event &deferredEvent)
+{
+    Event event(deferredEvent);
+    if (isDataProhibited()) {
+        m_retryScheduler->suspend();
+        m_retryScheduler->defer(event);
+        return;
+    }
+
+    event.setStatus(Event::SendingStatus);
+    EventModel model;
+    if (!model.modifyEvent(event))
+        qWarning() << "Failed updating MMS event status for" << event.id();
+
+    sendMessageFromEvent(event);
+}
+
+int MmsHandler::queueDepth() const
+{
+    return m_retryScheduler->depth();
+}
+
 void MmsHandler::sendMessageFromEvent(Event &event)
 {
     MmsPartList parts;
@@ -565,7 +883,8 @@ void MmsHandler::sendMessageFromEvent(Event &event)
     args << event.id() << QString() << event.toList() << event.ccList() << event.bccList()
          << event.subject() << flags << QVariant::fromValue(parts);
 
-    m_activeEvents.append(event.id());
+    setEventActive(event.id(), MmsTransactionJournal::Sending);
+    m_activeSends.insert(event.id(), event);
 
     QDBusMessage call = QDBusMessage::createMethodCall("org.nemomobile.MmsEngine", "/", "org.nemomobile.MmsEngine", "sendMessage");
     call.setArguments(args);
@@ -586,10 +905,17 @@ void MmsHandler::sendMessageFinished(QDBusPendingCallWatcher *call)
         event = model.event(model.index(0, 0));
 
     QDBusPendingReply<QString> reply = *call;
-    if (reply.isError()) {
+    if (ok && m_retryScheduler->isDeferred(eventId)) {
+        // Cancelled and deferred due to roaming while the call was pending
+        call->deleteLater();
+        return;
+    } else if (reply.isError()) {
         qCritical() << "Call to MmsEngine sendMessage failed:" << reply.error();
+        if (ok)
+            setEventDone(eventId);
         event.setStatus(Event::TemporarilyFailedStatus);
-        NotificationManager::instance()->showNotification(event, event.remoteUid(), Group::ChatTypeP2P);
+        if (!ok || !m_retryScheduler->sendFailed(eventId))
+            NotificationManager::instance()->showNotification(event, event.remoteUid(), Group::ChatTypeP2P);
     } else {
         event.setExtraProperty("mms-notification-imsi", reply.value());
     }
@@ -617,15 +943,76 @@ bool MmsHandler::isDataProhibited()
 
 void MmsHandler::onDataProhibitedChanged()
 {
-    if (!m_activeEvents.isEmpty() && isDataProhibited()) {
-        qWarning() << "Cancelling" << m_activeEvents.size() << "active MMS events due to roaming restrictions";
-        // Cancel any active events to prevent automatic retries
-        foreach (int eventId, m_activeEvents) {
-            QDBusMessage call = QDBusMessage::createMethodCall("org.nemomobile.MmsEngine", "/", "org.nemomobile.MmsEngine", "cancel");
-            call.setArguments(QVariantList() << eventId);
-            QDBusConnection::systemBus().asyncCall(call);
+    resumeTransactions();
+
+    // Avoid querying the roaming policy when there is nothing to do
+    if (m_activeEvents.isEmpty() && m_retryScheduler->depth() == 0 && m_suspendedReceives.isEmpty()) {
+        m_retryScheduler->resume();
+        return;
+    }
+
+    if (!isDataProhibited()) {
+        m_retryScheduler->resume();
+        resumeReceives();
+        return;
+    }
+
+    m_retryScheduler->suspend();
+    if (m_activeEvents.isEmpty())
+        return;
+
+    qWarning() << "Cancelling" << m_activeEvents.size() << "active MMS events due to roaming restrictions";
+    // Cancel any active events to prevent automatic retries, and hold
+    // them to be sent or downloaded again when data is allowed.
+    QList<Event> suspendedSends;
+    foreach (int eventId, m_activeEvents) {
+        cancelEngineTransaction(eventId);
+
+        if (m_activeSends.contains(eventId)) {
+            Event event = m_activeSends.value(eventId);
+            event.setStatus(Event::TemporarilyFailedStatus);
+            suspendedSends.append(event);
+            m_journal.record(eventId, MmsTransactionJournal::Done);
+        } else {
+            // Left in the journal, so it's resumed after a restart as well
+            m_suspendedReceives.insert(eventId);
         }
-        m_activeEvents.clear();
+    }
+    m_activeEvents.clear();
+    m_activeSends.clear();
+
+    if (!suspendedSends.isEmpty()) {
+        EventModel model;
+        if (!model.modifyEvents(suspendedSends))
+            qWarning() << "Failed updating status of" << suspendedSends.size() << "suspended MMS events";
+
+        foreach (const Event &event, suspendedSends)
+            m_retryScheduler->defer(event);
+    }
+}
+
+void MmsHandler::resumeReceives()
+{
+    if (m_suspendedReceives.isEmpty())
+        return;
+
+    DEBUG() << "Resuming" << m_suspendedReceives.size() << "MMS receives held due to roaming restrictions";
+    QSet<int> receives;
+    receives.swap(m_suspendedReceives);
+
+    foreach (int eventId, receives) {
+        Event event;
+        SingleEventModel model;
+        if (model.getEventById(eventId))
+            event = model.event(model.index(0, 0));
+
+        // Downloaded, or changed to manual download in the meantime
+        if (!event.isValid() || (event.status() != Event::WaitingStatus && event.status() != Event::DownloadingStatus)) {
+            setEventDone(eventId);
+            continue;
+        }
+
+        receiveMessageFromEvent(event);
     }
 }
 
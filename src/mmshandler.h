@@ -24,14 +24,24 @@
 
 #include "messagehandlerbase.h"
 #include "mmspart.h"
+#include "mmstransactionjournal.h"
+
+#include <CommHistory/Event>
+#include <QDBusPendingCall>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
 
 namespace CommHistory {
     class MessagePart;
 }
 
+class MmsRetryScheduler;
 class QDBusPendingCallWatcher;
 class ContextProperty;
 class MGConfItem;
+class QOfonoManager;
+class QOfonoSimManager;
 
 class MmsHandler : public MessageHandlerBase
 {
@@ -57,23 +67,56 @@ public Q_SLOTS:
             const QString &subject, MmsPartList parts);
     void sendMessageFromEvent(int eventId);
 
+    int queueDepth() const;
+
+Q_SIGNALS:
+    void queueDepthChanged(int depth);
+
 private Q_SLOTS:
     void sendMessageFinished(QDBusPendingCallWatcher *call);
+    void resumeTransactions();
+    void staleTransactionCancelled(QDBusPendingCallWatcher *call);
+    void dispatchDeferredSend(const CommHistory::Event &event);
     void onDataProhibitedChanged();
     void onSubscriberIdentityChanged();
+    void onModemAdded(const QString &path);
+    void onModemRemoved(const QString &path);
+    void onOfonoAvailableChanged(bool available);
+    void updateOwnNumbers();
 
 private:
     ContextProperty *m_cellularStatusProperty;
     ContextProperty *m_roamingAllowedProperty;
     ContextProperty *m_subscriberIdentityProperty;
     QList<int> m_activeEvents;
+    QHash<int, CommHistory::Event> m_activeSends;
+    QSet<int> m_suspendedReceives;
+    MmsRetryScheduler *m_retryScheduler;
     MGConfItem* m_sendMessageFlags;
     MGConfItem* m_automaticDownload;
+    MmsTransactionJournal m_journal;
+    QHash<int, MmsTransactionJournal::State> m_resumable;
+    QHash<int, CommHistory::Event> m_staleTransactions;
+    QElapsedTimer m_resumeClock;
+    QOfonoManager *m_ofonoManager;
+    QHash<QString, QOfonoSimManager*> m_simManagers;
+    // Subscriber numbers by IMSI
+    QHash<QString, QStringList> m_ownNumbers;
 
     void sendMessageFromEvent(CommHistory::Event &event);
     bool copyMmsPartFiles(const MmsPartList &parts, int eventId, QList<CommHistory::MessagePart> &eventParts, QString &freeText);
     QString copyMessagePartFile(const QString &sourcePath, int eventId, const QString &contentId);
 
+    void setEventActive(int eventId, MmsTransactionJournal::State state);
+    void setEventDone(int eventId);
+    void receiveMessageFromEvent(const CommHistory::Event &event);
+    QDBusPendingCall cancelEngineTransaction(int eventId);
+    void cancelStaleTransaction(const CommHistory::Event &event);
+    void resumeReceives();
+
+    QStringList ownNumbers(const QString &imsi) const;
+    QStringList conversationMembers(const QString &from, const QStringList &recipients, const QString &imsi) const;
+
     bool isDataProhibited();
 };
 
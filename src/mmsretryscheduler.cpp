@@ -0,0 +1,203 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "mmsretryscheduler.h"
+#include "debug.h"
+
+#include <QTimerEvent>
+
+using namespace CommHistory;
+
+#define MAX_CONCURRENT_SENDS 2
+#define MAX_SEND_ATTEMPTS 5
+#define RETRY_INTERVAL 30000 // ms, doubled after every failed attempt
+#define MAX_RETRY_INTERVAL (15 * 60 * 1000)
+
+MmsRetryScheduler::MmsRetryScheduler(QObject *parent)
+    : QObject(parent),
+      m_suspended(false)
+{
+    m_clock.start();
+}
+
+void MmsRetryScheduler::suspend()
+{
+    if (m_suspended)
+        return;
+
+    DEBUG() << "MmsRetryScheduler: suspended with" << depth() << "messages";
+    m_suspended = true;
+    m_timer.stop();
+}
+
+void MmsRetryScheduler::resume()
+{
+    if (!m_suspended)
+        return;
+
+    DEBUG() << "MmsRetryScheduler: resumed with" << depth() << "messages";
+    m_suspended = false;
+    dispatchDue();
+}
+
+void MmsRetryScheduler::defer(const Event &event)
+{
+    if (!event.isValid())
+        return;
+
+    bool known = m_entries.contains(event.id());
+    m_inFlight.remove(event.id());
+    if (!m_queue.contains(event.id()))
+        m_queue.append(event.id());
+
+    Entry &entry = m_entries[event.id()];
+    entry.event = event;
+    if (!known) {
+        entry.attempts = 0;
+        entry.due = m_clock.elapsed();
+    } else if (entry.attempts > 0) {
+        // Deferred again after being dispatched; don't come straight back
+        entry.due = m_clock.elapsed() + retryInterval(entry.attempts);
+        DEBUG() << "MmsRetryScheduler: deferred" << event.id() << "again after" << entry.attempts << "attempts";
+    }
+
+    emit depthChanged(depth());
+    dispatchDue();
+}
+
+void MmsRetryScheduler::remove(int eventId)
+{
+    if (!m_entries.remove(eventId))
+        return;
+
+    m_queue.removeOne(eventId);
+    m_inFlight.remove(eventId);
+
+    emit depthChanged(depth());
+    dispatchDue();
+}
+
+bool MmsRetryScheduler::contains(int eventId) const
+{
+    return m_entries.contains(eventId);
+}
+
+bool MmsRetryScheduler::isDeferred(int eventId) const
+{
+    return m_entries.contains(eventId) && !m_inFlight.contains(eventId);
+}
+
+void MmsRetryScheduler::sendFinished(int eventId)
+{
+    if (m_inFlight.contains(eventId))
+        remove(eventId);
+}
+
+bool MmsRetryScheduler::sendFailed(int eventId)
+{
+    if (!m_inFlight.remove(eventId))
+        return false;
+
+    Entry &entry = m_entries[eventId];
+    if (entry.attempts >= MAX_SEND_ATTEMPTS) {
+        qWarning() << "Giving up on sending MMS message after" << entry.attempts << "attempts:" << eventId;
+        remove(eventId);
+        return false;
+    }
+
+    qint64 interval = retryInterval(entry.attempts);
+    entry.due = m_clock.elapsed() + interval;
+    m_queue.append(eventId);
+
+    DEBUG() << "MmsRetryScheduler: retrying" << eventId << "in" << interval << "ms";
+    dispatchDue();
+    return true;
+}
+
+qint64 MmsRetryScheduler::retryInterval(int attempts)
+{
+    // deferrals don't count against MAX_SEND_ATTEMPTS; keep the shift bounded
+    int shift = qBound(0, attempts - 1, 16);
+    return qMin<qint64>(qint64(RETRY_INTERVAL) << shift, MAX_RETRY_INTERVAL);
+}
+
+int MmsRetryScheduler::depth() const
+{
+    return m_entries.size();
+}
+
+void MmsRetryScheduler::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_timer.timerId()) {
+        m_timer.stop();
+        dispatchDue();
+    } else {
+        QObject::timerEvent(event);
+    }
+}
+
+void MmsRetryScheduler::dispatchDue()
+{
+    if (m_suspended)
+        return;
+
+    qint64 now = m_clock.elapsed();
+    QList<int>::iterator it = m_queue.begin();
+    while (it != m_queue.end() && m_inFlight.size() < MAX_CONCURRENT_SENDS) {
+        Entry &entry = m_entries[*it];
+        if (entry.due > now) {
+            ++it;
+            continue;
+        }
+
+        int eventId = *it;
+        it = m_queue.erase(it);
+        m_inFlight.insert(eventId);
+        entry.attempts++;
+
+        DEBUG() << "MmsRetryScheduler: dispatching" << eventId << "attempt" << entry.attempts;
+        // Copy; the receiver may modify the scheduler
+        Event event = entry.event;
+        emit dispatch(event);
+        // The receiver may have suspended us or changed the queue
+        if (m_suspended)
+            return;
+        it = m_queue.begin();
+    }
+
+    schedule();
+}
+
+void MmsRetryScheduler::schedule()
+{
+    m_timer.stop();
+    if (m_suspended || m_queue.isEmpty() || m_inFlight.size() >= MAX_CONCURRENT_SENDS)
+        return;
+
+    qint64 next = -1;
+    foreach (int eventId, m_queue) {
+        qint64 due = m_entries.value(eventId).due;
+        if (next < 0 || due < next)
+            next = due;
+    }
+
+    m_timer.start(qMax<qint64>(next - m_clock.elapsed(), 0), this);
+}
@@ -0,0 +1,100 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef MMSRETRYSCHEDULER_H
+#define MMSRETRYSCHEDULER_H
+
+#include <QObject>
+#include <QBasicTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QSet>
+
+#include <CommHistory/Event>
+
+/* Holds outgoing MMS messages that can't be sent right now, and sends
+ * them again when allowed.
+ *
+ * While suspended (e.g. data is prohibited when roaming) nothing is
+ * dispatched. Once resumed, deferred messages are dispatched in order with
+ * a limited number in flight at a time. Messages that were dispatched by the
+ * scheduler and fail again are retried with exponential back-off, up to a
+ * maximum number of attempts.
+ */
+class MmsRetryScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MmsRetryScheduler(QObject *parent = 0);
+
+    bool isSuspended() const { return m_suspended; }
+    void suspend();
+    void resume();
+
+    // Hold an outgoing message until it can be dispatched
+    void defer(const CommHistory::Event &event);
+    // Forget a message, e.g. when it's sent by other means
+    void remove(int eventId);
+    bool contains(int eventId) const;
+    // Held by the scheduler and not currently being sent
+    bool isDeferred(int eventId) const;
+
+    // A message dispatched by the scheduler was sent or permanently failed
+    void sendFinished(int eventId);
+    // A message failed to send; returns true if it will be retried
+    bool sendFailed(int eventId);
+
+    // Number of messages waiting or in flight
+    int depth() const;
+
+Q_SIGNALS:
+    void dispatch(const CommHistory::Event &event);
+    void depthChanged(int depth);
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+private:
+    struct Entry {
+        CommHistory::Event event;
+        int attempts;
+        qint64 due;
+    };
+
+    static qint64 retryInterval(int attempts);
+    void schedule();
+    void dispatchDue();
+
+    QHash<int, Entry> m_entries;
+    QList<int> m_queue;
+    QSet<int> m_inFlight;
+    bool m_suspended;
+    QBasicTimer m_timer;
+    QElapsedTimer m_clock;
+
+#ifdef UNIT_TEST
+    friend class Ut_MmsRetryScheduler;
+#endif
+};
+
+#endif // MMSRETRYSCHEDULER_H
@@ -0,0 +1,161 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "mmstransactionjournal.h"
+#include "debug.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <unistd.h>
+
+// Rewrite the journal when it has this many records more than pending transactions
+#define COMPACT_THRESHOLD 64
+
+MmsTransactionJournal::MmsTransactionJournal(const QString &path)
+    : m_path(path),
+      m_file(path),
+      m_records(0)
+{
+}
+
+MmsTransactionJournal::~MmsTransactionJournal()
+{
+    m_file.close();
+}
+
+bool MmsTransactionJournal::open()
+{
+    if (m_file.isOpen())
+        return true;
+
+    QDir().mkpath(QFileInfo(m_path).path());
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "Cannot open MMS transaction journal:" << m_file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+QHash<int, MmsTransactionJournal::State> MmsTransactionJournal::replay()
+{
+    m_file.close();
+    m_pending.clear();
+    m_records = 0;
+
+    QFile file(m_path);
+    if (file.open(QIODevice::ReadOnly)) {
+        while (!file.atEnd()) {
+            QByteArray line = file.readLine();
+            // A partially written last line is ignored
+            if (line.size() < 4 || !line.endsWith('\n') || line.at(1) != ' ')
+                continue;
+
+            bool ok = false;
+            int eventId = line.mid(2, line.size() - 3).toInt(&ok);
+            if (!ok)
+                continue;
+
+            State state = static_cast<State>(line.at(0));
+            switch (state) {
+            case Notification:
+            case Receiving:
+            case Sending:
+                m_pending.insert(eventId, state);
+                break;
+            case Done:
+                m_pending.remove(eventId);
+                break;
+            default:
+                break;
+            }
+        }
+        file.close();
+    }
+
+    compact();
+
+    DEBUG() << "MMS transaction journal has" << m_pending.size() << "unfinished transactions";
+    return m_pending;
+}
+
+void MmsTransactionJournal::record(int eventId, State state)
+{
+    if (state == Done) {
+        if (!m_pending.remove(eventId))
+            return;
+    } else {
+        if (m_pending.value(eventId) == state)
+            return;
+        m_pending.insert(eventId, state);
+    }
+
+    if (!open())
+        return;
+
+    QByteArray line;
+    line.reserve(16);
+    line.append(char(state));
+    line.append(' ');
+    line.append(QByteArray::number(eventId));
+    line.append('\n');
+
+    if (m_file.write(line) != line.size() || !m_file.flush()) {
+        qWarning() << "Failed writing MMS transaction journal:" << m_file.errorString();
+        return;
+    }
+    fdatasync(m_file.handle());
+
+    if (++m_records > m_pending.size() + COMPACT_THRESHOLD)
+        compact();
+}
+
+void MmsTransactionJournal::compact()
+{
+    m_file.close();
+
+    if (m_pending.isEmpty()) {
+        QFile::remove(m_path);
+        m_records = 0;
+        return;
+    }
+
+    QDir().mkpath(QFileInfo(m_path).path());
+    QSaveFile file(m_path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Cannot rewrite MMS transaction journal:" << file.errorString();
+        return;
+    }
+
+    QHash<int, State>::const_iterator it = m_pending.constBegin();
+    for (; it != m_pending.constEnd(); ++it) {
+        file.write(QByteArray(1, char(it.value())) + ' ' + QByteArray::number(it.key()) + '\n');
+    }
+
+    if (!file.commit()) {
+        qWarning() << "Rewriting MMS transaction journal failed:" << file.errorString();
+        return;
+    }
+
+    m_records = m_pending.size();
+}
@@ -0,0 +1,65 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef MMSTRANSACTIONJOURNAL_H
+#define MMSTRANSACTIONJOURNAL_H
+
+#include <QFile>
+#include <QHash>
+#include <QString>
+
+/* Append-only record of MMS transactions handed to the MMS engine.
+ *
+ * Each state change is appended as one line ("<state> <event id>") and
+ * synced to disk. Replaying the journal at startup gives the last state of
+ * every transaction that wasn't finished, so they can be resumed or
+ * cancelled without scanning the event table. The file is rewritten with
+ * only the unfinished transactions when it grows.
+ */
+class MmsTransactionJournal
+{
+public:
+    enum State {
+        Notification = 'N',
+        Receiving = 'R',
+        Sending = 'S',
+        Done = 'D'
+    };
+
+    explicit MmsTransactionJournal(const QString &path);
+    ~MmsTransactionJournal();
+
+    // Read the journal and return unfinished transactions with their last state
+    QHash<int, State> replay();
+
+    void record(int eventId, State state);
+
+private:
+    bool open();
+    void compact();
+
+    QString m_path;
+    QFile m_file;
+    QHash<int, State> m_pending;
+    int m_records;
+};
+
+#endif // MMSTRANSACTIONJOURNAL_H
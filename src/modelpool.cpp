@@ -0,0 +1,139 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "modelpool.h"
+#include "debug.h"
+
+#include <CommHistory/ConversationModel>
+#include <CommHistory/ClassZeroSMSModel>
+
+#include <QCoreApplication>
+#include <QTimerEvent>
+
+#define MODEL_IDLE_TIMEOUT 60000 // msec
+
+using namespace RTComLogger;
+
+ModelPool* ModelPool::m_pInstance = 0;
+
+ModelPool* ModelPool::instance()
+{
+    if (!m_pInstance)
+        m_pInstance = new ModelPool(QCoreApplication::instance());
+
+    return m_pInstance;
+}
+
+ModelPool::ModelPool(QObject *parent)
+    : QObject(parent),
+      m_classZeroSMSModel(0),
+      m_idleTimeout(MODEL_IDLE_TIMEOUT)
+{
+}
+
+CommHistory::ConversationModel* ModelPool::acquireConversationModel(int groupId)
+{
+    CommHistory::ConversationModel *model = m_conversationModels.value(groupId);
+    if (!model) {
+        model = new CommHistory::ConversationModel(this);
+        // We are interested only in replace type that will be stored into Headers property:
+        model->setPropertyMask(CommHistory::Event::PropertySet()
+                               << CommHistory::Event::Headers);
+        // We are not interested in contact changes, just replace type of a message:
+        model->enableContactChanges(false);
+        m_conversationModels.insert(groupId, model);
+    }
+
+    acquire(model, groupId);
+    return model;
+}
+
+CommHistory::ClassZeroSMSModel* ModelPool::acquireClassZeroSMSModel()
+{
+    if (!m_classZeroSMSModel)
+        m_classZeroSMSModel = new CommHistory::ClassZeroSMSModel(this);
+
+    acquire(m_classZeroSMSModel, -1);
+    return m_classZeroSMSModel;
+}
+
+void ModelPool::acquire(QAbstractItemModel *model, int groupId)
+{
+    Entry &entry = m_entries[model];
+    entry.groupId = groupId;
+    entry.refs++;
+}
+
+void ModelPool::release(QAbstractItemModel *model)
+{
+    QHash<QAbstractItemModel*, Entry>::iterator it = m_entries.find(model);
+    if (it == m_entries.end() || it->refs == 0) {
+        qWarning() << Q_FUNC_INFO << "model is not held";
+        return;
+    }
+
+    if (--it->refs == 0) {
+        it->idle.start();
+        if (!m_timer.isActive())
+            m_timer.start(m_idleTimeout, this);
+    }
+}
+
+void ModelPool::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_timer.timerId())
+        reclaim();
+    else
+        QObject::timerEvent(event);
+}
+
+void ModelPool::reclaim()
+{
+    bool idleLeft = false;
+
+    QHash<QAbstractItemModel*, Entry>::iterator it = m_entries.begin();
+    while (it != m_entries.end()) {
+        QAbstractItemModel *model = it.key();
+        if (it->refs > 0) {
+            ++it;
+            continue;
+        }
+
+        // unread flash messages stay until they are read
+        bool isClassZero = model == m_classZeroSMSModel;
+        if (it->idle.elapsed() < m_idleTimeout || (isClassZero && model->rowCount() > 0)) {
+            idleLeft = true;
+            ++it;
+            continue;
+        }
+
+        DEBUG() << Q_FUNC_INFO << "deleting idle model of group" << it->groupId;
+        if (isClassZero)
+            m_classZeroSMSModel = 0;
+        else
+            m_conversationModels.remove(it->groupId);
+        model->deleteLater();
+        it = m_entries.erase(it);
+    }
+
+    if (!idleLeft)
+        m_timer.stop();
+}
@@ -0,0 +1,93 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef MODELPOOL_H
+#define MODELPOOL_H
+
+#include <QObject>
+#include <QBasicTimer>
+#include <QElapsedTimer>
+#include <QHash>
+
+class QAbstractItemModel;
+
+namespace CommHistory {
+    class ConversationModel;
+    class ClassZeroSMSModel;
+}
+
+namespace RTComLogger {
+
+/*!
+ * \class ModelPool
+ * \brief Daemon-wide pool of the read models used by channel listeners.
+ *
+ * Listeners of the same group share one conversation model, and all class 0
+ * channels share one class 0 model. Each acquire must be paired with a
+ * release(); a model nobody holds is deleted after MODEL_IDLE_TIMEOUT, so
+ * long-lived channels don't keep loaded rows around. The class 0 model is
+ * only deleted when it's empty, since it holds the unread flash messages.
+ *
+ * Conversation models load only the event headers and ignore contact
+ * changes; they are used to look up earlier messages by replace type.
+ */
+class ModelPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ModelPool* instance();
+
+    CommHistory::ConversationModel* acquireConversationModel(int groupId);
+    CommHistory::ClassZeroSMSModel* acquireClassZeroSMSModel();
+    void release(QAbstractItemModel *model);
+
+private:
+    struct Entry {
+        Entry() : groupId(-1), refs(0) {}
+        int groupId;    // -1 for the class 0 model
+        int refs;
+        QElapsedTimer idle;
+    };
+
+    explicit ModelPool(QObject *parent = 0);
+
+    void acquire(QAbstractItemModel *model, int groupId);
+    void timerEvent(QTimerEvent *event);
+    void reclaim();
+
+private:
+    static ModelPool* m_pInstance;
+
+    QHash<QAbstractItemModel*, Entry> m_entries;
+    QHash<int, CommHistory::ConversationModel*> m_conversationModels;
+    CommHistory::ClassZeroSMSModel *m_classZeroSMSModel;
+    QBasicTimer m_timer;
+    int m_idleTimeout;
+
+#ifdef UNIT_TEST
+    friend class Ut_ModelPool;
+#endif
+};
+
+} // namespace RTComLogger
+
+#endif // MODELPOOL_H
@@ -651,14 +651,7 @@ CommHistory::GroupModel* NotificationManager::groupModel()
     if (!m_GroupModel) {
         m_GroupModel = new CommHistory::GroupModel(this);
         m_GroupModel->enableContactChanges(false);
-        connect(m_GroupModel,
-                SIGNAL(rowsAboutToBeRemoved(const QModelIndex&, int, int)),
-                this,
-                SLOT(slotGroupRemoved(const QModelIndex&, int, int)));
-        connect(m_GroupModel,
-                SIGNAL(dataChanged(const QModelIndex&, const QModelIndex&)),
-                this,
-                SLOT(slotGroupDataChanged(const QModelIndex&, const QModelIndex&)));
+        GroupChangeDispatcher::forModel(m_GroupModel)->subscribeAll(this);
         if (!m_GroupModel->getGroups()) {
             qCritical() << "Failed to request group ";
             delete m_GroupModel;
@@ -669,18 +662,13 @@ CommHistory::GroupModel* NotificationManager::groupModel()
     return m_GroupModel;
 }
 
-void NotificationManager::slotGroupRemoved(const QModelIndex &index, int start, int end)
+void NotificationManager::groupRemoved(const Group &group)
 {
     DEBUG() << Q_FUNC_INFO;
-    for (int i = start; i <= end; i++) {
-        QModelIndex row = m_GroupModel->index(i, 0, index);
-        Group group = m_GroupModel->group(row);
-        if (group.isValid()
-            && !group.remoteUids().isEmpty()) {
-            removeConversationNotifications(group.localUid(),
-                                            group.remoteUids().first(),
-                                            group.chatType());
-        }
+    if (!group.remoteUids().isEmpty()) {
+        removeConversationNotifications(group.localUid(),
+                                        group.remoteUids().first(),
+                                        group.chatType());
     }
 }
 void NotificationManager::showVoicemailNotification(int count)
@@ -696,37 +684,32 @@ bool NotificationManager::hasMessageNotification() const
            m_Groups.contains(CommHistory::Event::MMSEvent);
 }
 
-void NotificationManager::slotGroupDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+void NotificationManager::groupChanged(const CommHistory::Group &group)
 {
     DEBUG() << Q_FUNC_INFO;
 
-    QSet<NotificationGroup> updatedGroups;
+    if (group.remoteUids().isEmpty())
+        return;
+
+    QString remoteUid = group.remoteUids().first();
+    QString localUid = group.localUid();
 
     // Update MUC notifications if MUC topic has changed
-    for (int i = topLeft.row(); i <= bottomRight.row(); i++) {
-        QModelIndex row = m_GroupModel->index(i, 0);
-        CommHistory::Group group = m_GroupModel->group(row);
-        if (group.isValid()) {
-            QString remoteUid = group.remoteUids().first();
-            QString localUid = group.localUid();
-
-            foreach (NotificationGroup *g, m_Groups) {
-                foreach (PersonalNotification *pn, g->notifications()) {
-                    // If notification is for MUC and matches to changed group...
-                    if (!pn->chatName().isEmpty() && pn->account() == localUid &&
-                            CommHistory::remoteAddressMatch(localUid, pn->targetId(), remoteUid))
-                    {
-                        QString newChatName;
-                        if (group.chatName().isEmpty() && pn->chatName() != txt_qtn_msg_group_chat)
-                            newChatName = txt_qtn_msg_group_chat;
-                        else if (group.chatName() != pn->chatName())
-                            newChatName = group.chatName();
-
-                        if (!newChatName.isEmpty()) {
-                            DEBUG() << Q_FUNC_INFO << "Changing chat name to" << newChatName;
-                            pn->setChatName(newChatName);
-                        }
-                    }
+    foreach (NotificationGroup *g, m_Groups) {
+        foreach (PersonalNotification *pn, g->notifications()) {
+            // If notification is for MUC and matches to changed group...
+            if (!pn->chatName().isEmpty() && pn->account() == localUid &&
+                    CommHistory::remoteAddressMatch(localUid, pn->targetId(), remoteUid))
+            {
+                QString newChatName;
+                if (group.chatName().isEmpty() && pn->chatName() != txt_qtn_msg_group_chat)
+                    newChatName = txt_qtn_msg_group_chat;
+                else if (group.chatName() != pn->chatName())
+                    newChatName = group.chatName();
+
+                if (!newChatName.isEmpty()) {
+                    DEBUG() << Q_FUNC_INFO << "Changing chat name to" << newChatName;
+                    pn->setChatName(newChatName);
                 }
             }
         }
@@ -42,6 +42,7 @@
 // our includes
 #include "notificationgroup.h"
 #include "personalnotification.h"
+#include "groupchangedispatcher.h"
 
 namespace CommHistory {
     class GroupModel;
@@ -59,7 +60,7 @@ typedef QPair<QString,QString> TpContactUid;
  * \class NotificationManager
  * \brief class responsible for showing notifications on desktop
  */
-class NotificationManager : public QObject
+class NotificationManager : public QObject, public GroupChangeListener
 {
     Q_OBJECT
 
@@ -123,14 +124,16 @@ private Q_SLOTS:
     void slotObservedConversationsChanged(const QVariantList &conversations);
     void slotInboxObservedChanged();
     void slotCallHistoryObservedChanged(bool observed);
-    void slotGroupRemoved(const QModelIndex &index, int start, int end);
-    void slotGroupDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
     void slotNgfEventFinished(quint32 id);
     void slotContactUpdated(quint32 localId, const QString &name, const QList<ContactAddress> &addresses);
     void slotContactRemoved(quint32 localId);
     void slotContactUnknown(const QPair<QString,QString> &address);
 
 private:
+    // GroupChangeListener
+    void groupChanged(const CommHistory::Group &group);
+    void groupRemoved(const CommHistory::Group &group);
+
     NotificationManager( QObject* parent = 0);
     ~NotificationManager();
     bool isCurrentlyObservedByUI(const CommHistory::Event& event,
@@ -0,0 +1,115 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "presencecoalescer.h"
+#include "debug.h"
+
+#include <QTimerEvent>
+
+#define STATUS_MESSAGE_DELAY 3000 //msec
+// changes due this soon after the earliest one are reported with it
+#define STATUS_MESSAGE_WINDOW 1000 //msec
+
+using namespace RTComLogger;
+
+PresenceCoalescer::PresenceCoalescer(QObject *parent)
+    : QObject(parent)
+{
+    m_clock.start();
+}
+
+void PresenceCoalescer::statusMessageChanged(const QString &contactId, const QString &remoteId,
+                                             const QString &previousMessage,
+                                             const QString &statusMessage)
+{
+    QHash<QString, Pending>::iterator it = m_pending.find(contactId);
+    if (it == m_pending.end()) {
+        Pending pending;
+        pending.originalMessage = previousMessage;
+        it = m_pending.insert(contactId, pending);
+    }
+
+    it->change.contactId = contactId;
+    it->change.remoteId = remoteId;
+    it->change.statusMessage = statusMessage;
+    it->due = m_clock.elapsed() + STATUS_MESSAGE_DELAY;
+
+    updateTimer();
+}
+
+void PresenceCoalescer::remove(const QString &contactId)
+{
+    if (m_pending.remove(contactId))
+        updateTimer();
+}
+
+QList<PresenceCoalescer::Change> PresenceCoalescer::takeReady()
+{
+    QList<Change> changes = m_ready;
+    m_ready.clear();
+    return changes;
+}
+
+void PresenceCoalescer::updateTimer()
+{
+    if (m_pending.isEmpty()) {
+        m_timer.stop();
+        return;
+    }
+
+    qint64 next = -1;
+    foreach (const Pending &pending, m_pending) {
+        if (next < 0 || pending.due < next)
+            next = pending.due;
+    }
+
+    m_timer.start(qMax<qint64>(0, next - m_clock.elapsed()), this);
+}
+
+void PresenceCoalescer::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != m_timer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
+
+    qint64 flushBefore = m_clock.elapsed() + STATUS_MESSAGE_WINDOW;
+    QHash<QString, Pending>::iterator it = m_pending.begin();
+    while (it != m_pending.end()) {
+        if (it->due > flushBefore) {
+            ++it;
+            continue;
+        }
+
+        // Flapped back to where it started
+        if (it->change.statusMessage != it->originalMessage)
+            m_ready.append(it->change);
+        else
+            DEBUG() << Q_FUNC_INFO << "status message of" << it.key() << "unchanged";
+        it = m_pending.erase(it);
+    }
+
+    updateTimer();
+
+    if (!m_ready.isEmpty())
+        emit ready();
+}
@@ -0,0 +1,94 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef PRESENCECOALESCER_H
+#define PRESENCECOALESCER_H
+
+#include <QObject>
+#include <QBasicTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+namespace RTComLogger {
+
+/*!
+ * \class PresenceCoalescer
+ * \brief Debounces status message changes of the contacts of a channel.
+ *
+ * A contact's status message is reported once it has stayed the same for
+ * STATUS_MESSAGE_DELAY, and only if it differs from the message before
+ * the first change, so a flapping contact produces at most one change.
+ * When the earliest pending change becomes due, all the changes due within
+ * STATUS_MESSAGE_WINDOW of it are reported with it by one ready(), so that
+ * they are stored in one commit.
+ */
+class PresenceCoalescer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Change {
+        QString contactId;
+        QString remoteId;
+        QString statusMessage;
+    };
+
+    explicit PresenceCoalescer(QObject *parent = 0);
+
+    void statusMessageChanged(const QString &contactId, const QString &remoteId,
+                              const QString &previousMessage, const QString &statusMessage);
+
+    /*!
+     * Drops a pending change, e.g. when the contact leaves the channel.
+     */
+    void remove(const QString &contactId);
+
+    /*!
+     * Returns the changes reported by ready() and forgets them.
+     */
+    QList<Change> takeReady();
+
+Q_SIGNALS:
+    void ready();
+
+private:
+    struct Pending {
+        Change change;
+        QString originalMessage;
+        qint64 due;
+    };
+
+    void timerEvent(QTimerEvent *event);
+    void updateTimer();
+
+private:
+    QHash<QString, Pending> m_pending;
+    QList<Change> m_ready;
+    QBasicTimer m_timer;
+    QElapsedTimer m_clock;
+};
+
+} // namespace RTComLogger
+
+#endif // PRESENCECOALESCER_H
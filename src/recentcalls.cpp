@@ -0,0 +1,368 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "recentcalls.h"
+#include "debug.h"
+
+#include <CommHistory/Event>
+#include <CommHistory/CallModel>
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDBusConnection>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTimer>
+
+#include <string.h>
+
+#define RECENT_CALLS_MAGIC    0x52434c53u // "RCLS"
+#define RECENT_CALLS_VERSION  1
+#define RECENT_CALLS_CAPACITY 32
+#define UID_LENGTH            128
+
+#define COMMHISTORY_INTERFACE "com.nokia.commhistory"
+#define EVENT_DELETED_SIGNAL  "eventDeleted"
+#define GROUPS_DELETED_SIGNAL "groupsDeleted"
+
+namespace RTComLogger {
+
+struct RecentCallsHeader {
+    quint32 magic;
+    quint32 version;
+    quint32 capacity;
+    quint32 recordSize;
+    quint32 sequence;
+    quint32 head;
+};
+
+struct RecentCallRecord {
+    qint32 eventId;
+    quint32 type;       // RecentCalls::CallType, 0 for an empty or removed record
+    qint64 startTime;   // msecs since epoch
+    qint64 endTime;
+    char localUid[UID_LENGTH];
+    char remoteUid[UID_LENGTH];
+};
+
+}
+
+using namespace RTComLogger;
+using namespace CommHistory;
+
+RecentCalls* RecentCalls::m_pInstance = 0;
+
+RecentCalls* RecentCalls::instance()
+{
+    if (!m_pInstance)
+        m_pInstance = new RecentCalls(QCoreApplication::instance());
+
+    return m_pInstance;
+}
+
+RecentCalls::RecentCalls(QObject *parent)
+    : QObject(parent),
+      m_data(0),
+      m_header(0),
+      m_seed(false),
+      m_reloadModel(0),
+      m_reloadPending(false)
+{
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+    m_file.setFileName(cacheDir + QLatin1String("/commhistoryd/recent-calls"));
+    m_lastDialedPath = cacheDir + QLatin1String("/last-dialed");
+
+    QDBusConnection::sessionBus().connect(QString(), QString(),
+                                          COMMHISTORY_INTERFACE, EVENT_DELETED_SIGNAL,
+                                          this, SLOT(slotEventDeleted(int)));
+    // Calls can't be matched to deleted groups; check them against the database
+    QDBusConnection::sessionBus().connect(QString(), QString(),
+                                          COMMHISTORY_INTERFACE, GROUPS_DELETED_SIGNAL,
+                                          this, SLOT(slotGroupsDeleted()));
+
+    if (open()) {
+        m_lastDialed = lastDialed();
+        // A new ring, e.g. after an upgrade, starts with the calls in the database
+        if (m_seed)
+            QTimer::singleShot(0, this, SLOT(reload()));
+    }
+}
+
+RecentCalls::~RecentCalls()
+{
+    if (m_data)
+        m_file.unmap(m_data);
+}
+
+bool RecentCalls::open()
+{
+    if (m_data)
+        return true;
+
+    const qint64 size = sizeof(RecentCallsHeader) + RECENT_CALLS_CAPACITY * sizeof(RecentCallRecord);
+
+    QDir().mkpath(QFileInfo(m_file.fileName()).path());
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "Cannot open recent calls cache:" << m_file.errorString();
+        return false;
+    }
+
+    bool initialize = m_file.size() != size;
+    if (initialize && !m_file.resize(size)) {
+        qWarning() << "Cannot resize recent calls cache:" << m_file.errorString();
+        m_file.close();
+        return false;
+    }
+
+    m_data = m_file.map(0, size);
+    m_file.close();
+    if (!m_data) {
+        qWarning() << "Cannot map recent calls cache:" << m_file.errorString();
+        return false;
+    }
+
+    m_header = reinterpret_cast<RecentCallsHeader*>(m_data);
+    if (initialize
+        || m_header->magic != RECENT_CALLS_MAGIC
+        || m_header->version != RECENT_CALLS_VERSION
+        || m_header->capacity != RECENT_CALLS_CAPACITY
+        || m_header->recordSize != sizeof(RecentCallRecord)) {
+        memset(m_data, 0, size);
+        m_header->magic = RECENT_CALLS_MAGIC;
+        m_header->version = RECENT_CALLS_VERSION;
+        m_header->capacity = RECENT_CALLS_CAPACITY;
+        m_header->recordSize = sizeof(RecentCallRecord);
+        m_seed = true;
+    }
+
+    return true;
+}
+
+RecentCallRecord* RecentCalls::record(quint32 index) const
+{
+    return reinterpret_cast<RecentCallRecord*>(m_data + sizeof(RecentCallsHeader))
+            + (index % RECENT_CALLS_CAPACITY);
+}
+
+void RecentCalls::beginWrite()
+{
+    __sync_add_and_fetch(&m_header->sequence, 1);
+}
+
+void RecentCalls::endWrite()
+{
+    __sync_add_and_fetch(&m_header->sequence, 1);
+}
+
+void RecentCalls::add(const Event &event)
+{
+    if (!event.isValid() || event.type() != Event::CallEvent || !open())
+        return;
+
+    beginWrite();
+    bool dialed = writeRecord(event);
+    endWrite();
+
+    // the reload may have read the database before this call was saved
+    if (m_reloadModel)
+        m_reloadPending = true;
+
+    if (dialed)
+        updateLastDialed();
+}
+
+// Writes the call as the newest record; returns true if it was dialed
+bool RecentCalls::writeRecord(const Event &event)
+{
+    CallType type = ReceivedCall;
+    if (event.direction() == Event::Outbound)
+        type = DialedCall;
+    else if (event.isMissedCall())
+        type = MissedCall;
+
+    QByteArray localUid = event.localUid().toUtf8().left(UID_LENGTH - 1);
+    QByteArray remoteUid = event.remoteUid().toUtf8().left(UID_LENGTH - 1);
+
+    RecentCallRecord *r = record(m_header->head);
+    memset(r, 0, sizeof(RecentCallRecord));
+    r->eventId = event.id();
+    r->type = type;
+    r->startTime = event.startTime().toMSecsSinceEpoch();
+    r->endTime = event.endTime().toMSecsSinceEpoch();
+    memcpy(r->localUid, localUid.constData(), localUid.size());
+    memcpy(r->remoteUid, remoteUid.constData(), remoteUid.size());
+    m_header->head++;
+
+    return type == DialedCall;
+}
+
+void RecentCalls::slotGroupsDeleted()
+{
+    // Nothing recorded can have been deleted, e.g. only messages were
+    if (!m_data || !hasRecords())
+        return;
+
+    reload();
+}
+
+// Rebuilds the ring from the newest calls in the database, after deletions
+// that can't be matched to records (e.g. groups or all calls deleted).
+// The query runs asynchronously; a reload requested meanwhile follows it.
+void RecentCalls::reload()
+{
+    if (!open())
+        return;
+
+    m_seed = false;
+
+    if (m_reloadModel) {
+        m_reloadPending = true;
+        return;
+    }
+
+    m_reloadModel = new CallModel(this);
+    m_reloadModel->setTreeMode(false);
+    m_reloadModel->setSorting(CallModel::SortByTime);
+    m_reloadModel->setLimit(RECENT_CALLS_CAPACITY);
+    connect(m_reloadModel, SIGNAL(modelReady(bool)), SLOT(slotReloadReady(bool)));
+    if (!m_reloadModel->getEvents()) {
+        qWarning() << "Cannot query recent calls";
+        m_reloadModel->deleteLater();
+        m_reloadModel = 0;
+    }
+}
+
+void RecentCalls::slotReloadReady(bool success)
+{
+    CallModel *model = m_reloadModel;
+    m_reloadModel = 0;
+    if (!model)
+        return;
+    model->deleteLater();
+
+    if (!success) {
+        qWarning() << "Cannot query recent calls";
+    } else {
+        DEBUG() << Q_FUNC_INFO << "reloading" << model->rowCount() << "recent calls";
+
+        beginWrite();
+        memset(record(0), 0, RECENT_CALLS_CAPACITY * sizeof(RecentCallRecord));
+        m_header->head = 0;
+        // Newest first in the model
+        for (int i = model->rowCount() - 1; i >= 0; i--)
+            writeRecord(model->event(model->index(i, 0)));
+        endWrite();
+
+        updateLastDialed();
+    }
+
+    if (m_reloadPending) {
+        m_reloadPending = false;
+        reload();
+    }
+}
+
+void RecentCalls::slotEventDeleted(int eventId)
+{
+    if (!m_data)
+        return;
+
+    quint32 count = qMin<quint32>(m_header->head, RECENT_CALLS_CAPACITY);
+    for (quint32 i = 0; i < count; i++) {
+        RecentCallRecord *r = record(m_header->head - 1 - i);
+        if (r->type != 0 && r->eventId == eventId) {
+            DEBUG() << Q_FUNC_INFO << "removing deleted call" << eventId;
+            bool dialed = r->type == DialedCall;
+            beginWrite();
+            r->type = 0;
+            endWrite();
+            if (dialed)
+                updateLastDialed();
+            break;
+        }
+    }
+}
+
+bool RecentCalls::hasRecords() const
+{
+    quint32 count = qMin<quint32>(m_header->head, RECENT_CALLS_CAPACITY);
+    for (quint32 i = 0; i < count; i++) {
+        if (record(i)->type != 0)
+            return true;
+    }
+
+    return false;
+}
+
+QString RecentCalls::lastDialed() const
+{
+    quint32 count = qMin<quint32>(m_header->head, RECENT_CALLS_CAPACITY);
+    for (quint32 i = 0; i < count; i++) {
+        RecentCallRecord *r = record(m_header->head - 1 - i);
+        if (r->type == DialedCall)
+            return QString::fromUtf8(r->remoteUid);
+    }
+
+    return QString();
+}
+
+void RecentCalls::updateLastDialed()
+{
+    QString number = lastDialed();
+    if (number.isEmpty() && !m_lastDialed.isEmpty()) {
+        // Older dialed calls may have rotated out of the ring
+        CallModel model;
+        model.setQueryMode(EventModel::SyncQuery);
+        model.setTreeMode(false);
+        model.setSorting(CallModel::SortByTime);
+        model.setFilterType(CallEvent::DialedCallType);
+        model.setLimit(1);
+        if (!model.getEvents()) {
+            qWarning() << "Cannot query last dialed call";
+            return;
+        }
+        if (model.rowCount() > 0)
+            number = model.event(model.index(0, 0)).remoteUid();
+    }
+
+    if (number == m_lastDialed)
+        return;
+
+    m_lastDialed = number;
+    if (number.isEmpty()) {
+        DEBUG() << "Removing last dialed number file";
+        QFile::remove(m_lastDialedPath);
+        return;
+    }
+
+    QSaveFile file(m_lastDialedPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Cannot open last dialed cache file:" << file.errorString();
+        return;
+    }
+
+    DEBUG() << "Writing last dialed number to file:" << number;
+    file.write(number.toLatin1());
+    if (!file.commit())
+        qWarning() << "Writing last dialed cache failed:" << file.errorString();
+}
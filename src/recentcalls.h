@@ -0,0 +1,104 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef RECENTCALLS_H
+#define RECENTCALLS_H
+
+#include <QObject>
+#include <QFile>
+
+namespace CommHistory {
+    class Event;
+    class CallModel;
+}
+
+namespace RTComLogger {
+
+struct RecentCallsHeader;
+struct RecentCallRecord;
+
+/* Fixed-size ring of the most recent dialed, received and missed calls,
+ * in a memory-mapped file under the cache directory ("commhistoryd/recent-calls").
+ *
+ * The file starts with a RecentCallsHeader followed by capacity records.
+ * 'head' is the total number of records written; the newest record is at
+ * index (head - 1) % capacity. 'sequence' is odd while the daemon is
+ * writing, so readers can retry if it changed or was odd while reading.
+ *
+ * The last dialed number is also written to the "last-dialed" cache file,
+ * for bluez, which is otherwise unable to access commhistory data in any
+ * sane way.
+ */
+class RecentCalls : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum CallType {
+        DialedCall = 1,
+        ReceivedCall,
+        MissedCall
+    };
+
+    static RecentCalls* instance();
+
+    /*!
+     * Adds a saved call event to the ring.
+     */
+    void add(const CommHistory::Event &event);
+
+private Q_SLOTS:
+    void slotEventDeleted(int eventId);
+    void slotGroupsDeleted();
+    void reload();
+    void slotReloadReady(bool success);
+
+private:
+    explicit RecentCalls(QObject *parent = 0);
+    ~RecentCalls();
+
+    bool open();
+    RecentCallRecord* record(quint32 index) const;
+    void beginWrite();
+    void endWrite();
+    bool writeRecord(const CommHistory::Event &event);
+
+    bool hasRecords() const;
+    QString lastDialed() const;
+    void updateLastDialed();
+
+private:
+    static RecentCalls* m_pInstance;
+
+    QFile m_file;
+    uchar *m_data;
+    RecentCallsHeader *m_header;
+    QString m_lastDialedPath;
+    QString m_lastDialed;
+    bool m_seed;
+    // asynchronous query of the newest calls while reloading
+    CommHistory::CallModel *m_reloadModel;
+    bool m_reloadPending;
+};
+
+} // namespace RTComLogger
+
+#endif // RECENTCALLS_H
@@ -28,7 +28,6 @@
 #include "qofonosmartmessaging.h"
 
 #include <CommHistory/event.h>
-#include <CommHistory/messagepart.h>
 
 #define SMART_MESSAGING     "org.ofono.SmartMessaging"
 #define AGENT_PATH          "/SmartMessagingAgent"
@@ -37,6 +36,9 @@
 #define VCARD_CONTENT_TYPE  "text/x-vcard"
 #define VCARD_EXTENSION     "vcf"
 
+#define VCALENDAR_CONTENT_TYPE  "text/x-vcalendar"
+#define VCALENDAR_EXTENSION     "vcs"
+
 using namespace CommHistory;
 using namespace RTComLogger;
 
@@ -109,17 +111,27 @@ void SmartMessaging::onInterfacesChanged(QStringList interfaces)
     registerAgent(modem, modem->interfaces());
 }
 
-void SmartMessaging::ReceiveAppointment(QByteArray, QVariantHash)
+void SmartMessaging::ReceiveAppointment(QByteArray appointment, QVariantHash info)
 {
-    DEBUG() << "ReceiveAppointment";
+    DEBUG() << "ReceiveAppointment" << appointment.length() << "bytes";
+    receive(appointment, info, QStringLiteral("appointment." VCALENDAR_EXTENSION),
+            QStringLiteral(VCALENDAR_CONTENT_TYPE));
 }
 
 void SmartMessaging::ReceiveBusinessCard(QByteArray vcard, QVariantHash info)
+{
+    DEBUG() << "ReceiveBusinessCard" << vcard.length() << "bytes";
+    receive(vcard, info, QStringLiteral("card." VCARD_EXTENSION),
+            QStringLiteral(VCARD_CONTENT_TYPE));
+}
+
+void SmartMessaging::receive(const QByteArray &data, const QVariantHash &info,
+                             const QString &contentId, const QString &contentType)
 {
     QString from = info.value("Sender").toString();
-    DEBUG() << "ReceiveBusinessCard" << vcard.length() << "bytes from" << from;
-    if (vcard.isEmpty()) {
-        qWarning () << "Empty vcard";
+    DEBUG() << "Received" << contentType << "from" << from;
+    if (data.isEmpty()) {
+        qWarning() << "Empty" << contentType << "message";
         return;
     }
 
@@ -130,32 +142,17 @@ void SmartMessaging::ReceiveBusinessCard(QByteArray vcard, QVariantHash info)
     event.setDirection(Event::Inbound);
     event.setLocalUid(RING_ACCOUNT_PATH);
     event.setRemoteUid(from);
-    event.setStatus(Event::DownloadingStatus);
+    event.setStatus(Event::ReceivedStatus);
     if (!setGroupForEvent(event)) {
-        qCritical() << "Failed to handle group for vCard notification event; message dropped:" << event.toString();
-        return;
-    }
-
-    EventModel model;
-    if (!model.addEvent(event)) {
-        qCritical() << "Failed to save vCard notification event; message dropped" << event.toString();
+        qCritical() << "Failed to handle group for" << contentType << "event; message dropped:" << event.toString();
         return;
     }
 
-    MessagePart part;
-    if (!save(event.id(), vcard, part)) {
-        qWarning () << "Failed to store vCard";
-        model.deleteEvent(event.id());
+    if (!addEventWithPart(event, contentId, contentType, data)) {
+        qCritical() << "Failed to save" << contentType << "event; message dropped" << event.toString();
         return;
     }
 
-    event.setStatus(Event::ReceivedStatus);
-    event.setMessageParts(QList<MessagePart>() << part);
-    if (!model.modifyEvent(event)) {
-        qCritical() << "Failed to update vCard event:" << event.toString();
-        model.deleteEvent(event.id());
-    }
-
     NotificationManager::instance()->showNotification(event, from, Group::ChatTypeP2P);
 }
 
@@ -163,28 +160,3 @@ void SmartMessaging::Release()
 {
     DEBUG() << "Release";
 }
-
-bool SmartMessaging::save(int id, QByteArray vcard, MessagePart& part)
-{
-    bool ok = false;
-    if (vcard.size()) {
-        QString contentId("card." VCARD_EXTENSION);
-        QString path = messagePartPath(id, contentId);
-        if (!path.isEmpty()) {
-            QFile file(path);
-            if (file.open(QIODevice::WriteOnly)) {
-                if (file.write(vcard) == vcard.size()) {
-                    DEBUG() << "Stored vCard to" << path;
-                    part.setContentType(VCARD_CONTENT_TYPE);
-                    part.setContentId(contentId);
-                    part.setPath(path);
-                    ok = true;
-                }
-                file.close();
-            }
-        }
-    } else {
-        qWarning () << "Empty vcard";
-    }
-    return ok;
-}
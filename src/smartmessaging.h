@@ -25,10 +25,6 @@
 #include "messagehandlerbase.h"
 #include "qofonomodem.h"
 
-namespace CommHistory {
-    class MessagePart;
-}
-
 class SmartMessaging: public MessageHandlerBase
 {
     Q_OBJECT
@@ -50,8 +46,8 @@ private:
     void removeModem(QString path);
     void registerAgent(QOfonoModem* modem, QStringList interfaces);
 
-private:
-    static bool save(int id, QByteArray vcard, CommHistory::MessagePart& part);
+    void receive(const QByteArray &data, const QVariantHash &info,
+                 const QString &contentId, const QString &contentType);
 
 private:
     QHash<QString,QOfonoModem*> modems;
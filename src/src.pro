@@ -31,7 +31,7 @@ TARGET = commhistoryd
 # -----------------------------------------------------------------------------
 # dependencies
 # -----------------------------------------------------------------------------
-QT += dbus contacts versit
+QT += dbus sql concurrent contacts versit
 
 CONFIG(debug, debug|release) {
   DEFINES += DEBUG_COMMHISTORY
@@ -54,9 +54,12 @@ packagesExist(qt5-boostable) {
 # input
 # -----------------------------------------------------------------------------
 HEADERS += logger.h \
+           startupsequence.h \
            channellistener.h \
            textchannellistener.h \
            streamchannellistener.h \
+           callcheckpointscheduler.h \
+           calljournal.h \
            loggerclientobserver.h \
            notificationmanager.h \
            serialisable.h \
@@ -66,25 +69,41 @@ HEADERS += logger.h \
            commhistoryservice.h \
            locstrings.h \
            messagereviver.h \
+           commitretryqueue.h \
+           expungeaggregator.h \
+           messagetokencheck.h \
+           commhistorydatabase.h \
            connectionutils.h \
            contactauthorizationlistener.h \
            contactauthorizer.h \
            constants.h \
            accountoperationsobserver.h \
+           accountpurge.h \
            accountpresenceifadaptor.h \
            accountpresenceservice.h \
-           lastdialedcache.h \
+           recentcalls.h \
            debug.h \
            mmshandler.h \
            mmspart.h \
+           mmstransactionjournal.h \
+           mmsretryscheduler.h \
            messagehandlerbase.h \
-           smartmessaging.h
+           smartmessaging.h \
+           conversationindex.h \
+           groupchangedispatcher.h \
+           contactcache.h \
+           presencecoalescer.h \
+           messagedata.h \
+           modelpool.h
 
 SOURCES += main.cpp \
+           startupsequence.cpp \
            logger.cpp \
            channellistener.cpp \
            textchannellistener.cpp \
            streamchannellistener.cpp \
+           callcheckpointscheduler.cpp \
+           calljournal.cpp \
            loggerclientobserver.cpp \
            notificationmanager.cpp \
            serialisable.cpp \
@@ -93,16 +112,29 @@ SOURCES += main.cpp \
            commhistoryifadaptor.cpp \
            commhistoryservice.cpp \
            messagereviver.cpp \
+           commitretryqueue.cpp \
+           expungeaggregator.cpp \
+           messagetokencheck.cpp \
+           commhistorydatabase.cpp \
            connectionutils.cpp \
            contactauthorizationlistener.cpp \
            contactauthorizer.cpp \
            accountoperationsobserver.cpp \
+           accountpurge.cpp \
            accountpresenceifadaptor.cpp \
            accountpresenceservice.cpp \
-           lastdialedcache.cpp \
+           recentcalls.cpp \
            mmshandler.cpp \
+           mmstransactionjournal.cpp \
+           mmsretryscheduler.cpp \
            messagehandlerbase.cpp \
-           smartmessaging.cpp
+           smartmessaging.cpp \
+           conversationindex.cpp \
+           groupchangedispatcher.cpp \
+           contactcache.cpp \
+           presencecoalescer.cpp \
+           messagedata.cpp \
+           modelpool.cpp
 
 DBUS_ADAPTORS += mmshandler
 mmshandler.files = org.nemomobile.MmsHandler.xml
@@ -0,0 +1,195 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "startupsequence.h"
+#include "logger.h"
+#include "notificationmanager.h"
+#include "commhistoryservice.h"
+#include "commhistoryifadaptor.h"
+#include "accountpresenceservice.h"
+#include "accountpresenceifadaptor.h"
+#include "messagereviver.h"
+#include "connectionutils.h"
+#include "accountoperationsobserver.h"
+#include "conversationindex.h"
+#include "calljournal.h"
+#include "recentcalls.h"
+#include "mmshandler.h"
+#include "mmshandler_adaptor.h"
+#include "smartmessaging_adaptor.h"
+#include "debug.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTimer>
+
+#include <stdio.h>
+
+#define IDLE_STAGE_DELAY 5000 //msec
+
+using namespace RTComLogger;
+
+StartupSequence::StartupSequence(QObject *parent)
+    : QObject(parent),
+      m_utils(0),
+      m_utilsCreated(0),
+      m_reviver(0),
+      m_firstConnection(true),
+      m_idleStarted(false)
+{
+    m_clock.start();
+}
+
+void StartupSequence::mark(const QString &name)
+{
+    m_marks.append(qMakePair(name, m_clock.elapsed()));
+    DEBUG() << "Startup:" << name << "after" << m_marks.last().second << "ms";
+}
+
+bool StartupSequence::registerServices()
+{
+    CommHistoryService *chService = CommHistoryService::instance();
+    if (!chService->isRegistered()) {
+        qCritical() << "CommHistoryService registration failed (already running or DBus not found), exiting";
+        return false;
+    }
+    new CommHistoryIfAdaptor(chService);
+    DEBUG() << "CommHistoryService created";
+
+    m_utilsCreated = m_clock.elapsed();
+    m_utils = new ConnectionUtils(QCoreApplication::instance());
+    connect(m_utils, SIGNAL(connectionReady(Tp::ConnectionPtr)),
+            SLOT(onConnectionReady(Tp::ConnectionPtr)));
+
+    // ContactAuthorizationListener needs to be updated with nemo-notifications and new UI handling
+    //new ContactAuthorizationListener(m_utils, chService);
+
+    AccountPresenceService *apService = new AccountPresenceService(m_utils->accountManager(),
+                                                                   QCoreApplication::instance());
+    if (!apService->isRegistered()) {
+        qCritical() << "AccountPresenceService registration failed (already running or DBus not found), exiting";
+        return false;
+    }
+    new AccountPresenceIfAdaptor(apService);
+    DEBUG() << "AccountPresenceService created";
+
+    mark(QLatin1String("services"));
+    return true;
+}
+
+void StartupSequence::start()
+{
+    m_reviver = new MessageReviver(m_utils, QCoreApplication::instance());
+    DEBUG() << "Message reviver created";
+
+    // Lets channels find their conversations before the group model is loaded
+    ConversationIndex::instance()->loadSnapshot();
+
+    new Logger(m_utils->accountManager(),
+               m_reviver,
+               QCoreApplication::instance());
+    DEBUG() << "Logger created";
+
+    // Init account operations observer to monitor account removals and to react to them.
+    // Created with the logger, so accounts removed during startup aren't missed.
+    new AccountOperationsObserver(m_utils->accountManager(), QCoreApplication::instance());
+
+    mark(QLatin1String("logger"));
+
+    QTimer::singleShot(0, this, SLOT(startDeferred()));
+    QTimer::singleShot(IDLE_STAGE_DELAY, this, SLOT(startIdle()));
+}
+
+void StartupSequence::startDeferred()
+{
+    MmsHandler *mmsHandler = new MmsHandler(QCoreApplication::instance());
+    new MmsHandlerAdaptor(mmsHandler);
+
+    new SmartMessagingAgentAdaptor(new SmartMessaging(QCoreApplication::instance()));
+
+    // Loads notification state; a message arriving before this creates it on demand
+    NotificationManager::instance();
+    DEBUG() << "NotificationManager created";
+
+    mark(QLatin1String("handlers"));
+}
+
+void StartupSequence::onConnectionReady(const Tp::ConnectionPtr &connection)
+{
+    if (m_firstConnection) {
+        m_firstConnection = false;
+        mark(QLatin1String("first connection ") + connection->objectPath());
+    }
+
+    // connectionReady is emitted for the ring connection before the others
+    if (!m_idleStarted)
+        QTimer::singleShot(0, this, SLOT(startIdle()));
+}
+
+void StartupSequence::startIdle()
+{
+    if (m_idleStarted)
+        return;
+    m_idleStarted = true;
+
+    // Load the conversation index in the background, so the first incoming
+    // message doesn't have to wait for it.
+    ConversationIndex::instance()->prewarm();
+
+    // Keeps the last dialed number current when calls are deleted
+    RecentCalls::instance();
+
+    // Save calls a previous run didn't finish logging; new calls don't
+    // reuse their journal slots meanwhile
+    CallJournal::instance()->replay();
+
+    mark(QLatin1String("idle"));
+
+    QString text = report();
+    DEBUG() << text;
+    if (QCoreApplication::arguments().contains(QLatin1String("-startup-report")))
+        fprintf(stderr, "%s\n", text.toLocal8Bit().constData());
+}
+
+QString StartupSequence::report() const
+{
+    QStringList lines;
+    lines << QLatin1String("commhistoryd startup:");
+
+    typedef QPair<QString, qint64> Mark;
+    foreach (const Mark &m, m_marks)
+        lines << QString::fromLatin1("  %1 ms  %2").arg(m.second, 6).arg(m.first);
+
+    if (m_utils) {
+        QMap<QString, AccountReadiness> readiness = m_utils->readiness();
+        QMap<QString, AccountReadiness>::const_iterator it = readiness.constBegin();
+        for (; it != readiness.constEnd(); ++it) {
+            // Same origin as the marks; -1 if not ready
+            lines << QString::fromLatin1("  account %1: ready %2 ms, connection %3 ms")
+                     .arg(it.key())
+                     .arg(it->accountReady < 0 ? -1 : it->accountReady + m_utilsCreated)
+                     .arg(it->connectionReady < 0 ? -1 : it->connectionReady + m_utilsCreated);
+        }
+    }
+
+    return lines.join(QLatin1Char('\n'));
+}
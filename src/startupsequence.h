@@ -0,0 +1,98 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef STARTUPSEQUENCE_H
+#define STARTUPSEQUENCE_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QList>
+#include <QPair>
+
+#include <TelepathyQt/Connection>
+
+namespace RTComLogger {
+
+class ConnectionUtils;
+class MessageReviver;
+
+/*!
+ * \class StartupSequence
+ * \brief Starts the daemon's subsystems in stages.
+ *
+ * 1. registerServices(): claims the D-Bus services before anything else.
+ * 2. start(): what is needed to log and notify the first incoming message,
+ *    and account removal handling, before the main loop runs.
+ * 3. On the first main loop turn: MMS and smart messaging handlers and the
+ *    notification manager state.
+ * 4. Once idle (the ring connection is ready or IDLE_STAGE_DELAY has
+ *    passed): the conversation index, the recent calls cache and saving
+ *    the calls left in the call journal.
+ *
+ * The time of each stage and of the first ready connection is recorded.
+ * All times in the report, including the time each account and connection
+ * took to become ready, are msecs since the StartupSequence was created.
+ * The report is written to the debug log, and to stderr when the daemon is
+ * started with -startup-report.
+ */
+class StartupSequence : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit StartupSequence(QObject *parent = 0);
+
+    /*!
+     * Registers the D-Bus services. Returns false if a service could not be
+     * registered, in which case the daemon should exit.
+     */
+    bool registerServices();
+
+    /*!
+     * Starts the message logging stage and queues the later stages.
+     */
+    void start();
+
+    QString report() const;
+
+private Q_SLOTS:
+    void startDeferred();
+    void startIdle();
+    void onConnectionReady(const Tp::ConnectionPtr &connection);
+
+private:
+    void mark(const QString &name);
+
+private:
+    QElapsedTimer m_clock;
+    QList<QPair<QString, qint64> > m_marks;
+    ConnectionUtils *m_utils;
+    // when m_utils was created; its readiness times count from there
+    qint64 m_utilsCreated;
+    MessageReviver *m_reviver;
+    bool m_firstConnection;
+    bool m_idleStarted;
+};
+
+} // namespace RTComLogger
+
+#endif // STARTUPSEQUENCE_H
@@ -22,10 +22,11 @@
 
 #include "streamchannellistener.h"
 #include "notificationmanager.h"
+#include "callcheckpointscheduler.h"
+#include "calljournal.h"
 #include "debug.h"
 
 // libcommhistory
-#include <CommHistory/EventModel>
 #include <CommHistory/Event>
 
 // TpQt4
@@ -35,8 +36,6 @@
 #define INITIAL_SERVICE_POINT_PROPERTY TP_QT_IFACE_CHANNEL_INTERFACE_SERVICE_POINT+QLatin1String(".InitialServicePoint")
 #define STREAM_CHANNEL_INITIAL_VIDEO_PROPERTY TP_QT_IFACE_CHANNEL_TYPE_STREAMED_MEDIA+QLatin1String(".InitialVideo")
 
-#define SAVING_INTERVAL 5*60000 // 5 minute
-
 using namespace RTComLogger;
 
 StreamChannelListener::StreamChannelListener(const Tp::AccountPtr &account,
@@ -47,9 +46,8 @@ StreamChannelListener::StreamChannelListener(const Tp::AccountPtr &account,
       m_CallStarted(false),
       m_CallEnded(false),
       m_callStartTime(0),
-      m_EventAdded(false),
-      m_LoggingTimerId(0),
-      m_eventCommitted(false),
+      m_journalSlot(-1),
+      m_saveTicket(-1),
       m_pProxy(0)
 {
     DEBUG() << __PRETTY_FUNCTION__;
@@ -58,14 +56,11 @@ StreamChannelListener::StreamChannelListener(const Tp::AccountPtr &account,
 
     makeChannelReady(Tp::StreamedMediaChannel::FeatureStreams);
 
-    connect(&(eventModel()), SIGNAL(eventsCommitted(QList<CommHistory::Event>, bool)),
-            this, SLOT(slotEventsCommitted(QList<CommHistory::Event>, bool)));
-
     m_Event.setStartTime(QDateTime::currentDateTime());
     m_Event.setEndTime(m_Event.startTime());
-    m_Event.setType(CommHistory::Event::CallEvent);
-    if (m_Account)
-        m_Event.setLocalUid(m_Account->objectPath());
+    m_Context.eventType = CommHistory::Event::CallEvent;
+    m_Event.setType(m_Context.eventType);
+    m_Event.setLocalUid(m_Context.accountPath);
     m_Event.setRemoteUid(targetId());
 
     m_Direction = CommHistory::Event::Inbound;
@@ -89,13 +84,15 @@ StreamChannelListener::StreamChannelListener(const Tp::AccountPtr &account,
         }
     }
 
-    // postpone adding event for incoming event to speed up call handling
-    if (m_Direction == CommHistory::Event::Outbound && !addEvent())
-        qWarning() << Q_FUNC_INFO << "failed to add event";
+    // Only the journal is written while the call is set up and ongoing;
+    // the event is saved to the database after the call has ended.
+    m_journalSlot = CallJournal::instance()->begin(m_Event);
 }
 
 StreamChannelListener::~StreamChannelListener()
 {
+    // an unfinished call stays in the journal for the next replay
+    CallCheckpointScheduler::instance()->remove(m_journalSlot);
 }
 
 void StreamChannelListener::callStarted()
@@ -107,6 +104,7 @@ void StreamChannelListener::callStarted()
 
     m_CallStarted = true;
     m_CallEnded = false;
+    CallJournal::instance()->answered(m_journalSlot);
     m_Event.setStartTime(QDateTime::currentDateTime());
     m_Event.setEndTime(m_Event.startTime());
 
@@ -120,8 +118,7 @@ void StreamChannelListener::callStarted()
 
     DEBUG() << Q_FUNC_INFO << m_Event.startTime();
 
-    if (addEvent())
-        m_LoggingTimerId = startTimer(SAVING_INTERVAL);
+    CallCheckpointScheduler::instance()->add(m_journalSlot);
 }
 
 void StreamChannelListener::callEnded()
@@ -144,11 +141,8 @@ void StreamChannelListener::callEnded()
     }
 
     m_Event.setEndTime(endTime);
-
-    if (m_LoggingTimerId > 0) {
-        killTimer(m_LoggingTimerId);
-        m_LoggingTimerId = 0;
-    }
+    CallJournal::instance()->ended(m_journalSlot, m_Event);
+    CallCheckpointScheduler::instance()->remove(m_journalSlot);
 }
 
 void StreamChannelListener::channelReady()
@@ -272,10 +266,8 @@ void StreamChannelListener::slotStreamStateChanged(const Tp::StreamedMediaStream
             modified = true;
         }
 
-        if (modified && m_EventAdded) {
-            // already added -> addEvent() will modify
-            addEvent();
-        }
+        if (modified)
+            CallJournal::instance()->update(m_journalSlot, m_Event);
     }
     if (stream->type() == Tp::MediaStreamTypeAudio
         && state == Tp::MediaStreamStateConnected) {
@@ -315,51 +307,38 @@ void StreamChannelListener::invalidated(Tp::DBusProxy *proxy,
             m_Event.setIsMissedCall(true);
     }
 
-    if (addEvent() && m_Event.isMissedCall()) {
-        NotificationManager* nManager = NotificationManager::instance();
-        nManager->showNotification(m_Event);
-    }
-
-    // don't quit and destroy the event model before the final call
-    // event has been saved (and the corresponding eventsUpdated()
-    // signal emitted)
-    if (m_eventCommitted) {
-        ChannelListener::invalidated(proxy,errorName,errorMessage);
-    } else {
-        m_pProxy = proxy;
-        m_errorName = errorName;
-        m_errorMessage = errorMessage;
-    }
-}
-
-void StreamChannelListener::timerEvent(QTimerEvent *event)
-{
-    if (event->timerId() == m_LoggingTimerId && m_EventAdded) {
-        m_Event.setEndTime(QDateTime::currentDateTime());
-        m_eventCommitted = false;
-        eventModel().modifyEvent(m_Event);
-    }
+    CallJournal::instance()->ended(m_journalSlot, m_Event);
+    CallCheckpointScheduler::instance()->remove(m_journalSlot);
+
+    // The journal saves the call from an idle step; don't quit before the
+    // final call event is in the database
+    m_pProxy = proxy;
+    m_errorName = errorName;
+    m_errorMessage = errorMessage;
+    connect(CallJournal::instance(), SIGNAL(callSaved(int, const CommHistory::Event &, bool)),
+            this, SLOT(slotCallSaved(int, const CommHistory::Event &, bool)),
+            Qt::UniqueConnection);
+    m_saveTicket = CallJournal::instance()->finish(m_journalSlot, m_Event);
+    // the slot is released once saved and may be taken by another call
+    m_journalSlot = -1;
 }
 
-bool StreamChannelListener::addEvent()
+void StreamChannelListener::slotCallSaved(int ticket, const CommHistory::Event &event, bool success)
 {
-    DEBUG() << __PRETTY_FUNCTION__;
+    if (ticket != m_saveTicket)
+        return;
 
-    bool result = false;
+    DEBUG() << Q_FUNC_INFO << success;
 
-    if (m_EventAdded) {
-        m_eventCommitted = false;
-        result = eventModel().modifyEvent(m_Event);
-    } else {
-        result = eventModel().addEvent(m_Event);
-        m_EventAdded = result;
-    }
+    disconnect(CallJournal::instance(), 0, this, 0);
+    m_saveTicket = -1;
 
-    if (result == false) {
-        qCritical() << "failed to add event";
+    if (success && event.isMissedCall()) {
+        NotificationManager* nManager = NotificationManager::instance();
+        nManager->showNotification(event);
     }
 
-    return result;
+    ChannelListener::invalidated(m_pProxy, m_errorName, m_errorMessage);
 }
 
 void StreamChannelListener::slotServicePointChanged(const Tp::ServicePoint &servicePoint)
@@ -371,17 +350,3 @@ void StreamChannelListener::slotServicePointChanged(const Tp::ServicePoint &serv
         m_Event.setIsEmergencyCall(true);
     }
 }
-
-void StreamChannelListener::slotEventsCommitted(QList<CommHistory::Event> events, bool successful)
-{
-    Q_UNUSED(events);
-    Q_UNUSED(successful);
-
-    DEBUG() << Q_FUNC_INFO;
-
-    if (m_pProxy) {
-        ChannelListener::invalidated(m_pProxy, m_errorName, m_errorMessage);
-    } else {
-        m_eventCommitted = true;
-    }
-}
@@ -24,7 +24,6 @@
 #define STREAM_CHANNEL_LISTENER_H
 
 #include <QDateTime>
-#include <QTimerEvent>
 #include <TelepathyQt/Types>
 #include <time.h>
 #include "channellistener.h"
@@ -65,25 +64,23 @@ private Q_SLOTS:
     virtual void invalidated(Tp::DBusProxy *proxy,
         const QString &errorName, const QString &errorMessage);
     void slotServicePointChanged(const Tp::ServicePoint &servicePoint);
-    void slotEventsCommitted(QList<CommHistory::Event> events, bool successful);
+    void slotCallSaved(int ticket, const CommHistory::Event &event, bool success);
 
 private:
     void channelReady();
-    bool addEvent();
     void channelListenerReady();
     void callStarted();
     void callEnded();
-    void timerEvent(QTimerEvent *event);
 
 private:
     bool m_CallStarted;
     bool m_CallEnded;
     time_t m_callStartTime;
     CommHistory::Event m_Event;
-    bool m_EventAdded;
-    int m_LoggingTimerId;
+    int m_journalSlot;
+    // identifies the final event in CallJournal::callSaved()
+    int m_saveTicket;
 
-    bool m_eventCommitted;
     Tp::DBusProxy *m_pProxy;
     QString m_errorName;
     QString m_errorMessage;
@@ -60,6 +60,12 @@
 
 #include "textchannellistener.h"
 #include "notificationmanager.h"
+#include "commitretryqueue.h"
+#include "conversationindex.h"
+#include "expungeaggregator.h"
+#include "messagedata.h"
+#include "messagetokencheck.h"
+#include "modelpool.h"
 #include "locstrings.h"
 #include "constants.h"
 #include "debug.h"
@@ -78,13 +84,6 @@
 #define MODEM_ERROR_DESTINATION_ADDRESS_FDN_RESTRICTED "com.nokia.Modem.SMS.Errors.DestinationAddressFDNRestricted"
 #define MODEM_ERROR_SMS_ADDRESS_FDN_RESTRICTED         "com.nokia.Modem.SMS.Errors.SMSCAddressFDNRestricted"
 
-// voicemail
-#define TXT_VOICE            QLatin1String("voice")
-#define MAILBOX_NOTIFICATION QLatin1String("x-nokia-mailbox-notification")
-#define VOICEMAIL_TYPE       QLatin1String("x-nokia-voicemail-type")
-#define MAILBOX_UNREAD_COUNT QLatin1String("x-nokia-mailbox-unread-count")
-#define MAILBOX_HAS_UNREAD   QLatin1String("x-nokia-mailbox-has-unread")
-
 // content
 #define PART_CONTENT       QLatin1String("content")
 #define PART_CONTENT_TYPE  QLatin1String("content-type")
@@ -93,9 +92,6 @@
 
 #define VCARD_EXTENSION   QLatin1String("vcf")
 
-// message editing support
-#define SUPERSEDES_TOKEN    QLatin1String("supersedes")
-
 #define PROTOCOL_TEL QLatin1String("tel")
 
 // tp properties
@@ -103,8 +99,14 @@
 #define CHANNEL_PROPERTY_SUBJECT QLatin1String("subject")
 #define CHANNEL_PROPERTY_SUBJECT_CONTACT QLatin1String("subject-contact")
 
-#define MAX_SAVE_ATTEMPTS 3
-#define RESAVE_INTERVAL 5000 //ms
+// More joins or leaves than this in one change are logged as a single
+// "N people have joined/left" event; 0 logs every member
+#define MEMBERSHIP_SUMMARY_THRESHOLD 10
+
+// Replayed history is written straight to the database, this many events
+// per transaction
+#define SCROLLBACK_CHUNK_SIZE 100
+
 
 using namespace RTComLogger;
 QTCONTACTS_USE_NAMESPACE
@@ -136,76 +138,6 @@ static CommHistory::Event::PropertySet deliveryHandlingProperties = CommHistory:
                                                  << CommHistory::Event::ReportRead;
 
 
-bool isVoicemail(const Tp::MessagePart &header)
-{
-    if (header.contains(MAILBOX_NOTIFICATION)) {
-        QVariant mailboxVar = header.value(MAILBOX_NOTIFICATION).variant();
-        if (mailboxVar.isValid())
-            return (mailboxVar.value<QString>() == TXT_VOICE);
-    }
-
-    return false;
-}
-
-QString replaceType(const Tp::MessagePart &header)
-{
-    if (header.contains(REPLACE_TYPE)) {
-        QVariant typeVar = header.value(REPLACE_TYPE).variant();
-        if (typeVar.isValid())
-            return typeVar.value<QString>();
-    }
-
-    return QString();
-}
-
-QString voicemailType(const Tp::MessagePart &header)
-{
-    if (header.contains(VOICEMAIL_TYPE)) {
-        // check whether it's skype or sms voicemail, aka
-        // "x-nokia-voicemail-type" is "skype" or "tel"
-        // Both SMS and Skype voicemail notifications (x-nokia-mailbox-notification
-        // with value "voice") MUST have this header
-        QVariant typeVar = header.value(VOICEMAIL_TYPE).variant();
-        if (typeVar.isValid())
-            return typeVar.value<QString>();
-    }
-
-    return QString();
-}
-
-bool mailboxHasUnread(const Tp::MessagePart &header)
-{
-    if (header.contains(MAILBOX_HAS_UNREAD)) {
-        QVariant typeVar = header.value(MAILBOX_HAS_UNREAD).variant();
-        if (typeVar.isValid())
-            return typeVar.value<bool>();
-    }
-
-    return false;
-}
-
-uint mailboxUnreadCount(const Tp::MessagePart &header)
-{
-    if (header.contains(MAILBOX_UNREAD_COUNT)) {
-        QVariant countVar = header.value(MAILBOX_UNREAD_COUNT).variant();
-        if (countVar.isValid())
-            return countVar.value<uint>();
-    }
-
-    return 0;
-}
-
-QString supersedesToken(const Tp::MessagePart &header)
-{
-    if (header.contains(SUPERSEDES_TOKEN)) {
-        QVariant typeVar = header.value(SUPERSEDES_TOKEN).variant();
-        if (typeVar.isValid())
-            return typeVar.value<QString>();
-    }
-
-    return QString();
-}
-
 uint pendingId(const Tp::ReceivedMessage &message)
 {
     return message.header().value("pending-message-id").variant().toUInt();
@@ -223,15 +155,25 @@ TextChannelListener::TextChannelListener(const Tp::AccountPtr &account,
       m_GroupModel(0),
       m_GroupRequested(false),
       m_ShowOfflineChatError(true),
-      m_isClassZeroSMS(false),
       m_pClassZeroSMSModel(0),
+      m_OnlineContacts(0),
+      m_StatusMessages(0),
       m_PropertiesIf(0),
       m_IsGroupChat(false),
       m_channelClosed(false),
-      m_FailedSaveCount(0),
-      m_pConversationModel(0)
+      m_pConversationModel(0),
+      m_ConversationGroupId(-1),
+      m_ConvEventCommitting(false),
+      m_ConvEventId(-1)
 {
     DEBUG() << __PRETTY_FUNCTION__;
+    if (m_Account && m_Account->protocolName() == PROTOCOL_TEL) {
+        m_Context.eventType = m_Context.isClassZero ? CommHistory::Event::ClassZeroSMSEvent
+                                                    : CommHistory::Event::SMSEvent;
+    } else {
+        m_Context.eventType = CommHistory::Event::IMEvent;
+    }
+
     makeChannelReady(Tp::TextChannel::FeatureMessageQueue
                      | Tp::TextChannel::FeatureMessageSentSignal);
 }
@@ -263,12 +205,8 @@ void TextChannelListener::channelListenerReady()
                  Qt::UniqueConnection );
 
         // check if channel is meant to be used for class 0 sms messages
-        QVariantMap properties = textChannel->immutableProperties();
-
-        QVariant property = properties.value(TP_QT_IFACE_CHANNEL_INTERFACE_SMS + QLatin1String(".Flash"), QVariant());
-        if(property.isValid() && property.value<bool>() == true) {
+        if (m_Context.isClassZero) {
             DEBUG() << __FUNCTION__ << "Channel contains class 0 property";
-            m_isClassZeroSMS = true;
             connect(classZeroSMSModel(),
                     SIGNAL(rowsAboutToBeRemoved(const QModelIndex&, int, int)),
                     SLOT(slotClassZeroSMSRemoved(const QModelIndex&, int, int)),
@@ -301,15 +239,19 @@ void TextChannelListener::requestConversationId()
         if (m_GroupModel) {
             m_GroupRequested = true;
 
-            connect(m_GroupModel, SIGNAL(rowsAboutToBeRemoved(const QModelIndex&,int,int)),
-                    SLOT(slotGroupRemoved(const QModelIndex&,int,int)));
-            connect(m_GroupModel, SIGNAL(dataChanged(const QModelIndex&,const QModelIndex&)),
-                    SLOT(slotGroupDataChanged(const QModelIndex&,const QModelIndex&)));
-            connect(m_GroupModel, SIGNAL(rowsInserted(const QModelIndex &, int, int)),
-                    this, SLOT(slotGroupInserted(const QModelIndex &, int, int)));
+            // m_Group is always the group of the channel target
+            m_GroupChanges = GroupChangeDispatcher::forModel(m_GroupModel);
+            if (m_Account)
+                m_GroupChanges->subscribe(this, m_Context.accountPath, targetId());
 
             if (m_GroupModel->isReady()) {
                 slotOnModelReady(true);
+            } else if (!m_IsGroupChat && m_Account
+                       && ConversationIndex::instance()->isWarm()) {
+                // The index can resolve the group without waiting for the model
+                m_Group = ConversationIndex::instance()->findGroup(m_Context.accountPath, targetId());
+                DEBUG() << Q_FUNC_INFO << "group from conversation index:" << m_Group.id();
+                channelListenerReady();
             } else {
                 connect(m_GroupModel, SIGNAL(modelReady(bool)), SLOT(slotOnModelReady(bool)));
             }
@@ -321,121 +263,75 @@ void TextChannelListener::requestConversationId()
 
 TextChannelListener::~TextChannelListener()
 {
+    if (m_GroupChanges)
+        m_GroupChanges->unsubscribe(this);
+    if (m_Contacts)
+        m_Contacts->unsubscribe(this);
+
+    // channel specific handles are not used by other channels
+    if (m_Contacts && m_IsGroupChat && !m_Channel.isNull())
+        m_Contacts->removeHandleOwners(m_Channel->groupHandleOwners().keys());
+
+    releaseConversationModel();
+    if (m_pClassZeroSMSModel) {
+        disconnect(m_pClassZeroSMSModel, 0, this, 0);
+        ModelPool::instance()->release(m_pClassZeroSMSModel);
+    }
 }
 
-void TextChannelListener::slotGroupDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+void TextChannelListener::groupChanged(const CommHistory::Group &group)
 {
     if (!m_Group.isValid())
         return;
 
-    if (!topLeft.isValid() || !bottomRight.isValid()) {
-        qWarning() << Q_FUNC_INFO << "Invalid indexes";
-        return;
-    }
-
-    bool pendingGroupsHandled = false;
-
-    for (int i = topLeft.row(); i <= bottomRight.row(); i++) {
-        QModelIndex row = m_GroupModel->index(i, 0);
-        CommHistory::Group group = m_GroupModel->group(row);
-        if (group.isValid()) {
-            if (m_pendingGroups.contains(group.id())) {
-                pendingGroupsHandled = true;
-                m_pendingGroups.removeAll(group.id());
-            }
-
-            if (m_Group.id() == group.id())
-                m_Group = group;
-        }
+    if (m_pendingGroups.contains(group.id())) {
+        m_pendingGroups.removeAll(group.id());
+        handleMessages();
     }
 
-    if (pendingGroupsHandled)
-        handleMessages();
+    if (m_Group.id() == group.id())
+        m_Group = group;
 
     tryToClose();
 }
 
-void TextChannelListener::slotGroupInserted(const QModelIndex &index, int start, int end)
+void TextChannelListener::groupInserted(const CommHistory::Group &group)
 {
-    DEBUG() << Q_FUNC_INFO << "Account path handled by this listener: " << m_Account->objectPath();
-    DEBUG() << Q_FUNC_INFO << "Target handled by this listener: " << targetId();
-
-    for (int i = start; i <= end; i++) {
-        QModelIndex row = m_GroupModel->index(i, 0, index);
-        CommHistory::Group group = m_GroupModel->group(row);
-
-        DEBUG() << Q_FUNC_INFO << "Inserted group's account: " << group.localUid();
-        DEBUG() << Q_FUNC_INFO << "Inserted group's target: " << group.remoteUids().first();
-
-        if (group.isValid()
-            && group.localUid() == m_Account->objectPath()
-            && CommHistory::remoteAddressMatch(group.localUid(),
-                                               group.remoteUids().first(),
-                                               targetId())) {
-            DEBUG() << Q_FUNC_INFO << "found listener for group" << group.id();
-            m_Group = group;
-            break;
-        }
-    }
+    DEBUG() << Q_FUNC_INFO << "found listener for group" << group.id();
+    m_Group = group;
 }
 
-void TextChannelListener::slotGroupRemoved(const QModelIndex &index, int start, int end)
+void TextChannelListener::groupRemoved(const CommHistory::Group &group)
 {
-    DEBUG() << Q_FUNC_INFO << "Account path handled by this listener: " << m_Account->objectPath();
-    DEBUG() << Q_FUNC_INFO << "Target handled by this listener: " << targetId();
-
-    if (!m_Group.isValid())
-    {
-        DEBUG() << Q_FUNC_INFO << "Group is not valid!";
-        return;
-    }
-
-    for (int i = start; i <= end; i++) {
-        QModelIndex row = m_GroupModel->index(i, 0, index);
-        CommHistory::Group group = m_GroupModel->group(row);
-        if (group == m_Group) {
-            DEBUG() << Q_FUNC_INFO << "Removed group belongs to this listener!";
-            m_Group.setId(-1); // Invalidate the current group in this listener.
-            break;
-        }
+    if (group == m_Group) {
+        DEBUG() << Q_FUNC_INFO << "Removed group belongs to this listener!";
+        m_Group.setId(-1); // Invalidate the current group in this listener.
     }
 }
 
 int TextChannelListener::groupIdForRecipient(const QString &remoteUid)
 {
-    int groupId = -1;
-    // if group exist, read group id right away
-    if (m_GroupModel->isReady()
-        && m_GroupModel->rowCount() > 0
-        && m_Account) {
-        for (int row = 0; row < m_GroupModel->rowCount(); row++) {
-            QModelIndex index = m_GroupModel->index(row, 0);
-            CommHistory::Group group = m_GroupModel->group(index);
-            if (group.isValid()
-                && group.localUid() == m_Account->objectPath()
-                && CommHistory::remoteAddressMatch(group.localUid(), group.remoteUids().first(), remoteUid)) {
-                groupId = group.id();
-                DEBUG() << Q_FUNC_INFO << "found existing group:" << groupId;
-                break;
-            }
-        }
+    if (!m_Account)
+        return -1;
 
-        if (groupId == -1) {
-            // add a new group
-            CommHistory::Group group;
-            group.setLocalUid(m_Account->objectPath());
+    // if group exist, read group id right away
+    ConversationIndex *index = ConversationIndex::instance();
+    CommHistory::Group group = index->findGroup(m_Context.accountPath, remoteUid);
+    if (group.isValid()) {
+        DEBUG() << Q_FUNC_INFO << "found existing group:" << group.id();
+        return group.id();
+    }
 
-            group.setRemoteUids(QStringList() << remoteUid);
-            if (!m_GroupModel->addGroup(group)) {
-                qCritical() << Q_FUNC_INFO << "error adding group";
-            }
-            else {
-                groupId = group.id();
-                DEBUG() << Q_FUNC_INFO << "added new group:" << groupId;
-            }
-        }
+    // add a new group
+    group.setLocalUid(m_Context.accountPath);
+    group.setRemoteUids(QStringList() << remoteUid);
+    if (!index->addGroup(group)) {
+        qCritical() << Q_FUNC_INFO << "error adding group";
+        return -1;
     }
-    return groupId;
+
+    DEBUG() << Q_FUNC_INFO << "added new group:" << group.id();
+    return group.id();
 }
 
 int TextChannelListener::groupId()
@@ -444,11 +340,23 @@ int TextChannelListener::groupId()
     if (!m_Group.isValid()) {
         DEBUG() << Q_FUNC_INFO << "Group is not valid!";
 
-        if (m_GroupModel->isReady()
+        if (!m_IsGroupChat && m_Account) {
+            // group may have been added after the group model was loaded
+            m_Group = ConversationIndex::instance()->findGroup(m_Context.accountPath, targetId());
+            if (m_Group.isValid()) {
+                DEBUG() << Q_FUNC_INFO << "found existing group:" << m_Group.id();
+                return m_Group.id();
+            }
+        }
+
+        // One-to-one groups were looked up above, so they can be added
+        // before the model is loaded once the index is warm
+        bool indexed = !m_IsGroupChat && ConversationIndex::instance()->isWarm();
+        if ((m_GroupModel->isReady() || indexed)
             && m_Account) { // m_Account not need to be ready
 
             CommHistory::Group group;
-            group.setLocalUid(m_Account->objectPath());
+            group.setLocalUid(m_Context.accountPath);
 
             QStringList remoteUids;
             DEBUG() << Q_FUNC_INFO << targetId();
@@ -456,19 +364,16 @@ int TextChannelListener::groupId()
             group.setRemoteUids(remoteUids);
 
             if (m_IsGroupChat) {
-                CommHistory::Group::ChatType chatType = CommHistory::Group::ChatTypeP2P;
-                if (m_GroupHandleType == Tp::HandleTypeNone) {
-                    chatType = CommHistory::Group::ChatTypeUnnamed;
-                } else if (m_GroupHandleType == Tp::HandleTypeRoom) {
-                    chatType = CommHistory::Group::ChatTypeRoom;
-                }
-                group.setChatType(chatType);
+                group.setChatType(m_Context.chatType);
 
                 if (!m_GroupChatName.isEmpty())
                     group.setChatName(m_GroupChatName);
             }
 
-            if (!m_GroupModel->addGroup(group)) {
+            bool added = m_GroupModel->isReady()
+                         ? m_GroupModel->addGroup(group)
+                         : ConversationIndex::instance()->addGroup(group);
+            if (!added) {
 
                 qCritical() << Q_FUNC_INFO << "error adding group";
             }
@@ -493,6 +398,8 @@ void TextChannelListener::handleTpProperties()
         *(m_Channel->interface<Tp::Client::ChannelInterface>()));
     connect(m_PropertiesIf, SIGNAL(PropertiesChanged(const Tp::PropertyValueList &)),
             this, SLOT(slotPropertiesChanged(const Tp::PropertyValueList &)));
+
+    // Property ids are only unique per object, so every channel lists its own
     QDBusPendingCall propertyCall = m_PropertiesIf->ListProperties();
     QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(propertyCall, this);
     connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher *)),
@@ -552,7 +459,7 @@ void TextChannelListener::slotGetPropertiesFinished(QDBusPendingCallWatcher *wat
 
 void TextChannelListener::slotOnModelReady(bool status)
 {
-    DEBUG() << __PRETTY_FUNCTION__ << m_Account->objectPath() << targetId();
+    DEBUG() << __PRETTY_FUNCTION__ << m_Context.accountPath << targetId();
 
     disconnect(m_GroupModel, SIGNAL(modelReady(bool)),
                this, SLOT(slotOnModelReady(bool)));
@@ -570,7 +477,7 @@ void TextChannelListener::slotOnModelReady(bool status)
             QModelIndex index = m_GroupModel->index(row, 0);
             CommHistory::Group group = m_GroupModel->group(index);
             if (group.isValid()
-                && group.localUid() == m_Account->objectPath()
+                && group.localUid() == m_Context.accountPath
                 && CommHistory::remoteAddressMatch(group.localUid(),
                                                    group.remoteUids().first(),
                                                    targetId())) {
@@ -611,6 +518,7 @@ void TextChannelListener::slotPendingMessageRemoved(const Tp::ReceivedMessage &m
 void TextChannelListener::handleMessages()
 {
     QList<CommHistory::Event> scrollbackEvents;
+    QList<Tp::ReceivedMessage> scrollbackMessages;
     QList<CommHistory::Event> addEvents;
     QHash<int, QList<CommHistory::Event> > modifyEvents; // separate list for each group
     QList<Tp::ReceivedMessage> processedMessages;
@@ -629,7 +537,7 @@ void TextChannelListener::handleMessages()
     }
 
     // Add to our local message queue only those messages that are not yet pending:
-    foreach (Tp::ReceivedMessage me, textChannel->messageQueue()) {
+    foreach (const Tp::ReceivedMessage &me, textChannel->messageQueue()) {
         uint id = pendingId(me);
         if (!m_pendingMessageIds.contains(m_Channel->objectPath(), id)) {
             m_messageQueue << me;
@@ -639,15 +547,28 @@ void TextChannelListener::handleMessages()
 
     DEBUG() << __PRETTY_FUNCTION__ << "Number of messages in local message queue: " << m_messageQueue.size();
 
-    foreach(Tp::ReceivedMessage message, m_messageQueue) {
+    foreach (const Tp::ReceivedMessage &message, m_messageQueue) {
         CommHistory::Event event;
-        Tp::ChannelTextMessageType type = message.messageType();
+        MessageData data(message);
         bool wait = false;
 
         DEBUG() << __PRETTY_FUNCTION__ << "Handling message from channel " << m_Channel->objectPath()
-                 << " with content " << message.text() << " and with pending id " << pendingId(message);
+                 << " with content " << data.text << " and with pending id " << data.pendingId;
+
+        // Rejoining a room can replay hundreds of old lines; they are
+        // imported in bulk and never notified
+        if (data.isScrollback && !m_Context.isClassZero && data.supersedes.isEmpty()
+            && (data.type == Tp::ChannelTextMessageTypeNormal
+                || data.type == Tp::ChannelTextMessageTypeAction)) {
+            handleReceivedMessage(message, data, event);
+            if (data.type == Tp::ChannelTextMessageTypeAction)
+                event.setIsAction(true);
+            scrollbackEvents << event;
+            scrollbackMessages << message;
+            continue;
+        }
 
-        switch (type) {
+        switch (data.type) {
         case Tp::ChannelTextMessageTypeDeliveryReport: {
             DeliveryHandlingStatus status = handleDeliveryReport(message, event);
             switch (status) {
@@ -662,7 +583,7 @@ void TextChannelListener::handleMessages()
                     modifyEvents[groupId] << event;
                     modifyMessages[groupId] << message;
 
-                    QString token = message.messageToken();
+                    QString token = data.token;
                     if (token.isEmpty())
                         token = event.messageToken();
 
@@ -674,7 +595,7 @@ void TextChannelListener::handleMessages()
 
                 break;
             case DeliveryHandlingFailed:
-                expungeMessage(message.messageToken());
+                expungeMessage(data.token);
                 processedMessages << message;
                 break;
             case DeliveryHandlingPending:
@@ -687,12 +608,10 @@ void TextChannelListener::handleMessages()
         }
         case Tp::ChannelTextMessageTypeNormal: {
             // fills event properties
-            handleReceivedMessage(message, event);
-
-            QString replaceTypeValue = replaceType(message.header());
+            handleReceivedMessage(message, data, event);
 
             // class 0 sms
-            if (m_isClassZeroSMS) {
+            if (m_Context.isClassZero) {
                 // just ack message, expunge would be called
                 // as soon as user reads message
                 DEBUG() << __FUNCTION__ << "Adding class 0 sms";
@@ -701,7 +620,7 @@ void TextChannelListener::handleMessages()
                 m_EventTokens.insertMulti(event.id(), event.messageToken());
                 nManager->playClass0SMSAlert();
             // Replace sms
-            } else if (!replaceTypeValue.isEmpty()) {
+            } else if (!data.replaceType.isEmpty()) {
                 DEBUG() << __FUNCTION__ << "Replace type of sms";
                 m_replaceEvents << event;
                 m_replaceMessages << message;
@@ -711,15 +630,14 @@ void TextChannelListener::handleMessages()
                 }
               // Normal sms
             } else {
-                QString supersedes = supersedesToken(message.header());
-                if (!supersedes.isEmpty()) {
+                if (!data.supersedes.isEmpty()) {
                     CommHistory::Event originalEvent;
-                    getEventForToken(supersedes, QString(), m_Group.id(), originalEvent);
+                    getEventForToken(data.supersedes, QString(), m_Group.id(), originalEvent);
                     if (!originalEvent.isValid()) {
                         // handle as a new message
                         // use original's message token to be able to handle updates
                         // for this message
-                        event.setMessageToken(supersedes);
+                        event.setMessageToken(data.supersedes);
                         addEvents << event;
                         addMessages << message;
                         nManager->showNotification(event, targetId(), m_Group.chatType());
@@ -738,11 +656,7 @@ void TextChannelListener::handleMessages()
                     }
                 }
                 else {
-                    if (message.isScrollback()) {
-                        scrollbackEvents << event;
-                    } else {
-                        addEvents << event;
-                    }
+                    addEvents << event;
                     addMessages << message;
 
                     if (event.direction() != CommHistory::Event::Outbound) {
@@ -754,15 +668,14 @@ void TextChannelListener::handleMessages()
         }
         case Tp::ChannelTextMessageTypeNotice: {
             // Telepathy can add a new type for mailbox notification in future
-            Tp::MessagePart header = message.header();
-            if (isVoicemail(header)) {
-                QString type = voicemailType(header);
-
-                if (type == PROTOCOL_TEL) {
+            // Both SMS and Skype voicemail notifications MUST have the
+            // voicemail type header, "tel" or "skype"
+            if (data.isVoicemail) {
+                if (data.voicemailType == PROTOCOL_TEL) {
                     int unread = 0;
 
-                    if (mailboxHasUnread(header)) {
-                        unread = mailboxUnreadCount(message.header());
+                    if (data.mailboxHasUnread) {
+                        unread = data.mailboxUnreadCount;
                         if (unread == 0)
                             unread = -1; // set count to -1 if unread flag is set
                                          // but count is not available
@@ -773,19 +686,15 @@ void TextChannelListener::handleMessages()
                 }
                 // TODO skype voicemail support
             }
-            expungeMessage(message.messageToken());
+            expungeMessage(data.token);
             processedMessages << message;
             break;
         }
         case Tp::ChannelTextMessageTypeAction: {
-            handleReceivedMessage(message, event);
+            handleReceivedMessage(message, data, event);
             event.setIsAction(true);
 
-            if (message.isScrollback()) {
-                scrollbackEvents << event;
-            } else {
-                addEvents << event;
-            }
+            addEvents << event;
             addMessages << message;
 
             if (event.direction() != CommHistory::Event::Outbound) {
@@ -794,7 +703,7 @@ void TextChannelListener::handleMessages()
         break;
         }
         default:
-            DEBUG() << "onMessageReceived: type " << type << " not supported";
+            DEBUG() << "onMessageReceived: type " << data.type << " not supported";
             break;
         }
 
@@ -803,17 +712,16 @@ void TextChannelListener::handleMessages()
     }
 
     if (!scrollbackEvents.isEmpty()) {
-        if (eventModel().addEvents(scrollbackEvents, true)) {
-            processedMessages << addMessages;
-        } else {
-            qWarning() << "Adding events failed";
-        }
+        if (importScrollback(scrollbackEvents))
+            processedMessages << scrollbackMessages;
+        else
+            qWarning() << "Importing scrollback failed";
     }
 
     if (!addEvents.isEmpty()) {
         if (eventModel().addEvents(addEvents)) {
             processedMessages << addMessages;
-            foreach (CommHistory::Event e, addEvents)
+            foreach (const CommHistory::Event &e, addEvents)
                 m_EventTokens.insertMulti(e.id(), e.messageToken());
         } else {
             qWarning() << "Adding events failed";
@@ -838,20 +746,78 @@ void TextChannelListener::handleMessages()
         }
     }
 
-    foreach (Tp::ReceivedMessage message, processedMessages) {
+    foreach (const Tp::ReceivedMessage &message, processedMessages) {
         m_messageQueue.removeOne(message);
     }
 }
 
+bool TextChannelListener::importScrollback(const QList<CommHistory::Event> &events)
+{
+    // Most of a replay is usually stored already
+    QSet<QString> skipTokens;
+    foreach (const CommHistory::Event &event, events) {
+        if (!event.messageToken().isEmpty())
+            skipTokens.insert(event.messageToken());
+    }
+
+    if (!skipTokens.isEmpty()) {
+        MessageTokenCheck check = checkMessageTokens(m_Connection ? m_Connection->objectPath() : QString(),
+                                                     skipTokens);
+        if (!check.ok)
+            return false;
+        skipTokens = check.existing.toSet();
+    }
+
+    // Stored chunks are skipped by token if a later one fails and the
+    // replay is handled again
+    CommHistory::DatabaseIO &db = eventModel().databaseIO();
+    int imported = 0;
+    int i = 0;
+    while (i < events.size()) {
+        if (!db.transaction())
+            return false;
+
+        QList<CommHistory::Event> chunk;
+        for (; i < events.size() && chunk.size() < SCROLLBACK_CHUNK_SIZE; i++) {
+            CommHistory::Event event = events.at(i);
+            if (!event.messageToken().isEmpty()) {
+                if (skipTokens.contains(event.messageToken()))
+                    continue;
+                // replayed twice in the same batch
+                skipTokens.insert(event.messageToken());
+            }
+
+            if (!db.addEvent(event)) {
+                db.rollback();
+                return false;
+            }
+            chunk.append(event);
+        }
+
+        if (!db.commit()) {
+            db.rollback();
+            return false;
+        }
+
+        // One update for the chunk; the events are already in the database
+        if (!chunk.isEmpty())
+            eventModel().addEvents(chunk, true);
+        imported += chunk.size();
+    }
+
+    DEBUG() << Q_FUNC_INFO << "imported" << imported << "of" << events.size() << "scrollback events";
+    return true;
+}
+
 CommHistory::ConversationModel& TextChannelListener::conversationModel()
 {
-    if(!m_pConversationModel){
-        m_pConversationModel = new CommHistory::ConversationModel(this);
-        // We are interested only in replace type that will be stored into Headers property:
-        m_pConversationModel->setPropertyMask(CommHistory::Event::PropertySet()
-                                              << CommHistory::Event::Headers);
-        // We are not interested in contact changes, just replace type of a message:
-        m_pConversationModel->enableContactChanges(false);
+    // pooled models are shared by group
+    if (m_pConversationModel && m_ConversationGroupId != m_Group.id())
+        releaseConversationModel();
+
+    if (!m_pConversationModel) {
+        m_ConversationGroupId = m_Group.id();
+        m_pConversationModel = ModelPool::instance()->acquireConversationModel(m_ConversationGroupId);
         // Model should inform us when it is populated after calling getEvents:
         connect(m_pConversationModel, SIGNAL(modelReady(bool)),
                 this, SLOT(slotConvModelReady(bool)));
@@ -860,6 +826,19 @@ CommHistory::ConversationModel& TextChannelListener::conversationModel()
     return *m_pConversationModel;
 }
 
+void TextChannelListener::releaseConversationModel()
+{
+    if (!m_pConversationModel)
+        return;
+
+    disconnect(m_pConversationModel, 0, this, 0);
+    ModelPool::instance()->release(m_pConversationModel);
+    m_pConversationModel = 0;
+    m_ConvEventCommitting = false;
+    m_ConvEventId = -1;
+    m_ConvEventToken.clear();
+}
+
 void TextChannelListener::slotConvModelReady(bool success)
 {
     DEBUG() << __FUNCTION__;
@@ -874,20 +853,44 @@ void TextChannelListener::slotConvModelReady(bool success)
         if (conversationModel().addEvent(event)) {
             // Add event token to list to indicate that the event is under committing process.
             m_EventTokens.insertMulti(event.id(), event.messageToken());
+            m_ConvEventCommitting = true;
+            m_ConvEventId = event.id();
+            m_ConvEventToken = event.messageToken();
         } else  {
             qWarning() << "Adding replace type of event failed!";
+            disconnect(&conversationModel(), SIGNAL(eventsCommitted(const QList<CommHistory::Event> &, bool)),
+                       this, SLOT(slotConvEventsCommitted(const QList<CommHistory::Event> &, bool)));
         }
 
         m_messageQueue.removeOne(m_replaceMessages.takeFirst());
     }
+
+    // Another listener of the group may have reloaded the shared model
+    // while our last replace event is being committed
+    if (m_replaceEvents.isEmpty() && !m_ConvEventCommitting)
+        releaseConversationModel();
 }
 
-void TextChannelListener::slotConvEventsCommitted(const QList<CommHistory::Event> &events, bool success)
+void TextChannelListener::slotConvEventsCommitted(const QList<CommHistory::Event> &committed, bool success)
 {
     DEBUG() << __FUNCTION__;
 
+    // The pooled model also reports the commits of the other listeners of the group
+    QList<CommHistory::Event> events;
+    foreach (const CommHistory::Event &event, committed) {
+        if ((m_ConvEventId != -1 && event.id() == m_ConvEventId)
+            || (!m_ConvEventToken.isEmpty() && event.messageToken() == m_ConvEventToken))
+            events << event;
+    }
+
+    if (events.isEmpty())
+        return;
+
     disconnect(&conversationModel(), SIGNAL(eventsCommitted(const QList<CommHistory::Event> &, bool)),
             this, SLOT(slotConvEventsCommitted(const QList<CommHistory::Event> &, bool)));
+    m_ConvEventCommitting = false;
+    m_ConvEventId = -1;
+    m_ConvEventToken.clear();
 
     if (success) {
         QList<CommHistory::Event> eventsToBeRemoved;
@@ -937,7 +940,7 @@ bool TextChannelListener::recoverDeliveryEcho(const Tp::Message &message,
                 event.setFreeText(content.trimmed());
                 result = true;
             } else if (contentType == VCARD_CONTENT_TYPE) {
-                checkVCard(parts, event);
+                checkVCard(fetchVCardFromMessage(parts), event);
                 result = true;
             }
         }
@@ -1026,8 +1029,8 @@ TextChannelListener::DeliveryHandlingStatus TextChannelListener::handleDeliveryR
         if (messageFound) {
             event.setMessageToken(deliveryToken);
             event.setType(eventType());
-            event.setLocalUid(m_Account->objectPath());
-            if (!m_isClassZeroSMS) {
+            event.setLocalUid(m_Context.accountPath);
+            if (!m_Context.isClassZero) {
                 event.setGroupId(groupId());
             }
             event.setIsRead(true);
@@ -1122,15 +1125,48 @@ TextChannelListener::DeliveryHandlingStatus TextChannelListener::handleDeliveryR
 
 bool TextChannelListener::areRemotePartiesOffline()
 {
-    bool offline = true;
-    QHashIterator<QString,Presence> presenceIt(m_PresenceStatuses);
-    while (presenceIt.hasNext()) {
-        if (presenceIt.next().value().first != Tp::Presence::offline().status()) {
-            offline = false;
-            break;
-        }
-    }
-    return offline;
+    return m_OnlineContacts == 0;
+}
+
+bool TextChannelListener::isOnline(const QString &status)
+{
+    return status != Tp::Presence::offline().status();
+}
+
+bool TextChannelListener::isContactOnline(const QString &contactId) const
+{
+    // Unknown presence doesn't count either way
+    return m_Contacts && m_Contacts->hasPresence(contactId)
+           && isOnline(m_Contacts->presence(contactId).first);
+}
+
+void TextChannelListener::addPresenceContact(const QString &contactId)
+{
+    if (m_PresenceContacts.contains(contactId))
+        return;
+
+    m_PresenceContacts.insert(contactId);
+    m_Contacts->subscribePresence(this, contactId);
+    if (isContactOnline(contactId))
+        m_OnlineContacts++;
+}
+
+void TextChannelListener::removePresenceContact(const QString &contactId)
+{
+    if (!m_PresenceContacts.remove(contactId))
+        return;
+
+    if (isContactOnline(contactId))
+        m_OnlineContacts--;
+    if (m_Contacts)
+        m_Contacts->unsubscribePresence(this, contactId);
+    if (m_StatusMessages)
+        m_StatusMessages->remove(contactId);
+}
+
+QString TextChannelListener::handleOwnerId(uint handle) const
+{
+    return m_Contacts ? m_Contacts->handleOwnerId(handle) : QString();
 }
 
 void TextChannelListener::handleMessageFailed(const Tp::ReceivedMessage &message,
@@ -1220,23 +1256,12 @@ void TextChannelListener::showErrorNote(const QString &errorMsg, BannerType type
 
 CommHistory::Event::EventType TextChannelListener::eventType() const
 {
-    CommHistory::Event::EventType type = CommHistory::Event::UnknownType;
-    if (m_Account->protocolName() == PROTOCOL_TEL) {
-        if (m_isClassZeroSMS) {
-            type = CommHistory::Event::ClassZeroSMSEvent;
-        } else {
-            type = CommHistory::Event::SMSEvent;
-        }
-    } else {
-        type = CommHistory::Event::IMEvent;
-    }
-    return type;
+    return m_Context.eventType;
 }
 
-void TextChannelListener::checkVCard(const Tp::MessagePartList &parts,
+void TextChannelListener::checkVCard(const QByteArray &vcard,
                                      CommHistory::Event &event)
 {
-    QByteArray vcard = fetchVCardFromMessage(parts);
     if (!vcard.isEmpty()) {
         QString filename;
         if (storeVCard(vcard, filename)) {
@@ -1251,55 +1276,47 @@ void TextChannelListener::checkVCard(const Tp::MessagePartList &parts,
     }
 }
 
-void TextChannelListener::fillEventFromMessage(const Tp::Message &message,
+void TextChannelListener::fillEventFromMessage(const MessageData &data,
                                                CommHistory::Event &event)
 {
     event.setType(eventType());
 
-    checkVCard(message.parts(), event);
-
-    // Check for possible sms-replace-number header in Tp::Message:
-    QString replaceTypeString = replaceType(message.header());
-    if (!replaceTypeString.isEmpty()) {
-        QHash<QString, QString> replaceTypeHeader;
-        replaceTypeHeader.insert(REPLACE_TYPE, replaceTypeString);
-        event.setHeaders(replaceTypeHeader);
-    }
-
-    event.setLocalUid(m_Account->objectPath());
-    event.setFreeText(message.text().trimmed());
+    checkVCard(data.vcard, event);
+    data.fillEvent(event);
+    event.setLocalUid(m_Context.accountPath);
 
     // do not set / create group id for class0 messages
-    if (!m_isClassZeroSMS) {
+    if (!m_Context.isClassZero) {
         event.setGroupId(groupId());
     }
 }
 
 void TextChannelListener::handleReceivedMessage(const Tp::ReceivedMessage &message,
+                                                const MessageData &data,
                                                 CommHistory::Event &event)
 {
     QString remoteId;
-    QString messageText = message.text();
-
-    uint handle = message.sender()->handle().first();
+    Tp::ContactPtr sender = message.sender();
+    uint handle = sender ? sender->handle().first() : 0;
 
     bool fromSelf = false;
     if (m_Connection && m_Connection->isReady() && m_Connection->selfHandle() == handle) {
         fromSelf = true;
         remoteId = targetId();
-    } else if (m_HandleOwnerNames.contains(handle))
-        remoteId = m_HandleOwnerNames.value(handle);
-    else if (message.sender())
-        remoteId = message.sender()->id();
-    else {
-        qWarning() << "Message sender is unknown, use target id";
-        remoteId = targetId();
+    } else {
+        remoteId = handleOwnerId(handle);
+        if (remoteId.isEmpty() && sender) {
+            remoteId = sender->id();
+        } else if (remoteId.isEmpty()) {
+            qWarning() << "Message sender is unknown, use target id";
+            remoteId = targetId();
+        }
     }
 
     DEBUG() << "Handling received message: " << remoteId << (fromSelf ? "<-" : "->")
-             << m_Account->objectPath() << messageText;
+             << m_Context.accountPath << data.text;
 
-    fillEventFromMessage(message, event);
+    fillEventFromMessage(data, event);
     event.setRemoteUid(remoteId);
 
     if (fromSelf) {
@@ -1309,66 +1326,44 @@ void TextChannelListener::handleReceivedMessage(const Tp::ReceivedMessage &messa
         event.setDirection(CommHistory::Event::Inbound);
     }
 
-    QDateTime receivedTime;
-    if (message.received().isValid())
-        receivedTime = message.received();
-    else
-        receivedTime = QDateTime::currentDateTime();
-
-    QDateTime sentTime;
-    if (message.sent().isValid())
-        sentTime = message.sent();
-    else
-        sentTime = receivedTime;
-
-    event.setStartTime(sentTime);
-    event.setEndTime(receivedTime);
-
-    event.setMessageToken(message.messageToken());
-    DEBUG() << "Message token is: " << message.messageToken();
+    DEBUG() << "Message token is: " << data.token;
 }
 
 void TextChannelListener::slotMessageSent(const Tp::Message &message,
                                         Tp::MessageSendingFlags flags,
                                         const QString &messageToken)
 {
-    QString messageText = message.text();
-    QString remoteUid = targetId();
+    MessageData data(message);
+    const QString &remoteUid = targetId();
 
     if (remoteUid.isEmpty())
         qCritical() << "Empty target id";
 
-    int existingEventId = message.header().value("x-commhistory-event-id", QDBusVariant(-1)).variant().toInt();
-    DEBUG() << "Handling sent message: " << m_Account->objectPath() << "->" << remoteUid << messageText;
+    DEBUG() << "Handling sent message: " << m_Context.accountPath << "->" << remoteUid << data.text;
 
     CommHistory::Event event;
-    if (existingEventId >= 0 && getEventById(existingEventId, event)) {
-        DEBUG() << "Sent message has an existing event" << existingEventId;
+    if (data.eventId >= 0 && getEventById(data.eventId, event)) {
+        DEBUG() << "Sent message has an existing event" << data.eventId;
+        // TODO: think about start/endtime...
+        QDateTime sentTime = data.sent ? QDateTime::fromTime_t(data.sent)
+                                       : QDateTime::currentDateTime();
+        event.setStartTime(sentTime);
+        event.setEndTime(sentTime);
     } else {
-        fillEventFromMessage(message, event);
+        fillEventFromMessage(data, event);
         event.setIsRead(true);
         event.setDirection(CommHistory::Event::Outbound);
         event.setRemoteUid(remoteUid);
-        if (message.messageType() == Tp::ChannelTextMessageTypeAction)
+        if (data.type == Tp::ChannelTextMessageTypeAction)
             event.setIsAction(true);
     }
 
-    QDateTime sentTime;
-    if (message.sent().isValid()) {
-        sentTime = message.sent();
-    } else {
-        sentTime = QDateTime::currentDateTime();
-    }
-    // TODO: think about start/endtime...
-    event.setStartTime(sentTime);
-    event.setEndTime(sentTime);
-
     event.setMessageToken(messageToken);
     DEBUG() << "Message token is: " << messageToken;
 
     // according to latest ui spec, sending status
     // should be set only for sms / mms messages
-    if(m_Account->protocolName() == PROTOCOL_TEL) {
+    if (m_Context.eventType != CommHistory::Event::IMEvent) {
         event.setStatus(CommHistory::Event::SendingStatus);
     }
 
@@ -1410,12 +1405,9 @@ void TextChannelListener::saveMessage(CommHistory::Event &event)
 
 void TextChannelListener::expungeMessage(const QString &token)
 {
-    if (checkStoredMessagesIf() && !token.isEmpty()) {
-        if (m_expungeTokens.isEmpty()) {
-            QTimer::singleShot(0, this, SLOT(slotExpungeMessages()));
-        }
-        m_expungeTokens.append(token);
-    }
+    // The aggregator keeps the token until the connection is ready
+    if (!token.isEmpty() && !m_Connection.isNull())
+        ExpungeAggregator::forConnection(m_Connection)->expunge(token);
 }
 
 void TextChannelListener::updateGroupChatName(ChangedChannelProperty changedChannelProperty,
@@ -1456,8 +1448,8 @@ void TextChannelListener::updateGroupChatName(ChangedChannelProperty changedChan
 
                 QString remoteId;
                 // Here we need to figure out who changed the topic
-                if (m_HandleOwnerNames.contains(m_ChannelSubjectContactHandle))
-                    remoteId = m_HandleOwnerNames.value(m_ChannelSubjectContactHandle);
+                if (!handleOwnerId(m_ChannelSubjectContactHandle).isEmpty())
+                    remoteId = handleOwnerId(m_ChannelSubjectContactHandle);
 
                 else
                     foreach (Tp::ContactPtr contact, m_Channel->groupContacts())
@@ -1505,17 +1497,34 @@ void TextChannelListener::updateGroupChatName(ChangedChannelProperty changedChan
 
 void TextChannelListener::sendGroupChatEvent(const QString &message)
 {
-    CommHistory::Event event;
-    event.setType( CommHistory::Event::StatusMessageEvent );
-    event.setDirection( CommHistory::Event::Inbound );
-    event.setGroupId( m_Group.id() );
-    event.setLocalUid( m_Account->objectPath() );
-    event.setFreeText( message );
-    event.setStartTime( QDateTime::currentDateTime() );
-    event.setEndTime( QDateTime::currentDateTime() );
-    event.setIsRead( true );
-
-    if ( !eventModel().addEvent( event, true ) )
+    sendGroupChatEvents(QStringList() << message);
+}
+
+void TextChannelListener::sendGroupChatEvents(const QStringList &messages)
+{
+    if (messages.isEmpty())
+        return;
+
+    QDateTime now = QDateTime::currentDateTime();
+    QList<CommHistory::Event> events;
+    events.reserve(messages.size());
+
+    foreach (const QString &message, messages) {
+        CommHistory::Event event;
+        event.setType( CommHistory::Event::StatusMessageEvent );
+        event.setDirection( CommHistory::Event::Inbound );
+        event.setGroupId( m_Group.id() );
+        event.setLocalUid( m_Context.accountPath );
+        event.setFreeText( message );
+        event.setStartTime( now );
+        event.setEndTime( now );
+        event.setIsRead( true );
+        events << event;
+    }
+
+    // Status events are shown in the models only, as before; the batch
+    // just saves the models from updating once per message
+    if ( !eventModel().addEvents( events, true ) )
     {
         DEBUG() << "*** Adding group chat event message to data model has been failed.";
      }
@@ -1542,15 +1551,11 @@ void TextChannelListener::slotEventsCommitted(QList<CommHistory::Event> events,
         // try to redeliver incoming messages
         if (!events.isEmpty()
             && events.first().direction() == CommHistory::Event::Inbound) {
-            if (m_FailedSaveCount++ < MAX_SAVE_ATTEMPTS) {
-                m_failedSaveEvents << events;
-                QTimer::singleShot(m_FailedSaveCount*RESAVE_INTERVAL,
-                                   this,
-                                   SLOT(slotSaveFailedEvents()));
-            } else {
-               emit savingFailed(m_Connection);
-           }
+            CommitRetryQueue::instance()->add(events, m_Connection);
         }
+    } else {
+        // saving works again, retry soon instead of after the back-off
+        CommitRetryQueue::instance()->databaseAvailable();
     }
 
     // handle delivery reports pending for event commits
@@ -1560,36 +1565,6 @@ void TextChannelListener::slotEventsCommitted(QList<CommHistory::Event> events,
     tryToClose();
 }
 
-void TextChannelListener::slotSaveFailedEvents()
-{
-    DEBUG() << Q_FUNC_INFO;
-    if (eventModel().addEvents(m_failedSaveEvents)) {
-        foreach (CommHistory::Event e, m_failedSaveEvents)
-            m_EventTokens.insertMulti(e.id(), e.messageToken());
-    }
-    m_failedSaveEvents.clear();
-}
-
-void TextChannelListener::slotExpungeMessages()
-{
-    if (m_expungeTokens.isEmpty()
-        || (m_Connection && !m_Connection->isReady()))
-        return;
-
-    CommHistoryTp::Client::ConnectionInterfaceStoredMessagesInterface* storedMessages =
-            m_Connection->interface<CommHistoryTp::Client::ConnectionInterfaceStoredMessagesInterface>();
-
-    if (storedMessages) {
-        DEBUG() << Q_FUNC_INFO << m_expungeTokens;
-        storedMessages->ExpungeMessages(m_expungeTokens);
-        m_expungeTokens.clear();
-    } else {
-        qCritical() << Q_FUNC_INFO << "No stored messages interface present";
-    }
-
-    tryToClose();
-}
-
 QString TextChannelListener::fetchContactLabelFromVCard(const QByteArray &vcard)
 {
     if (vcard.isEmpty())
@@ -1678,62 +1653,78 @@ bool TextChannelListener::storeVCard(const QByteArray &vcard, QString &name)
     return true;
 }
 
-void TextChannelListener::slotPresenceChanged(const Tp::Presence &presence)
+void TextChannelListener::presenceChanged(const QString &contactId, uint handle,
+                                          const QString &previousStatus,
+                                          const QString &previousMessage)
 {
+    if (!m_PresenceContacts.contains(contactId))
+        return;
+
     DEBUG() << Q_FUNC_INFO;
 
-    Tp::Contact *contact = qobject_cast<Tp::Contact *>(sender());
-    if (!contact) {
-        qWarning() << Q_FUNC_INFO << ": invalid contact";
-        return;
-    }
+    ContactCache::Presence presence = m_Contacts->presence(contactId);
 
-    Presence oldPresenceValues = m_PresenceStatuses.value(contact->id());
-    m_PresenceStatuses.insert(contact->id(),Presence(presence.status(), presence.statusMessage()));
+    if (isOnline(previousStatus) != isOnline(presence.first))
+        m_OnlineContacts += isOnline(presence.first) ? 1 : -1;
 
     /* If offline chat error has already been shown and presence status changed
        and we have at least one participant online after this status change
        then offline chat error is allowed to be shown next time: */
-    if (!m_ShowOfflineChatError && (oldPresenceValues.first != presence.status()) && !areRemotePartiesOffline())
+    if (!m_ShowOfflineChatError && (previousStatus != presence.first) && !areRemotePartiesOffline())
         m_ShowOfflineChatError = true;
 
     // Status message did not change, do not send status message event.
-    if (oldPresenceValues.second == presence.statusMessage())
+    if (previousMessage == presence.second)
         return;
 
-    QString remoteId;
-    uint handle = contact->handle().first();
-    if (m_HandleOwnerNames.contains(handle))
-        remoteId = m_HandleOwnerNames.value(handle);
-    else
-        remoteId = contact->id();
+    QString remoteId = handleOwnerId(handle);
+    if (remoteId.isEmpty())
+        remoteId = contactId;
 
-    QString newStatusMessage = m_PresenceStatuses.value(contact->id()).second;
+    if (!m_StatusMessages) {
+        m_StatusMessages = new PresenceCoalescer(this);
+        connect(m_StatusMessages, SIGNAL(ready()), SLOT(slotStatusMessagesReady()));
+    }
+    m_StatusMessages->statusMessageChanged(contactId, remoteId, previousMessage, presence.second);
+}
+
+void TextChannelListener::slotStatusMessagesReady()
+{
+    QList<PresenceCoalescer::Change> changes = m_StatusMessages->takeReady();
+
+    QDateTime now = QDateTime::currentDateTime();
+    QList<CommHistory::Event> events;
+    foreach (const PresenceCoalescer::Change &change, changes) {
+        if (change.statusMessage.isEmpty() || groupId() == -1)
+            continue;
 
-    if (!newStatusMessage.isEmpty() && groupId() != -1) {
-        DEBUG() << Q_FUNC_INFO << "Preparing status message event.";
         CommHistory::Event event;
         event.setType(CommHistory::Event::StatusMessageEvent);
         event.setDirection(CommHistory::Event::Inbound);
-        event.setRemoteUid(remoteId);
+        event.setRemoteUid(change.remoteId);
         event.setGroupId(groupId());
-        event.setLocalUid(m_Account->objectPath());
-        event.setFreeText(newStatusMessage);
-        event.setStartTime(QDateTime::currentDateTime());
-        event.setEndTime(QDateTime::currentDateTime());
+        event.setLocalUid(m_Context.accountPath);
+        event.setFreeText(change.statusMessage);
+        event.setStartTime(now);
+        event.setEndTime(now);
         event.setIsRead(true);
+        events << event;
+    }
+
+    if (events.isEmpty())
+        return;
 
-        if (!eventModel().addEvent(event, true)) {
+    DEBUG() << Q_FUNC_INFO << "Adding" << events.size() << "status message events.";
+    if (!eventModel().addEvents(events, true)) {
 
-            DEBUG() << "*** Adding status message to data model has been failed.";
-        }
+        DEBUG() << "*** Adding status message to data model has been failed.";
     }
 }
 
 CommHistory::ClassZeroSMSModel* TextChannelListener::classZeroSMSModel()
 {
     if (!m_pClassZeroSMSModel) {
-        m_pClassZeroSMSModel = new CommHistory::ClassZeroSMSModel(this);
+        m_pClassZeroSMSModel = ModelPool::instance()->acquireClassZeroSMSModel();
     }
     return m_pClassZeroSMSModel;
 }
@@ -1750,7 +1741,9 @@ void TextChannelListener::slotClassZeroSMSRemoved(const QModelIndex& index,
 
         QModelIndex index = classZeroSMSModel()->index(row, 0);
         CommHistory::Event event = classZeroSMSModel()->event(index);
-        if (event.isValid() && !event.messageToken().isEmpty()) {
+        // the model is shared with the other class 0 channels
+        if (event.isValid() && !event.messageToken().isEmpty()
+            && m_EventTokens.contains(event.id(), event.messageToken())) {
             DEBUG() << "Expunged message: " << event.messageToken();
             expungeMessage(event.messageToken());
             m_EventTokens.remove(event.id(), event.messageToken());
@@ -1763,21 +1756,15 @@ void TextChannelListener::channelReady()
     DEBUG() << Q_FUNC_INFO;
 
     if (m_Channel && m_Connection) {
-        if (m_Channel->targetHandleType() == Tp::HandleTypeRoom) {
+        if (m_Context.chatType == CommHistory::Group::ChatTypeRoom) {
             DEBUG() << Q_FUNC_INFO << "group chat: HandleTypeRoom";
             m_IsGroupChat = true;
-            m_GroupHandleType = Tp::HandleTypeRoom;
-        } else if (m_Channel->targetHandleType() == Tp::HandleTypeNone
-                   && m_Channel->interfaces().contains(
-                       TP_QT_IFACE_CHANNEL_INTERFACE_GROUP)) {
+        } else if (m_Context.chatType == CommHistory::Group::ChatTypeUnnamed) {
             m_IsGroupChat = true;
-            m_GroupHandleType = Tp::HandleTypeNone;
-            m_PersistentId = m_Channel->immutableProperties().value(
-                TELEPATHY_CHANNEL_INTERFACE_PERSISTENT_ID).toString();
             DEBUG() << Q_FUNC_INFO << "group chat: HandleTypeNone, PersistentId ="
-                     << m_PersistentId;
+                     << m_Context.persistentId;
 
-            if (m_PersistentId.isEmpty()) {
+            if (m_Context.persistentId.isEmpty()) {
                 qCritical() << Q_FUNC_INFO << "No persistent id for Tp::HandleTypeNone groupchat";
                 return;
             }
@@ -1800,50 +1787,37 @@ void TextChannelListener::channelReady()
         // request contact for target id to track presence
         Tp::ContactManagerPtr contactManager = m_Connection->contactManager();
         if (contactManager->supportedFeatures().contains(Tp::Contact::FeatureSimplePresence)) {
+            m_Contacts = ContactCache::forConnection(m_Connection);
+
             Tp::UIntList handles;
             handles << m_Channel->targetHandle();
-
-            Tp::Features features;
-            features << Tp::Contact::FeatureSimplePresence;
-            features << Tp::Contact::FeatureAlias;
-
-            Tp::PendingContacts* pendingContacts = contactManager->contactsForHandles(handles,
-                                                                                      features);
-            connect(pendingContacts,
-                    SIGNAL(finished(Tp::PendingOperation*)),
-                    this,
-                    SLOT(slotContactsReady(Tp::PendingOperation*)));
+            m_PendingPresenceHandles << m_Channel->targetHandle();
+            trackPresence(m_Contacts->contactsForHandles(this, handles));
 
             if (m_IsGroupChat) {
                 QList<Tp::ContactPtr> contactList;
 
                 foreach (Tp::ContactPtr contact, m_Channel->groupContacts()) {
-                    if (contact != m_Channel->groupSelfContact())
+                    if (contact != m_Channel->groupSelfContact()) {
                         contactList << contact;
+                        m_PendingPresenceHandles << contact->handle().first();
+                    }
                 }
 
-                if (!contactList.isEmpty()) {
-                    Tp::PendingContacts *pc = contactManager->upgradeContacts(contactList,
-                                                                              features);
-                    connect(pc, SIGNAL(finished(Tp::PendingOperation *)),
-                            this, SLOT(slotContactsReady(Tp::PendingOperation *)));
-                }
+                if (!contactList.isEmpty())
+                    trackPresence(m_Contacts->upgradeContacts(this, contactList));
 
                 if (m_Channel->groupAreHandleOwnersAvailable()) {
-                    Tp::UIntList handleOwnerList;
+                    Tp::HandleOwnerMap handleOwners;
                     foreach (Tp::ContactPtr contact, contactList) {
-                        uint ownerHandle = m_Channel->groupHandleOwners().
-                            value(contact->handle().first());
+                        uint handle = contact->handle().first();
+                        uint ownerHandle = m_Channel->groupHandleOwners().value(handle);
                         if (ownerHandle)
-                            handleOwnerList << ownerHandle;
+                            handleOwners.insert(handle, ownerHandle);
                     }
 
-                    if (!handleOwnerList.isEmpty()) {
-                        Tp::PendingContacts *owners =
-                            contactManager->contactsForHandles(handleOwnerList);
-                        connect(owners, SIGNAL(finished(Tp::PendingOperation *)),
-                                this, SLOT(slotHandleOwnersFetched(Tp::PendingOperation *)));
-                    }
+                    if (!handleOwners.isEmpty())
+                        m_Contacts->addHandleOwners(handleOwners);
                 }
 
                 connect(m_Channel.data(),
@@ -1868,33 +1842,80 @@ void TextChannelListener::channelReady()
     }
 }
 
-void TextChannelListener::slotContactsReady(Tp::PendingOperation* operation)
+void TextChannelListener::contactsReady(const QList<Tp::ContactPtr> &contacts)
+{
+    if (m_PendingPresenceHandles.isEmpty() && m_JoinBatches.isEmpty())
+        return;
+
+    DEBUG() << Q_FUNC_INFO << channel();
+
+    trackPresence(contacts);
+    announceJoined(contacts);
+}
+
+void TextChannelListener::contactsFailed(const QList<uint> &handles)
+{
+    qWarning() << Q_FUNC_INFO << channel() << "no contacts for" << handles.size() << "handles";
+
+    foreach (uint handle, handles) {
+        m_PendingPresenceHandles.remove(handle);
+        for (int i = 0; i < m_JoinBatches.size(); ++i)
+            m_JoinBatches[i].pendingHandles.remove(handle);
+    }
+
+    flushJoined();
+}
+
+void TextChannelListener::contactsDropped()
 {
     DEBUG() << Q_FUNC_INFO << channel();
 
-    if (operation && operation->isError()) {
-        qWarning() << "No presence contacts" << operation->errorMessage();
-        return;
+    // Nothing is subscribed any more; counted contacts would never go offline
+    m_PresenceContacts.clear();
+    m_OnlineContacts = 0;
+}
+
+void TextChannelListener::trackPresence(const QList<Tp::ContactPtr> &contacts)
+{
+    foreach (const Tp::ContactPtr &contact, contacts) {
+        if (m_PendingPresenceHandles.remove(contact->handle().first()))
+            addPresenceContact(contact->id());
     }
+}
 
-    Tp::PendingContacts* pendingContacts = static_cast<Tp::PendingContacts*>(operation);
-    if (pendingContacts) {
-        QList<Tp::ContactPtr> contacts(pendingContacts->contacts());
+void TextChannelListener::announceJoined(const QList<Tp::ContactPtr> &contacts)
+{
+    foreach (const Tp::ContactPtr &contact, contacts) {
+        uint handle = contact->handle().first();
 
-        for ( int i = 0; i < contacts.count(); i++ )
-        {
-            // initialise presence values:
-            if(!contacts.value(i).isNull()) {
-                m_PresenceStatuses.insert(contacts.value(i)->id(),Presence(contacts.value(i)->presence().status(),
-                                          contacts.value(i)->presence().statusMessage()));
-            }
+        // the same member may have been added again by a later change
+        for (int i = 0; i < m_JoinBatches.size(); ++i) {
+            JoinBatch &batch = m_JoinBatches[i];
+            if (!batch.pendingHandles.remove(handle))
+                continue;
 
-            connect(contacts.value(i).data(),
-                    SIGNAL(presenceChanged(const Tp::Presence &)),
-                    SLOT(slotPresenceChanged(const Tp::Presence &)));
+            // Ignore self contact. In that case "You have joined..." message
+            // should be shown instead (by messaging-ui)
+            if (contact != m_Channel->groupSelfContact()) {
+                DEBUG() << contact->alias() << "joined";
+                batch.joined << txt_qtn_msg_group_chat_remote_joined(contact->alias());
+            }
         }
-    } else {
-        qCritical() << Q_FUNC_INFO << "Invalid TpPendingOperation when requesting target contact";
+    }
+
+    flushJoined();
+}
+
+void TextChannelListener::flushJoined()
+{
+    // announce complete changes in the order they happened
+    while (!m_JoinBatches.isEmpty() && m_JoinBatches.first().pendingHandles.isEmpty()) {
+        QStringList joined = m_JoinBatches.takeFirst().joined;
+
+        if (MEMBERSHIP_SUMMARY_THRESHOLD > 0 && joined.size() > MEMBERSHIP_SUMMARY_THRESHOLD)
+            sendGroupChatEvent(txt_qtn_msg_group_chat_remote_joined_count(joined.size()));
+        else
+            sendGroupChatEvents(joined);
     }
 }
 
@@ -1944,6 +1965,11 @@ void TextChannelListener::slotGroupMembersChanged(
 
     if (!groupMembersRemoved.isEmpty()) {
 
+        // kicks and bans are always logged one by one, plain leaves
+        // may be collapsed
+        QStringList removedEvents;
+        QStringList leftEvents;
+
         foreach (Tp::ContactPtr contact, groupMembersRemoved) {
 
             // if there is valid originatior for the change
@@ -1958,13 +1984,13 @@ void TextChannelListener::slotGroupMembersChanged(
                 if (contact == m_Channel->groupSelfContact()) {
 
                     DEBUG() << "YOU've been banned/kicked by" << details.actor()->alias();
-                    sendGroupChatEvent(txt_qtn_msg_group_chat_you_removed(details.actor()->alias()));
+                    removedEvents << txt_qtn_msg_group_chat_you_removed(details.actor()->alias());
                 }
                 else {
 
                     DEBUG() << contact->alias() << "has been banned/kicked by" << details.actor()->alias();
-                    sendGroupChatEvent(txt_qtn_msg_group_chat_person_removed(details.actor()->alias(), contact->alias()));
-                    m_PresenceStatuses.remove(contact->id());
+                    removedEvents << txt_qtn_msg_group_chat_person_removed(details.actor()->alias(), contact->alias());
+                    removePresenceContact(contact->id());
                 }
             }
 
@@ -1972,73 +1998,31 @@ void TextChannelListener::slotGroupMembersChanged(
             else {
 
                 DEBUG() << contact->alias() << "has left the channel";
-                sendGroupChatEvent(txt_qtn_msg_group_chat_remote_left(contact->alias()));
-                m_PresenceStatuses.remove(contact->id());
+                leftEvents << txt_qtn_msg_group_chat_remote_left(contact->alias());
+                removePresenceContact(contact->id());
             }
         }
-    }
-
-    if (!groupMembersAdded.isEmpty()) {
-
-        Tp::Features features;
-        features << Tp::Contact::FeatureSimplePresence;
-        features << Tp::Contact::FeatureAlias;
 
-        Tp::PendingContacts *pc = m_Channel->connection()->contactManager()->upgradeContacts(
-            QList<Tp::ContactPtr>::fromSet(groupMembersAdded), features);
+        if (MEMBERSHIP_SUMMARY_THRESHOLD > 0 && leftEvents.size() > MEMBERSHIP_SUMMARY_THRESHOLD)
+            removedEvents << txt_qtn_msg_group_chat_remote_left_count(leftEvents.size());
+        else
+            removedEvents << leftEvents;
 
-        connect(pc,
-                SIGNAL(finished(Tp::PendingOperation *)),
-                this,
-                SLOT(slotContactsReady(Tp::PendingOperation *)));
-
-        connect(pc,
-                SIGNAL(finished(Tp::PendingOperation *)),
-                this,
-                SLOT(slotJoinedGroupChat(Tp::PendingOperation *)));
+        sendGroupChatEvents(removedEvents);
     }
-}
 
-void TextChannelListener::slotJoinedGroupChat(Tp::PendingOperation *operation)
-{
-    DEBUG() << Q_FUNC_INFO << channel();
-
-    if (operation && operation->isError()) {
-        qWarning() << "No contacts" << operation->errorMessage();
-        return;
-    }
-
-    Tp::PendingContacts* pendingContacts = static_cast<Tp::PendingContacts *>(operation);
-    if (pendingContacts) {
-        QList<Tp::ContactPtr> contacts(pendingContacts->contacts());
-        for (int i = 0; i < contacts.count(); i++) {
-            // Ignore self contact. In that case "You have joined..." message
-            // should be shown instead (by messaging-ui)
-            if (contacts.value(i) != m_Channel->groupSelfContact()) {
-                DEBUG() << contacts.value(i)->alias() << "joined";
-                sendGroupChatEvent(txt_qtn_msg_group_chat_remote_joined(contacts.value(i)->alias()));
-            }
+    if (!groupMembersAdded.isEmpty() && m_Contacts) {
+        JoinBatch batch;
+        foreach (Tp::ContactPtr contact, groupMembersAdded) {
+            m_PendingPresenceHandles << contact->handle().first();
+            batch.pendingHandles << contact->handle().first();
         }
-    }
-}
+        m_JoinBatches << batch;
 
-void TextChannelListener::slotHandleOwnersFetched(Tp::PendingOperation *op)
-{
-    Tp::PendingContacts *pc = qobject_cast<Tp::PendingContacts *>(op);
-
-    if (pc && !pc->isError()) {
-        foreach (Tp::ContactPtr handleOwner, pc->contacts()) {
-            QMapIterator<uint, uint> i(m_Channel->groupHandleOwners());
-            while (i.hasNext()) {
-                i.next();
-                if (i.value() == handleOwner->handle().first()) {
-                    m_HandleOwnerNames.insert(i.key(), handleOwner->id());
-                    DEBUG() << Q_FUNC_INFO << "added handle owner:"
-                             << i.key() << handleOwner->id();
-                    break;
-                }
-            }
-        }
+        QList<Tp::ContactPtr> ready =
+            m_Contacts->upgradeContacts(this, QList<Tp::ContactPtr>::fromSet(groupMembersAdded));
+        trackPresence(ready);
+        announceJoined(ready);
     }
 }
 
@@ -2046,26 +2030,23 @@ void TextChannelListener::slotHandleOwnersChanged(const Tp::HandleOwnerMap &hand
                                                   const Tp::UIntList &added,
                                                   const Tp::UIntList &removed)
 {
+    if (!m_Contacts)
+        return;
+
     if (!added.isEmpty()) {
-        Tp::UIntList addedOwners;
+        Tp::HandleOwnerMap addedOwners;
         foreach (uint handle, added)
-            addedOwners << handleOwnerMap.value(handle);
-        Tp::PendingContacts *owners =
-            m_Channel->connection()->contactManager()->contactsForHandles(addedOwners);
-        connect(owners, SIGNAL(finished(Tp::PendingOperation *)),
-                this, SLOT(slotHandleOwnersFetched(Tp::PendingOperation *)));
+            addedOwners.insert(handle, handleOwnerMap.value(handle));
+        m_Contacts->addHandleOwners(addedOwners);
     }
 
-    foreach (uint handle, removed)
-        m_HandleOwnerNames.remove(handle);
+    m_Contacts->removeHandleOwners(removed);
 }
 
 bool TextChannelListener::hasPendingOperations() const
 {
-    return !(m_expungeTokens.isEmpty()
-             && m_EventTokens.isEmpty()
+    return !(m_EventTokens.isEmpty()
              && m_pendingGroups.isEmpty()
-             && m_failedSaveEvents.isEmpty()
              && m_replaceMessages.isEmpty());
 }
 
@@ -25,10 +25,16 @@
 
 #include <QList>
 #include <QMultiHash>
+#include <QPointer>
+#include <QSet>
+#include <QStringList>
 
 #include <CommHistory/Group>
 
 #include "channellistener.h"
+#include "groupchangedispatcher.h"
+#include "contactcache.h"
+#include "presencecoalescer.h"
 #include "constants.h"
 
 namespace CommHistory {
@@ -53,12 +59,15 @@ namespace Tp {
 namespace RTComLogger
 {
 
+struct MessageData;
+
 /*!
  * \class TextChannelListener
  * \brief class responsible for listening and logging activity on a text channel
  * chats, sms
  */
-class TextChannelListener : public ChannelListener
+class TextChannelListener : public ChannelListener, public GroupChangeListener,
+                            public ContactCacheListener
 {
     Q_OBJECT
 
@@ -71,11 +80,17 @@ public:
 
     virtual ~TextChannelListener();
 
-Q_SIGNALS:
-    /*!
-     * \brief emitted when message saving fails
-     */
-    void savingFailed(const Tp::ConnectionPtr& connection);
+    // GroupChangeListener
+    void groupInserted(const CommHistory::Group &group);
+    void groupChanged(const CommHistory::Group &group);
+    void groupRemoved(const CommHistory::Group &group);
+
+    // ContactCacheListener
+    void contactsReady(const QList<Tp::ContactPtr> &contacts);
+    void contactsFailed(const QList<uint> &handles);
+    void presenceChanged(const QString &contactId, uint handle,
+                         const QString &previousStatus, const QString &previousMessage);
+    void contactsDropped();
 
 private Q_SLOTS:
     void slotMessageReceived(const Tp::ReceivedMessage &message);
@@ -83,31 +98,23 @@ private Q_SLOTS:
                        Tp::MessageSendingFlags flags,
                        const QString &messageToken);
     void slotOnModelReady(bool status);
-    void slotPresenceChanged(const Tp::Presence &presence);
-    void slotGroupRemoved(const QModelIndex &index, int start, int end);
-    void slotGroupInserted(const QModelIndex &index, int start, int end);
-    void slotGroupDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
     void slotEventsCommitted(QList<CommHistory::Event> events, bool status);
     void slotClassZeroSMSRemoved(const QModelIndex&, int, int);
-    void slotContactsReady(Tp::PendingOperation* operation);
+    void slotStatusMessagesReady();
     void slotPropertiesChanged(const Tp::PropertyValueList &props, bool listProps = false);
     void slotGroupMembersChanged(const Tp::Contacts &groupMembersAdded,
                                  const Tp::Contacts &groupLocalPendingMembersAdded,
                                  const Tp::Contacts &groupRemotePendingMembersAdded,
                                  const Tp::Contacts &groupMembersRemoved,
                                  const Tp::Channel::GroupMemberChangeDetails &details);
-    void slotHandleOwnersFetched(Tp::PendingOperation *op);
     void slotHandleOwnersChanged(const Tp::HandleOwnerMap &handleOwnerMap,
                                  const Tp::UIntList &added,
                                  const Tp::UIntList &removed);
-    void slotListPropertiesFinished(QDBusPendingCallWatcher *watcher);
     void slotGetPropertiesFinished(QDBusPendingCallWatcher *watcher);
-    void slotExpungeMessages();
-    void slotSaveFailedEvents();
-    void slotJoinedGroupChat(Tp::PendingOperation *operation);
+    void slotListPropertiesFinished(QDBusPendingCallWatcher *watcher);
     void slotPendingMessageRemoved(const Tp::ReceivedMessage &message);
     void slotConvModelReady(bool success);
-    void slotConvEventsCommitted(const QList<CommHistory::Event> &events, bool success);
+    void slotConvEventsCommitted(const QList<CommHistory::Event> &committed, bool success);
 
 private:
 
@@ -135,11 +142,13 @@ private:
                                                 CommHistory::Event &event);
     // MMS
     // normal message
-    void fillEventFromMessage(const Tp::Message &message, CommHistory::Event &event);
+    void fillEventFromMessage(const MessageData &data, CommHistory::Event &event);
     void handleReceivedMessage(const Tp::ReceivedMessage &message,
+                               const MessageData &data,
                                CommHistory::Event &event);
 
     void handleMessages();
+    bool importScrollback(const QList<CommHistory::Event> &events);
     QString fetchContactLabelFromVCard(const QByteArray &vcard);
     QByteArray fetchVCardFromMessage(const Tp::MessagePartList &parts);
     bool storeVCard (const QByteArray &vcard, QString &name);
@@ -155,13 +164,14 @@ private:
     void handleMessageFailed(const Tp::ReceivedMessage &message,
                              const CommHistory::Event &event);
     void sendGroupChatEvent(const QString &message);
+    void sendGroupChatEvents(const QStringList &messages);
     void showErrorNote(const QString &errorMsg, BannerType type = ErrorBanner);
 
     // attempt to read original message from delivery report
     bool recoverDeliveryEcho(const Tp::Message &message, CommHistory::Event &event);
 
     CommHistory::Event::EventType eventType() const;
-    void checkVCard(const Tp::MessagePartList &parts, CommHistory::Event &event);
+    void checkVCard(const QByteArray &vcard, CommHistory::Event &event);
     bool getEventForToken(const QString &token, const QString &mmsId,
                           int groupId, CommHistory::Event &event);
     bool getEventById(int eventId, CommHistory::Event &event);
@@ -177,46 +187,58 @@ private:
     bool pendingCommit(const QString &messageToken);
 
     bool areRemotePartiesOffline();
+    static bool isOnline(const QString &status);
+    bool isContactOnline(const QString &contactId) const;
+    void addPresenceContact(const QString &contactId);
+    void removePresenceContact(const QString &contactId);
+    QString handleOwnerId(uint handle) const;
+    void trackPresence(const QList<Tp::ContactPtr> &contacts);
+    void announceJoined(const QList<Tp::ContactPtr> &contacts);
+    void flushJoined();
 
     CommHistory::ConversationModel& conversationModel();
+    void releaseConversationModel();
 
 private:
 
-    typedef QPair<QString,QString> Presence;
-
-    // TODO: only for 1-1 chat, should be fixed later
-    Tp::ContactPtr m_TargetContact;
-
     CommHistory::GroupModel *m_GroupModel;
+    QPointer<GroupChangeDispatcher> m_GroupChanges;
     CommHistory::Group m_Group;
     bool m_GroupRequested;
 
-    // tokens for expunging
-    QList<QString> m_expungeTokens;
     // map event id to tokens that should be expunged,
     // Event does not have report delivery token, therefore it's stored here
-    // until events are committed than if OK they are moved to m_expungeTokens
-    // for actual expunging
+    // until events are committed than if OK they are passed to the
+    // connection's ExpungeAggregator for actual expunging
     QMultiHash<int, QString> m_EventTokens;
 
     bool m_ShowOfflineChatError;
 
-    // indicates that channel contains class0 messages
-    bool m_isClassZeroSMS;
     CommHistory::ClassZeroSMSModel *m_pClassZeroSMSModel;
 
-    Tp::HandleIdentifierMap m_HandleOwnerNames;
+    // contacts, presence and handle owners shared with the other channels of the connection
+    QPointer<ContactCache> m_Contacts;
+    // ids of the remote parties whose presence matters to this channel
+    QSet<QString> m_PresenceContacts;
+    // how many of m_PresenceContacts are not offline
+    int m_OnlineContacts;
+    PresenceCoalescer *m_StatusMessages;
+    // handles of remote parties not ready yet in m_Contacts
+    QSet<uint> m_PendingPresenceHandles;
+    // members added by one group change; announced together once all are ready
+    struct JoinBatch {
+        QSet<uint> pendingHandles;
+        QStringList joined;
+    };
+    QList<JoinBatch> m_JoinBatches;
     Tp::Client::PropertiesInterfaceInterface *m_PropertiesIf;
     QHash<QString, Tp::PropertySpec> m_Properties;
-    QHash<QString,Presence> m_PresenceStatuses;
 
     bool m_IsGroupChat;
-    uint m_GroupHandleType;
     QString m_GroupChatName;
     QString m_ChannelName;
     QString m_ChannelSubject;
     uint m_ChannelSubjectContactHandle;
-    QString m_PersistentId;
 
     // internal copy of message queue
     QList<Tp::ReceivedMessage> m_messageQueue;
@@ -228,16 +250,18 @@ private:
     // not be handled unitl the event committed
     QSet<QString> m_commitingEvents;
 
-    //handle failed save messages
-    uint m_FailedSaveCount;
-    QList<CommHistory::Event> m_failedSaveEvents;
-
     // Global storage, among all text channel listeners, of ids of messages not acknowledged yet by mui:
     static QMultiHash<QString,uint> m_pendingMessageIds;
 
     QList<Tp::ReceivedMessage> m_replaceMessages;
     QList<CommHistory::Event> m_replaceEvents;
+    // shared through ModelPool, held only while replace messages are handled
     CommHistory::ConversationModel* m_pConversationModel;
+    int m_ConversationGroupId;
+    bool m_ConvEventCommitting;
+    // the replace event being committed, told apart from commits of other listeners
+    int m_ConvEventId;
+    QString m_ConvEventToken;
 #ifdef UNIT_TEST
     friend class Ut_TextChannelListener;
 #endif
@@ -26,7 +26,16 @@ TEMPLATE = subdirs
 SUBDIRS = ut_notificationmanager \
           ut_textchannellistener \
           ut_streamchannellistener \
-          ut_messagereviver
+          ut_messagereviver \
+          ut_commitretryqueue \
+          ut_presencecoalescer \
+          ut_groupchangedispatcher \
+          ut_modelpool \
+          ut_calljournal \
+          ut_mmstransactionjournal \
+          ut_mmsretryscheduler \
+          ut_conversationindex \
+          ut_accountpurge
 
 # make sure the destination path exists
 !system( mkdir -p $${OUT_PWD}/bin ) : \
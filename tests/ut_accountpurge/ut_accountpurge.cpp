@@ -0,0 +1,285 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+
+// INCLUDES
+#include "ut_accountpurge.h"
+
+// Qt includes
+#include <QDBusConnection>
+#include <QDBusMetaType>
+#include <QDir>
+#include <QSignalSpy>
+#include <QTest>
+#include <QTime>
+
+#include <CommHistory/CallModel>
+#include <CommHistory/EventModel>
+#include <CommHistory/GroupModel>
+
+#include "accountpurge.h"
+#include "commhistorydatabase.h"
+
+// constants
+#define ACCOUNT_PATH QLatin1String("/org/freedesktop/Telepathy/Account/gabble/jabber/purge")
+#define OTHER_ACCOUNT_PATH QLatin1String("/org/freedesktop/Telepathy/Account/gabble/jabber/other")
+#define PURGE_TIMEOUT 5000
+#define DELETED_SIGNAL_BATCH 50
+
+#define COMMHISTORY_INTERFACE "com.nokia.commhistory"
+#define EVENT_DELETED_SIGNAL  "eventDeleted"
+#define GROUPS_DELETED_SIGNAL "groupsDeleted"
+
+using namespace RTComLogger;
+using namespace CommHistory;
+
+namespace {
+    bool waitSignal(QSignalSpy &spy, int msec)
+    {
+        QTime timer;
+        timer.start();
+        while (timer.elapsed() < msec && spy.isEmpty())
+            QCoreApplication::processEvents();
+
+        return !spy.isEmpty();
+    }
+}
+
+Ut_AccountPurge::Ut_AccountPurge()
+{
+}
+
+Ut_AccountPurge::~Ut_AccountPurge()
+{
+}
+
+void Ut_AccountPurge::eventDeleted(int id)
+{
+    m_deletedEvents.append(id);
+}
+
+void Ut_AccountPurge::groupsDeleted(const QList<int> &ids)
+{
+    m_deletedGroups.append(ids);
+}
+
+/*!
+ * This function will be called before the first testfunction is executed.
+ */
+void Ut_AccountPurge::initTestCase()
+{
+    qDBusRegisterMetaType<QList<int> >();
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    QVERIFY(bus.connect(QString(), QString(), COMMHISTORY_INTERFACE, EVENT_DELETED_SIGNAL,
+                        this, SLOT(eventDeleted(int))));
+    QVERIFY(bus.connect(QString(), QString(), COMMHISTORY_INTERFACE, GROUPS_DELETED_SIGNAL,
+                        this, SLOT(groupsDeleted(QList<int>))));
+}
+
+/*!
+ * This function will be called before each testfunction is executed.
+ */
+void Ut_AccountPurge::init()
+{
+    m_deletedEvents.clear();
+    m_deletedGroups.clear();
+}
+
+/*!
+ * This function will be called after the last testfunction was executed.
+ */
+void Ut_AccountPurge::cleanupTestCase()
+{
+    AccountPurge purge;
+    QSignalSpy finished(&purge, SIGNAL(finished(QString, bool)));
+    purge.purge(ACCOUNT_PATH);
+    purge.purge(OTHER_ACCOUNT_PATH);
+    QTRY_COMPARE_WITH_TIMEOUT(finished.size(), 2, PURGE_TIMEOUT);
+}
+
+Group Ut_AccountPurge::addGroup(const QString &localUid, const QString &remoteUid)
+{
+    GroupModel groupModel;
+    Group group;
+    group.setLocalUid(localUid);
+    group.setRemoteUids(QStringList() << remoteUid);
+    if (!groupModel.addGroup(group))
+        return Group();
+    return group;
+}
+
+Event Ut_AccountPurge::addMessage(const Group &group)
+{
+    EventModel model;
+    Event event;
+    event.setType(Event::SMSEvent);
+    event.setDirection(Event::Inbound);
+    event.setGroupId(group.id());
+    event.setLocalUid(group.localUid());
+    event.setRemoteUid(group.remoteUids().first());
+    event.setStartTime(QDateTime::currentDateTime());
+    event.setEndTime(event.startTime());
+    event.setFreeText(QLatin1String("purge"));
+    if (!model.addEvent(event))
+        return Event();
+    return event;
+}
+
+Event Ut_AccountPurge::addCall(const QString &localUid, const QString &remoteUid)
+{
+    EventModel model;
+    Event event;
+    event.setType(Event::CallEvent);
+    event.setDirection(Event::Outbound);
+    event.setLocalUid(localUid);
+    event.setRemoteUid(remoteUid);
+    event.setStartTime(QDateTime::currentDateTime());
+    event.setEndTime(event.startTime());
+    if (!model.addEvent(event))
+        return Event();
+    return event;
+}
+
+int Ut_AccountPurge::groupCount(const QString &localUid)
+{
+    GroupModel groupModel;
+    groupModel.enableContactChanges(false);
+    groupModel.setQueryMode(EventModel::SyncQuery);
+    if (!groupModel.getGroups(localUid))
+        return -1;
+    return groupModel.rowCount();
+}
+
+int Ut_AccountPurge::callCount(const QString &localUid)
+{
+    CallModel model;
+
+    QSignalSpy modelReady(&model, SIGNAL(modelReady(bool)));
+    model.setFilterAccount(localUid);
+    model.getEvents();
+    if (!waitSignal(modelReady, PURGE_TIMEOUT))
+        return -1;
+    return model.rowCount();
+}
+
+void Ut_AccountPurge::purgeAccount()
+{
+    Group a = addGroup(ACCOUNT_PATH, QLatin1String("a@example.com"));
+    Group b = addGroup(ACCOUNT_PATH, QLatin1String("b@example.com"));
+    Group other = addGroup(OTHER_ACCOUNT_PATH, QLatin1String("a@example.com"));
+    QVERIFY(a.isValid());
+    QVERIFY(b.isValid());
+    QVERIFY(other.isValid());
+
+    Event message = addMessage(a);
+    QVERIFY(message.isValid());
+    QVERIFY(addMessage(b).isValid());
+    Event otherMessage = addMessage(other);
+    QVERIFY(otherMessage.isValid());
+
+    QList<int> calls;
+    calls << addCall(ACCOUNT_PATH, QLatin1String("+1001")).id()
+          << addCall(ACCOUNT_PATH, QLatin1String("+1002")).id();
+    QVERIFY(addCall(OTHER_ACCOUNT_PATH, QLatin1String("+1001")).isValid());
+
+    QDir partDir(CommHistoryDatabase::dataPath() + QString::number(message.id()));
+    QDir otherPartDir(CommHistoryDatabase::dataPath() + QString::number(otherMessage.id()));
+    QVERIFY(partDir.mkpath(QLatin1String(".")));
+    QVERIFY(otherPartDir.mkpath(QLatin1String(".")));
+
+    AccountPurge purge;
+    QSignalSpy finished(&purge, SIGNAL(finished(QString, bool)));
+    purge.purge(ACCOUNT_PATH);
+    QVERIFY(waitSignal(finished, PURGE_TIMEOUT));
+    QCOMPARE(finished.first().at(0).toString(), QString(ACCOUNT_PATH));
+    QCOMPARE(finished.first().at(1).toBool(), true);
+
+    QCOMPARE(groupCount(ACCOUNT_PATH), 0);
+    QCOMPARE(callCount(ACCOUNT_PATH), 0);
+    QCOMPARE(groupCount(OTHER_ACCOUNT_PATH), 1);
+    QCOMPARE(callCount(OTHER_ACCOUNT_PATH), 1);
+
+    QVERIFY(!partDir.exists());
+    QVERIFY(otherPartDir.exists());
+    QVERIFY(otherPartDir.removeRecursively());
+
+    // One signal for the groups, one per call
+    QTRY_COMPARE_WITH_TIMEOUT(m_deletedGroups.toSet(), QSet<int>() << a.id() << b.id(), PURGE_TIMEOUT);
+    QTRY_COMPARE_WITH_TIMEOUT(m_deletedEvents.toSet(), calls.toSet(), PURGE_TIMEOUT);
+    QCOMPARE(m_deletedEvents.size(), calls.size());
+}
+
+void Ut_AccountPurge::deletedSignalBatches()
+{
+    const int callTotal = DELETED_SIGNAL_BATCH + 10;
+    for (int i = 0; i < callTotal; i++)
+        QVERIFY(addCall(ACCOUNT_PATH, QString::fromLatin1("+2%1").arg(i)).isValid());
+
+    AccountPurge purge;
+    QSignalSpy finished(&purge, SIGNAL(finished(QString, bool)));
+    purge.purge(ACCOUNT_PATH);
+    QVERIFY(waitSignal(finished, PURGE_TIMEOUT));
+    QCOMPARE(finished.first().at(1).toBool(), true);
+
+    // Queued rather than sent all at once
+    QCOMPARE(purge.m_deletedCalls.size(), callTotal);
+    QVERIFY(purge.m_signalsScheduled);
+
+    purge.sendDeletedSignals();
+    QCOMPARE(purge.m_deletedCalls.size(), callTotal - DELETED_SIGNAL_BATCH);
+    QVERIFY(purge.m_signalsScheduled);
+
+    QTRY_COMPARE_WITH_TIMEOUT(m_deletedEvents.size(), callTotal, PURGE_TIMEOUT);
+    QVERIFY(purge.m_deletedCalls.isEmpty());
+    QVERIFY(!purge.m_signalsScheduled);
+
+    // No groups, no groupsDeleted
+    QVERIFY(m_deletedGroups.isEmpty());
+}
+
+void Ut_AccountPurge::purgeQueue()
+{
+    QVERIFY(addCall(ACCOUNT_PATH, QLatin1String("+3001")).isValid());
+    QVERIFY(addCall(OTHER_ACCOUNT_PATH, QLatin1String("+3001")).isValid());
+
+    AccountPurge purge;
+    QSignalSpy finished(&purge, SIGNAL(finished(QString, bool)));
+    purge.purge(ACCOUNT_PATH);
+    purge.purge(ACCOUNT_PATH);
+    purge.purge(OTHER_ACCOUNT_PATH);
+    purge.purge(QString());
+
+    QTRY_COMPARE_WITH_TIMEOUT(finished.size(), 2, PURGE_TIMEOUT);
+    QTest::qWait(100);
+    QCOMPARE(finished.size(), 2);
+    QCOMPARE(finished.at(0).at(0).toString(), QString(ACCOUNT_PATH));
+    QCOMPARE(finished.at(1).at(0).toString(), QString(OTHER_ACCOUNT_PATH));
+    QVERIFY(finished.at(0).at(1).toBool());
+    QVERIFY(finished.at(1).at(1).toBool());
+
+    QCOMPARE(callCount(ACCOUNT_PATH), 0);
+    QCOMPARE(callCount(OTHER_ACCOUNT_PATH), 0);
+    // The connection is closed once the queue is empty
+    QVERIFY(!purge.m_database.isValid());
+}
+
+QTEST_MAIN(Ut_AccountPurge)
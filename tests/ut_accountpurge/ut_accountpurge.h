@@ -0,0 +1,69 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+
+#ifndef UT_ACCOUNTPURGE_H
+#define UT_ACCOUNTPURGE_H
+
+#include <QObject>
+#include <QList>
+
+#include <CommHistory/Event>
+#include <CommHistory/Group>
+
+namespace RTComLogger {
+
+class Ut_AccountPurge : public QObject
+{
+    Q_OBJECT
+public:
+    Ut_AccountPurge();
+    ~Ut_AccountPurge();
+
+public Q_SLOTS:
+    void eventDeleted(int id);
+    void groupsDeleted(const QList<int> &ids);
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void cleanupTestCase();
+
+// Test functions
+private Q_SLOTS:
+    void purgeAccount();
+    void deletedSignalBatches();
+    void purgeQueue();
+
+private:
+    CommHistory::Group addGroup(const QString &localUid, const QString &remoteUid);
+    CommHistory::Event addMessage(const CommHistory::Group &group);
+    CommHistory::Event addCall(const QString &localUid, const QString &remoteUid);
+    int groupCount(const QString &localUid);
+    int callCount(const QString &localUid);
+
+    QList<int> m_deletedEvents;
+    QList<int> m_deletedGroups;
+};
+
+}
+#endif // UT_ACCOUNTPURGE_H
@@ -0,0 +1,235 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+
+// INCLUDES
+#include "ut_calljournal.h"
+
+// Qt includes
+#include <QFile>
+#include <QScopedPointer>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+#include <QTime>
+
+#include <CommHistory/CallModel>
+
+#include "calljournal.h"
+
+// constants
+#define ACCOUNT_PATH QLatin1String("/org/freedesktop/Telepathy/Account/ring/tel/journal")
+#define JOURNAL_PATH (QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) \
+                      + QLatin1String("/commhistoryd/call-journal"))
+#define SAVE_TIMEOUT 5000
+#define JOURNAL_SLOTS 16
+
+using namespace RTComLogger;
+using namespace CommHistory;
+
+namespace {
+    bool waitSignal(QSignalSpy &spy, int msec)
+    {
+        QTime timer;
+        timer.start();
+        while (timer.elapsed() < msec && spy.isEmpty())
+            QCoreApplication::processEvents();
+
+        return !spy.isEmpty();
+    }
+
+    Event callEvent(const QString &remoteUid, Event::EventDirection direction)
+    {
+        Event event;
+        event.setType(Event::CallEvent);
+        event.setDirection(direction);
+        event.setLocalUid(ACCOUNT_PATH);
+        event.setRemoteUid(remoteUid);
+        event.setStartTime(QDateTime::currentDateTime());
+        event.setEndTime(event.startTime());
+        return event;
+    }
+}
+
+Ut_CallJournal::Ut_CallJournal()
+{
+    qRegisterMetaType<CommHistory::Event>();
+}
+
+Ut_CallJournal::~Ut_CallJournal()
+{
+}
+
+/*!
+ * This function will be called before each testfunction is executed.
+ */
+void Ut_CallJournal::init()
+{
+    QFile::remove(JOURNAL_PATH);
+}
+
+/*!
+ * This unction will be called after every testfunction.
+ */
+void Ut_CallJournal::cleanup()
+{
+    QFile::remove(JOURNAL_PATH);
+}
+
+/*!
+ * This function will be called after the last testfunction was executed.
+ */
+void Ut_CallJournal::cleanupTestCase()
+{
+    CallModel model;
+
+    QSignalSpy modelReady(&model, SIGNAL(modelReady(bool)));
+    model.setFilterAccount(ACCOUNT_PATH);
+    model.getEvents();
+    QVERIFY(waitSignal(modelReady, SAVE_TIMEOUT));
+
+    while (model.rowCount() != 0)
+        QVERIFY(model.deleteEvent(model.event(model.index(0,0)).id()));
+}
+
+Event Ut_CallJournal::savedCall(const QString &remoteUid)
+{
+    CallModel model;
+
+    QSignalSpy modelReady(&model, SIGNAL(modelReady(bool)));
+    model.setFilterAccount(ACCOUNT_PATH);
+    model.getEvents();
+    if (!waitSignal(modelReady, SAVE_TIMEOUT))
+        return Event();
+
+    for (int i = 0; i < model.rowCount(); i++) {
+        Event event = model.event(model.index(i, 0));
+        if (event.remoteUid() == remoteUid)
+            return event;
+    }
+
+    return Event();
+}
+
+void Ut_CallJournal::finish()
+{
+    CallJournal journal;
+    QSignalSpy saved(&journal, SIGNAL(callSaved(int, const CommHistory::Event&, bool)));
+
+    Event event = callEvent("+1001", Event::Outbound);
+    int slot = journal.begin(event);
+    QVERIFY(slot >= 0);
+    journal.answered(slot);
+    journal.ended(slot, event);
+
+    int ticket = journal.finish(slot, event);
+    // saved from an idle step, not on the call path
+    QVERIFY(saved.isEmpty());
+
+    QVERIFY(waitSignal(saved, SAVE_TIMEOUT));
+    QCOMPARE(saved.first().at(0).toInt(), ticket);
+    QVERIFY(saved.first().at(2).toBool());
+    QVERIFY(saved.first().at(1).value<Event>().id() >= 0);
+    QVERIFY(savedCall("+1001").isValid());
+
+    // the slot is free again
+    CallJournal reopened;
+    QVERIFY(reopened.open());
+    QVERIFY(reopened.m_leftover.isEmpty());
+}
+
+void Ut_CallJournal::finishWithoutSlot()
+{
+    CallJournal journal;
+    QSignalSpy saved(&journal, SIGNAL(callSaved(int, const CommHistory::Event&, bool)));
+
+    int first = journal.finish(-1, callEvent("+1002", Event::Inbound));
+    int second = journal.finish(-1, callEvent("+1003", Event::Inbound));
+    QVERIFY(first != second);
+
+    // saved together
+    QVERIFY(waitSignal(saved, SAVE_TIMEOUT));
+    QCOMPARE(saved.count(), 2);
+    QCOMPARE(saved.at(0).at(0).toInt(), first);
+    QCOMPARE(saved.at(1).at(0).toInt(), second);
+    QVERIFY(savedCall("+1002").isValid());
+    QVERIFY(savedCall("+1003").isValid());
+}
+
+void Ut_CallJournal::replayAnswered()
+{
+    {
+        // The daemon goes away during the call
+        QScopedPointer<CallJournal> journal(new CallJournal);
+        int slot = journal->begin(callEvent("+1004", Event::Inbound));
+        QVERIFY(slot >= 0);
+        journal->answered(slot);
+        QTest::qWait(1100);
+        journal->checkpoint(slot);
+    }
+
+    CallJournal journal;
+    QVERIFY(journal.open());
+    QCOMPARE(journal.m_leftover.size(), 1);
+
+    journal.replay();
+    QTRY_VERIFY_WITH_TIMEOUT(journal.m_leftover.isEmpty(), SAVE_TIMEOUT);
+
+    Event event = savedCall("+1004");
+    QVERIFY(event.isValid());
+    QVERIFY(!event.isMissedCall());
+    QCOMPARE(event.direction(), Event::Inbound);
+    // lasted until the last checkpoint
+    QVERIFY(event.startTime().secsTo(event.endTime()) >= 1);
+
+    CallJournal reopened;
+    QVERIFY(reopened.open());
+    QVERIFY(reopened.m_leftover.isEmpty());
+}
+
+void Ut_CallJournal::replayUnanswered()
+{
+    {
+        QScopedPointer<CallJournal> journal(new CallJournal);
+        QVERIFY(journal->begin(callEvent("+1005", Event::Inbound)) >= 0);
+    }
+
+    CallJournal journal;
+    journal.replay();
+    QTRY_VERIFY_WITH_TIMEOUT(journal.m_leftover.isEmpty(), SAVE_TIMEOUT);
+
+    // an incoming call nobody saw answered or finished is missed
+    Event event = savedCall("+1005");
+    QVERIFY(event.isValid());
+    QVERIFY(event.isMissedCall());
+}
+
+void Ut_CallJournal::journalFull()
+{
+    CallJournal journal;
+    for (int i = 0; i < JOURNAL_SLOTS; i++)
+        QCOMPARE(journal.begin(callEvent("+1006", Event::Outbound)), i);
+
+    QCOMPARE(journal.begin(callEvent("+1006", Event::Outbound)), -1);
+}
+
+QTEST_MAIN(Ut_CallJournal)
@@ -2,8 +2,7 @@
 **
 ** This file is part of commhistory-daemon.
 **
-** Copyright (C) 2013 Jolla Ltd.
-** Contact: John Brooks <john.brooks@jolla.com>
+** Copyright (C) 2014 Jolla Ltd.
 **
 ** This library is free software; you can redistribute it and/or modify it
 ** under the terms of the GNU Lesser General Public License version 2.1 as
@@ -20,40 +19,40 @@
 **
 ******************************************************************************/
 
-#ifndef LASTDIALEDCACHE_H
-#define LASTDIALEDCACHE_H
+
+
+#ifndef UT_CALLJOURNAL_H
+#define UT_CALLJOURNAL_H
 
 #include <QObject>
-#include <CommHistory/CallModel>
+
+#include <CommHistory/Event>
 
 namespace RTComLogger {
 
-/* Write the last dialed number from the call log to a cache file,
- * and update the number when items are removed from the call log.
- *
- * This is a hack to provide functionality necessary for bluez,
- * which is otherwise unable to access commhistory data in any sane way.
- */
-class LastDialedCache : public QObject
+class Ut_CallJournal : public QObject
 {
     Q_OBJECT
-
 public:
-    LastDialedCache(QObject *parent);
-
-private slots:
-    void onRowsInserted(const QModelIndex &parent, int start, int end);
-    void onRowsRemoved(const QModelIndex &parent, int start, int end);
-    void onModelReset();
+    Ut_CallJournal();
+    ~Ut_CallJournal();
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+    void cleanupTestCase();
+
+// Test functions
+private Q_SLOTS:
+    void finish();
+    void finishWithoutSlot();
+    void replayAnswered();
+    void replayUnanswered();
+    void journalFull();
 
 private:
-    QString filePath;
-    CommHistory::CallModel *model;
-
-    void writeLastDialed(const QString &number);
-    void removeLastDialed();
+    CommHistory::Event savedCall(const QString &remoteUid);
 };
 
 }
-
-#endif
+#endif // UT_CALLJOURNAL_H
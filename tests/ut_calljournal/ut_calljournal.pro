@@ -0,0 +1,53 @@
+###############################################################################
+#
+# This file is part of commhistory-daemon.
+#
+# Copyright (C) 2014 Jolla Ltd.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License version 2.1 as
+# published by the Free Software Foundation.
+#
+# This library is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+# or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+# License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library; if not, write to the Free Software Foundation, Inc.,
+# 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+#
+###############################################################################
+
+#-----------------------------------------------------------------------------
+# Project file for test ut_calljournal
+#-----------------------------------------------------------------------------
+
+#-----------------------------------------------------------------------------
+# common test configuration
+#-----------------------------------------------------------------------------
+!include(../tests.pri) : error( "Unable to include test.pri" )
+
+#-----------------------------------------------------------------------------
+# test specific configuration
+#-----------------------------------------------------------------------------
+
+TARGET = ut_calljournal
+
+TEST_SOURCES += $$COMMHISTORYDSRCDIR/calljournal.cpp \
+                $$COMMHISTORYDSRCDIR/recentcalls.cpp
+
+TEST_HEADERS += $$COMMHISTORYDSRCDIR/calljournal.h \
+                $$COMMHISTORYDSRCDIR/recentcalls.h
+
+HEADERS     += ut_calljournal.h \
+            $$TEST_HEADERS
+
+SOURCES     += ut_calljournal.cpp \
+            $$TEST_SOURCES
+
+DESTDIR = ../bin
+QT += dbus
+QT -= gui
+
+# End of File
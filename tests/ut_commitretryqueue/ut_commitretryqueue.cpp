@@ -0,0 +1,231 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+// INCLUDES
+#include "ut_commitretryqueue.h"
+
+// Qt includes
+#include <QDebug>
+#include <QFile>
+#include <QTest>
+#include <QStandardPaths>
+
+#include <CommHistory/Event>
+
+#include "commitretryqueue.h"
+#include "messagetokencheck.h"
+
+// constants
+#define ACCOUNT_PATH QLatin1String("/org/freedesktop/Telepathy/Account/ring/tel/ring")
+#define CONNECTION_PATH QLatin1String("/org/freedesktop/Telepathy/Connection/ring/tel/ring")
+#define NUMBER QLatin1String("+2222")
+#define QUEUE_PATH (QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) \
+                    + QLatin1String("/commhistoryd/failed-events"))
+
+using namespace RTComLogger;
+
+namespace {
+    CommHistory::Event messageEvent(int groupId, const QString &token)
+    {
+        CommHistory::Event event;
+        event.setType(CommHistory::Event::SMSEvent);
+        event.setDirection(CommHistory::Event::Inbound);
+        event.setStartTime(QDateTime::currentDateTime());
+        event.setEndTime(QDateTime::currentDateTime());
+        event.setLocalUid(ACCOUNT_PATH);
+        event.setGroupId(groupId);
+        event.setRemoteUid(NUMBER);
+        event.setFreeText("retry");
+        event.setMessageToken(token);
+        return event;
+    }
+
+    // DatabaseIO refuses to add an event without a type
+    CommHistory::Event poisonEvent()
+    {
+        CommHistory::Event event;
+        event.setDirection(CommHistory::Event::Inbound);
+        event.setStartTime(QDateTime::currentDateTime());
+        event.setEndTime(QDateTime::currentDateTime());
+        event.setLocalUid(ACCOUNT_PATH);
+        event.setRemoteUid(NUMBER);
+        return event;
+    }
+}
+
+Ut_CommitRetryQueue::Ut_CommitRetryQueue()
+    : groupId(-1)
+{
+}
+
+Ut_CommitRetryQueue::~Ut_CommitRetryQueue()
+{
+}
+
+/*!
+ * This function will be called before the first testfunction is executed.
+ */
+void Ut_CommitRetryQueue::initTestCase()
+{
+    groupModel.enableContactChanges(false);
+    CommHistory::Group group;
+    group.setLocalUid(ACCOUNT_PATH);
+    group.setRemoteUids(QStringList() << NUMBER);
+    groupModel.addGroup(group);
+    groupId = group.id();
+}
+
+/*!
+ * This function will be called after the last testfunction was executed.
+ */
+void Ut_CommitRetryQueue::cleanupTestCase()
+{
+    groupModel.deleteAll();
+}
+
+/*!
+ * This function will be called before each testfunction is executed.
+ */
+void Ut_CommitRetryQueue::init()
+{
+    QFile::remove(QUEUE_PATH);
+    failedConnections.clear();
+}
+
+/*!
+ * This unction will be called after every testfunction.
+ */
+void Ut_CommitRetryQueue::cleanup()
+{
+    QFile::remove(QUEUE_PATH);
+}
+
+qint64 Ut_CommitRetryQueue::retryDelay(const CommitRetryQueue &queue) const
+{
+    return queue.m_due - queue.m_clock.elapsed();
+}
+
+void Ut_CommitRetryQueue::onSavingFailed(const Tp::ConnectionPtr &connection)
+{
+    failedConnections.append(connection);
+}
+
+void Ut_CommitRetryQueue::persistence()
+{
+    {
+        CommitRetryQueue queue;
+        queue.add(QList<CommHistory::Event>() << poisonEvent() << messageEvent(groupId, "crtq-persist"),
+                  Tp::ConnectionPtr(new Tp::Connection(CONNECTION_PATH)));
+        QCOMPARE(queue.size(), 2);
+        QVERIFY(queue.m_timer.isActive());
+
+        // Failed attempts are stored with the events
+        queue.m_timer.stop();
+        queue.m_entries[0].attempts = 3;
+        queue.save();
+    }
+    QVERIFY(QFile::exists(QUEUE_PATH));
+
+    CommitRetryQueue loaded;
+    // Events left by the previous run are retried right away
+    QVERIFY(loaded.m_timer.isActive());
+    loaded.m_timer.stop();
+
+    QCOMPARE(loaded.size(), 2);
+    QCOMPARE(loaded.m_entries.at(0).attempts, 3);
+    QCOMPARE(loaded.m_entries.at(0).event.type(), CommHistory::Event::UnknownType);
+    QCOMPARE(loaded.m_entries.at(1).attempts, 0);
+    QCOMPARE(loaded.m_entries.at(1).event.messageToken(), QString("crtq-persist"));
+    QCOMPARE(loaded.m_entries.at(1).connectionPath, QString(CONNECTION_PATH));
+
+    // An empty queue leaves no file behind
+    loaded.m_entries.clear();
+    loaded.save();
+    QVERIFY(!QFile::exists(QUEUE_PATH));
+}
+
+void Ut_CommitRetryQueue::backOff()
+{
+    CommitRetryQueue queue;
+    queue.add(QList<CommHistory::Event>() << poisonEvent(), Tp::ConnectionPtr());
+
+    // Without message tokens there is nothing to check, so this is synchronous
+    queue.retry();
+    QVERIFY(!queue.m_check);
+    QCOMPARE(queue.size(), 1);
+    QCOMPARE(queue.m_entries.at(0).attempts, 1);
+    QCOMPARE(queue.m_failures, 1);
+    QVERIFY(queue.m_timer.isActive());
+    qint64 first = retryDelay(queue);
+
+    queue.retry();
+    QCOMPARE(queue.m_entries.at(0).attempts, 2);
+    QCOMPARE(queue.m_failures, 2);
+    qint64 second = retryDelay(queue);
+    // Doubled, with up to 25% jitter either way
+    QVERIFY2(second > first, qPrintable(QString("%1 <= %2").arg(second).arg(first)));
+
+    // Another commit succeeding only brings the retry forward
+    queue.databaseAvailable();
+    QCOMPARE(queue.m_entries.at(0).attempts, 2);
+    QCOMPARE(queue.m_failures, 0);
+    QVERIFY(queue.m_timer.isActive());
+    QVERIFY(retryDelay(queue) <= 500);
+
+    // ...and doesn't postpone a retry that is already due sooner
+    queue.start(0);
+    queue.databaseAvailable();
+    QVERIFY(retryDelay(queue) <= 0);
+
+    queue.m_timer.stop();
+}
+
+void Ut_CommitRetryQueue::giveUp()
+{
+    Tp::ConnectionPtr connection(new Tp::Connection(CONNECTION_PATH));
+
+    CommitRetryQueue queue;
+    connect(&queue, SIGNAL(savingFailed(Tp::ConnectionPtr)),
+            SLOT(onSavingFailed(Tp::ConnectionPtr)));
+    queue.add(QList<CommHistory::Event>() << poisonEvent() << messageEvent(groupId, "crtq-giveup"),
+              connection);
+
+    // The event that can't be saved doesn't hold back the other one
+    int attempts = 0;
+    while (queue.size() > 0 && attempts < 20) {
+        queue.retry();
+        QTRY_VERIFY(!queue.m_check);
+        attempts++;
+    }
+
+    QCOMPARE(queue.size(), 0);
+    QCOMPARE(attempts, 8);
+    QCOMPARE(failedConnections.size(), 1);
+    QVERIFY(failedConnections.first() == connection);
+    QVERIFY(!QFile::exists(QUEUE_PATH));
+
+    MessageTokenCheck check = checkMessageTokens(QString(), QSet<QString>() << "crtq-giveup");
+    QVERIFY(check.ok);
+    QCOMPARE(check.existing, QStringList() << "crtq-giveup");
+}
+
+QTEST_MAIN(Ut_CommitRetryQueue)
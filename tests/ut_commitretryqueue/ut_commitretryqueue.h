@@ -0,0 +1,67 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef UT_COMMITRETRYQUEUE_H
+#define UT_COMMITRETRYQUEUE_H
+
+#include <QObject>
+#include <QList>
+
+#include <TelepathyQt/Connection>
+#include <CommHistory/GroupModel>
+
+namespace RTComLogger {
+
+class CommitRetryQueue;
+
+class Ut_CommitRetryQueue : public QObject
+{
+    Q_OBJECT
+public:
+    Ut_CommitRetryQueue();
+    ~Ut_CommitRetryQueue();
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+    void cleanup();
+
+// Test functions
+private Q_SLOTS:
+    void persistence();
+    void backOff();
+    void giveUp();
+
+public Q_SLOTS:
+    void onSavingFailed(const Tp::ConnectionPtr &connection);
+
+private:
+    qint64 retryDelay(const CommitRetryQueue &queue) const;
+
+    CommHistory::GroupModel groupModel;
+    int groupId;
+    QList<Tp::ConnectionPtr> failedConnections;
+};
+
+}
+#endif // UT_COMMITRETRYQUEUE_H
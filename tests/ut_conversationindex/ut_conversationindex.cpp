@@ -0,0 +1,205 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+
+// INCLUDES
+#include "ut_conversationindex.h"
+
+// Qt includes
+#include <QDir>
+#include <QFile>
+#include <QTest>
+
+#include <CommHistory/groupmanager.h>
+
+#include "conversationindex.h"
+
+// constants
+#define ACCOUNT_PATH QLatin1String("/org/freedesktop/Telepathy/Account/gabble/jabber/conversationindex")
+#define REMOTE_A QLatin1String("a@example.com")
+#define REMOTE_B QLatin1String("b@example.com")
+#define MISSING_GROUP_ID 999999
+#define LOAD_TIMEOUT 5000
+
+using namespace RTComLogger;
+using namespace CommHistory;
+
+Ut_ConversationIndex::Ut_ConversationIndex()
+    : m_snapshotPath(QDir::tempPath() + QLatin1String("/ut_conversationindex/conversation-index"))
+{
+}
+
+Ut_ConversationIndex::~Ut_ConversationIndex()
+{
+}
+
+/*!
+ * This function will be called before the first testfunction is executed.
+ */
+void Ut_ConversationIndex::initTestCase()
+{
+    groupModel.enableContactChanges(false);
+    groupModel.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(groupModel.getGroups(ACCOUNT_PATH));
+}
+
+/*!
+ * This function will be called after the last testfunction was executed.
+ */
+void Ut_ConversationIndex::cleanupTestCase()
+{
+    groupModel.deleteAll();
+    QFile::remove(m_snapshotPath);
+}
+
+/*!
+ * This unction will be called after every testfunction.
+ */
+void Ut_ConversationIndex::cleanup()
+{
+    QList<int> ids;
+    for (int i = 0; i < groupModel.rowCount(); i++)
+        ids << groupModel.group(groupModel.index(i, 0)).id();
+    if (!ids.isEmpty())
+        QVERIFY(groupModel.deleteGroups(ids));
+    QTRY_COMPARE(groupModel.rowCount(), 0);
+    QFile::remove(m_snapshotPath);
+}
+
+Group Ut_ConversationIndex::addGroup(const QString &remoteUid, const QString &chatName)
+{
+    Group group;
+    group.setLocalUid(ACCOUNT_PATH);
+    group.setRemoteUids(QStringList() << remoteUid);
+    group.setChatName(chatName);
+    if (!groupModel.addGroup(group))
+        return Group();
+    return group;
+}
+
+void Ut_ConversationIndex::warmWith(ConversationIndex &index, const Group &candidate)
+{
+    index.m_snapshotPath = m_snapshotPath;
+    index.insert(candidate);
+    index.m_warm = true;
+}
+
+void Ut_ConversationIndex::snapshotHit()
+{
+    Group stored = addGroup(REMOTE_A, QLatin1String("Current"));
+    QVERIFY(stored.isValid());
+
+    Group candidate(stored);
+    candidate.setChatName(QLatin1String("Stale"));
+
+    ConversationIndex index;
+    warmWith(index, candidate);
+    QVERIFY(index.isWarm());
+    QVERIFY(!index.isReady());
+
+    // Read back from the database, not returned as the snapshot had it
+    Group group = index.findGroup(ACCOUNT_PATH, REMOTE_A);
+    QCOMPARE(group.id(), stored.id());
+    QCOMPARE(group.chatName(), QString(QLatin1String("Current")));
+    QCOMPARE(index.m_groups.value(stored.id()).chatName(), QString(QLatin1String("Current")));
+}
+
+void Ut_ConversationIndex::snapshotGroupDeleted()
+{
+    Group candidate;
+    candidate.setId(MISSING_GROUP_ID);
+    candidate.setLocalUid(ACCOUNT_PATH);
+    candidate.setRemoteUids(QStringList() << REMOTE_A);
+
+    ConversationIndex index;
+    warmWith(index, candidate);
+
+    // Deleted since the snapshot; dropped from the index
+    QVERIFY(!index.findGroup(ACCOUNT_PATH, REMOTE_A).isValid());
+    QVERIFY(!index.m_groups.contains(MISSING_GROUP_ID));
+    QVERIFY(index.m_index.isEmpty());
+
+    // Added again by someone else; found by the query instead
+    Group stored = addGroup(REMOTE_A);
+    QVERIFY(stored.isValid());
+    QCOMPARE(index.findGroup(ACCOUNT_PATH, REMOTE_A).id(), stored.id());
+}
+
+void Ut_ConversationIndex::snapshotIdReused()
+{
+    Group a = addGroup(REMOTE_A);
+    Group b = addGroup(REMOTE_B);
+    QVERIFY(a.isValid());
+    QVERIFY(b.isValid());
+
+    // The snapshot has the id of a for the address of b
+    Group candidate(a);
+    candidate.setRemoteUids(QStringList() << REMOTE_B);
+
+    ConversationIndex index;
+    warmWith(index, candidate);
+
+    QCOMPARE(index.findGroup(ACCOUNT_PATH, REMOTE_B).id(), b.id());
+    // Corrected from the database
+    QCOMPARE(index.m_groups.value(a.id()).remoteUids(), QStringList() << REMOTE_A);
+    QCOMPARE(index.lookup(ACCOUNT_PATH, QStringList() << REMOTE_A).id(), a.id());
+}
+
+void Ut_ConversationIndex::snapshotRoundTrip()
+{
+    Group a = addGroup(REMOTE_A, QLatin1String("Chat"));
+    Group b = addGroup(REMOTE_B);
+    QVERIFY(a.isValid());
+    QVERIFY(b.isValid());
+
+    {
+        ConversationIndex index;
+        index.m_snapshotPath = m_snapshotPath;
+        index.load();
+        QVERIFY(index.m_manager);
+        QTRY_VERIFY_WITH_TIMEOUT(index.isReady(), LOAD_TIMEOUT);
+        index.writeSnapshot();
+    }
+    QVERIFY(QFile::exists(m_snapshotPath));
+
+    ConversationIndex index;
+    index.m_snapshotPath = m_snapshotPath;
+    index.loadSnapshot();
+    QVERIFY(index.isWarm());
+    QVERIFY(!index.isReady());
+    QCOMPARE(index.m_groups.value(a.id()).chatName(), QString(QLatin1String("Chat")));
+    QCOMPARE(index.findGroup(ACCOUNT_PATH, REMOTE_B).id(), b.id());
+
+    // Corrupted snapshots are ignored
+    QFile file(m_snapshotPath);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.resize(file.size() - 1));
+    file.close();
+
+    ConversationIndex corrupted;
+    corrupted.m_snapshotPath = m_snapshotPath;
+    corrupted.loadSnapshot();
+    QVERIFY(!corrupted.isWarm());
+    QVERIFY(corrupted.m_groups.isEmpty());
+}
+
+QTEST_MAIN(Ut_ConversationIndex)
@@ -0,0 +1,65 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+
+#ifndef UT_CONVERSATIONINDEX_H
+#define UT_CONVERSATIONINDEX_H
+
+#include <QObject>
+
+#include <CommHistory/Group>
+#include <CommHistory/GroupModel>
+
+namespace RTComLogger {
+
+class ConversationIndex;
+
+class Ut_ConversationIndex : public QObject
+{
+    Q_OBJECT
+public:
+    Ut_ConversationIndex();
+    ~Ut_ConversationIndex();
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void cleanup();
+
+// Test functions
+private Q_SLOTS:
+    void snapshotHit();
+    void snapshotGroupDeleted();
+    void snapshotIdReused();
+    void snapshotRoundTrip();
+
+private:
+    CommHistory::Group addGroup(const QString &remoteUid, const QString &chatName = QString());
+    // index serving lookups from a snapshot holding the candidate
+    void warmWith(ConversationIndex &index, const CommHistory::Group &candidate);
+
+    CommHistory::GroupModel groupModel;
+    QString m_snapshotPath;
+};
+
+}
+#endif // UT_CONVERSATIONINDEX_H
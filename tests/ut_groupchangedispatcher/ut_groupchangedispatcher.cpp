@@ -0,0 +1,202 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+
+// INCLUDES
+#include "ut_groupchangedispatcher.h"
+
+// Qt includes
+#include <QTest>
+
+#include <CommHistory/Group>
+
+#include "groupchangedispatcher.h"
+
+// constants
+#define ACCOUNT_PATH QLatin1String("/org/freedesktop/Telepathy/Account/gabble/jabber/dispatcher")
+#define REMOTE_A QLatin1String("a@example.com")
+#define REMOTE_B QLatin1String("b@example.com")
+#define DELIVERY_TIMEOUT 5000
+
+using namespace RTComLogger;
+
+namespace {
+    class Listener : public GroupChangeListener
+    {
+    public:
+        Listener() : dispatcher(0), unsubscribeOnInsert(0) {}
+
+        void groupInserted(const CommHistory::Group &group)
+        {
+            inserted << group.id();
+            if (dispatcher && unsubscribeOnInsert)
+                dispatcher->unsubscribe(unsubscribeOnInsert);
+        }
+
+        void groupRemoved(const CommHistory::Group &group)
+        {
+            removed << group.id();
+        }
+
+        QList<int> inserted;
+        QList<int> removed;
+        GroupChangeDispatcher *dispatcher;
+        GroupChangeListener *unsubscribeOnInsert;
+    };
+}
+
+Ut_GroupChangeDispatcher::Ut_GroupChangeDispatcher()
+{
+}
+
+Ut_GroupChangeDispatcher::~Ut_GroupChangeDispatcher()
+{
+}
+
+/*!
+ * This function will be called before the first testfunction is executed.
+ */
+void Ut_GroupChangeDispatcher::initTestCase()
+{
+    groupModel.enableContactChanges(false);
+    groupModel.setQueryMode(CommHistory::EventModel::SyncQuery);
+    QVERIFY(groupModel.getGroups(ACCOUNT_PATH));
+}
+
+/*!
+ * This function will be called after the last testfunction was executed.
+ */
+void Ut_GroupChangeDispatcher::cleanupTestCase()
+{
+    groupModel.deleteAll();
+}
+
+/*!
+ * This unction will be called after every testfunction.
+ */
+void Ut_GroupChangeDispatcher::cleanup()
+{
+    QList<int> ids;
+    for (int i = 0; i < groupModel.rowCount(); i++)
+        ids << groupModel.group(groupModel.index(i, 0)).id();
+    if (!ids.isEmpty())
+        QVERIFY(groupModel.deleteGroups(ids));
+    QTRY_COMPARE(groupModel.rowCount(), 0);
+}
+
+int Ut_GroupChangeDispatcher::addGroup(const QString &remoteUid)
+{
+    CommHistory::Group group;
+    group.setLocalUid(ACCOUNT_PATH);
+    group.setRemoteUids(QStringList() << remoteUid);
+    if (!groupModel.addGroup(group))
+        return -1;
+    return group.id();
+}
+
+void Ut_GroupChangeDispatcher::dispatchById()
+{
+    GroupChangeDispatcher *dispatcher = GroupChangeDispatcher::forModel(&groupModel);
+    QVERIFY(dispatcher);
+    QVERIFY(GroupChangeDispatcher::forModel(&groupModel) == dispatcher);
+
+    int a = addGroup(REMOTE_A);
+    int b = addGroup(REMOTE_B);
+    QVERIFY(a >= 0);
+    QVERIFY(b >= 0);
+
+    Listener listener;
+    dispatcher->subscribe(&listener, a);
+
+    QVERIFY(groupModel.deleteGroups(QList<int>() << b));
+    QVERIFY(groupModel.deleteGroups(QList<int>() << a));
+    QTRY_COMPARE_WITH_TIMEOUT(listener.removed, QList<int>() << a, DELIVERY_TIMEOUT);
+    QVERIFY(listener.inserted.isEmpty());
+
+    dispatcher->unsubscribe(&listener);
+}
+
+void Ut_GroupChangeDispatcher::dispatchByAddress()
+{
+    GroupChangeDispatcher *dispatcher = GroupChangeDispatcher::forModel(&groupModel);
+
+    // Subscribed before the group exists
+    Listener listener;
+    dispatcher->subscribe(&listener, ACCOUNT_PATH, REMOTE_A);
+
+    int b = addGroup(REMOTE_B);
+    int a = addGroup(REMOTE_A);
+    QVERIFY(a >= 0);
+    QVERIFY(b >= 0);
+    QTRY_COMPARE_WITH_TIMEOUT(listener.inserted, QList<int>() << a, DELIVERY_TIMEOUT);
+
+    // Addresses of other accounts don't match
+    Listener other;
+    dispatcher->subscribe(&other, QLatin1String("/org/freedesktop/Telepathy/Account/other"), REMOTE_A);
+
+    QVERIFY(groupModel.deleteGroups(QList<int>() << a));
+    QTRY_COMPARE_WITH_TIMEOUT(listener.removed, QList<int>() << a, DELIVERY_TIMEOUT);
+    QVERIFY(other.removed.isEmpty());
+
+    dispatcher->unsubscribe(&listener);
+    dispatcher->unsubscribe(&other);
+}
+
+void Ut_GroupChangeDispatcher::subscribeAll()
+{
+    GroupChangeDispatcher *dispatcher = GroupChangeDispatcher::forModel(&groupModel);
+
+    Listener listener;
+    dispatcher->subscribeAll(&listener);
+    // Delivered once, however many subscriptions match
+    dispatcher->subscribe(&listener, ACCOUNT_PATH, REMOTE_A);
+
+    int a = addGroup(REMOTE_A);
+    int b = addGroup(REMOTE_B);
+    QTRY_COMPARE_WITH_TIMEOUT(listener.inserted, QList<int>() << a << b, DELIVERY_TIMEOUT);
+
+    dispatcher->unsubscribe(&listener);
+    addGroup(QLatin1String("c@example.com"));
+    QTest::qWait(100);
+    QCOMPARE(listener.inserted.size(), 2);
+}
+
+void Ut_GroupChangeDispatcher::unsubscribeDuringDelivery()
+{
+    GroupChangeDispatcher *dispatcher = GroupChangeDispatcher::forModel(&groupModel);
+
+    Listener first, second;
+    first.dispatcher = dispatcher;
+    first.unsubscribeOnInsert = &second;
+    dispatcher->subscribeAll(&first);
+    dispatcher->subscribeAll(&second);
+
+    int a = addGroup(REMOTE_A);
+    QTRY_COMPARE_WITH_TIMEOUT(first.inserted, QList<int>() << a, DELIVERY_TIMEOUT);
+    // Unsubscribed by the first listener before its turn
+    QVERIFY(second.inserted.isEmpty());
+
+    first.unsubscribeOnInsert = 0;
+    dispatcher->unsubscribe(&first);
+}
+
+QTEST_MAIN(Ut_GroupChangeDispatcher)
@@ -38,10 +38,14 @@
 
 #include "connectionutils.h"
 #include "messagereviver.h"
+#include "messagetokencheck.h"
 
 // constants
 #define ACCOUNT_PATH QLatin1String("/org/freedesktop/Telepathy/Account/ring/tel/ring")
 #define NUMBER QLatin1String("+1111")
+// More than two chunks of checkMessageTokens()
+#define CHUNK_TOKENS 1001
+#define CHUNK_STORED_TOKENS 520
 
 using namespace RTComLogger;
 
@@ -58,6 +62,7 @@ namespace {
 }
 
 Ut_MessageReviver::Ut_MessageReviver()
+    : groupId(-1)
 {
 }
 
@@ -75,6 +80,7 @@ void Ut_MessageReviver::initTestCase()
     group.setLocalUid(ACCOUNT_PATH);
     group.setRemoteUids(QStringList() << NUMBER);
     groupModel.addGroup(group);
+    groupId = group.id();
 
     CommHistory::EventModel model;
 
@@ -149,6 +155,8 @@ void Ut_MessageReviver::revive()
     // call seconde time with the same tokens to initate recovery
     reviver.updateTokens(tokens, conn);
 
+    // tokens are checked in a worker thread
+    QTRY_COMPARE(sm->ut_getDeliveredMessages().size(), 2);
     QStringList delivered = sm->ut_getDeliveredMessages();
     QCOMPARE(delivered.size(), 2);
     QVERIFY(delivered.contains("mrtc2"));
@@ -157,4 +165,46 @@ void Ut_MessageReviver::revive()
     QVERIFY(sm->ut_getExpungedMessages().contains("mrtc1"));
 }
 
+void Ut_MessageReviver::tokenChunks()
+{
+    CommHistory::EventModel model;
+    QSignalSpy commit(&model,
+                      SIGNAL(eventsCommitted(const QList<CommHistory::Event>&, bool)));
+
+    QList<CommHistory::Event> events;
+    for (int i = 0; i < CHUNK_STORED_TOKENS; i++) {
+        CommHistory::Event event;
+        event.setType(CommHistory::Event::SMSEvent);
+        event.setDirection(CommHistory::Event::Inbound);
+        event.setStartTime(QDateTime::currentDateTime());
+        event.setEndTime(QDateTime::currentDateTime());
+        event.setLocalUid(ACCOUNT_PATH);
+        event.setGroupId(groupId);
+        event.setRemoteUid(NUMBER);
+        event.setFreeText("chunk");
+        event.setMessageToken(QString::fromLatin1("chunk%1").arg(i));
+        events.append(event);
+    }
+    QVERIFY(model.addEvents(events, false));
+    QVERIFY(waitSignal(commit, 5000));
+
+    QSet<QString> tokens;
+    for (int i = 0; i < CHUNK_TOKENS; i++)
+        tokens.insert(QString::fromLatin1("chunk%1").arg(i));
+
+    MessageTokenCheck check = checkMessageTokens(ACCOUNT_PATH, tokens);
+    QVERIFY(check.ok);
+    QCOMPARE(check.connectionPath, QString(ACCOUNT_PATH));
+    QCOMPARE(check.existing.size(), CHUNK_STORED_TOKENS);
+    QCOMPARE(check.missing.size(), CHUNK_TOKENS - CHUNK_STORED_TOKENS);
+
+    for (int i = 0; i < CHUNK_TOKENS; i++) {
+        QString token = QString::fromLatin1("chunk%1").arg(i);
+        if (i < CHUNK_STORED_TOKENS)
+            QVERIFY(check.existing.contains(token));
+        else
+            QVERIFY(check.missing.contains(token));
+    }
+}
+
 QTEST_MAIN(Ut_MessageReviver)
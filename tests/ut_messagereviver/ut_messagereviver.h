@@ -47,9 +47,11 @@ private Q_SLOTS:
 // Test functions
 private Q_SLOTS:
     void revive();
+    void tokenChunks();
 
 private:
     CommHistory::GroupModel groupModel;
+    int groupId;
 };
 
 }
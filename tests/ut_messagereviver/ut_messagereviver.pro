@@ -39,9 +39,15 @@ INCLUDEPATH = ../stubs/ $${INCLUDEPATH}
 TARGET = ut_messagereviver
 
 TEST_SOURCES += $$COMMHISTORYDSRCDIR/messagereviver.cpp \
+                $$COMMHISTORYDSRCDIR/messagetokencheck.cpp \
+                $$COMMHISTORYDSRCDIR/commhistorydatabase.cpp \
+                $$COMMHISTORYDSRCDIR/expungeaggregator.cpp \
                 $$COMMHISTORYDSRCDIR/connectionutils.cpp
 
 TEST_HEADERS += $$COMMHISTORYDSRCDIR/messagereviver.h \
+                $$COMMHISTORYDSRCDIR/messagetokencheck.h \
+                $$COMMHISTORYDSRCDIR/commhistorydatabase.h \
+                $$COMMHISTORYDSRCDIR/expungeaggregator.h \
                 $$COMMHISTORYDSRCDIR/connectionutils.h
 
 HEADERS     += ut_messagereviver.h \
@@ -51,7 +57,7 @@ SOURCES     += ut_messagereviver.cpp \
             $$TEST_SOURCES
 
 DESTDIR = ../bin
-QT += dbus
+QT += dbus sql concurrent
 QT -= gui
 
 # End of File
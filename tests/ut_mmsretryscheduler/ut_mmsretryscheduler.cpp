@@ -0,0 +1,187 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+
+// INCLUDES
+#include "ut_mmsretryscheduler.h"
+
+// Qt includes
+#include <QTest>
+
+#include "mmsretryscheduler.h"
+
+// constants
+#define MAX_CONCURRENT_SENDS 2
+#define MAX_SEND_ATTEMPTS 5
+
+using namespace CommHistory;
+
+namespace {
+    Event mmsEvent(int id)
+    {
+        Event event;
+        event.setId(id);
+        event.setType(Event::MMSEvent);
+        event.setDirection(Event::Outbound);
+        return event;
+    }
+}
+
+Ut_MmsRetryScheduler::Ut_MmsRetryScheduler()
+    : m_scheduler(0),
+      m_deferOnDispatch(false)
+{
+}
+
+Ut_MmsRetryScheduler::~Ut_MmsRetryScheduler()
+{
+}
+
+/*!
+ * This function will be called before each testfunction is executed.
+ */
+void Ut_MmsRetryScheduler::init()
+{
+    m_scheduler = 0;
+    m_dispatched.clear();
+    m_deferOnDispatch = false;
+}
+
+void Ut_MmsRetryScheduler::onDispatch(const Event &event)
+{
+    m_dispatched.append(event.id());
+    if (m_deferOnDispatch && m_scheduler)
+        m_scheduler->defer(event);
+}
+
+void Ut_MmsRetryScheduler::expireDue(MmsRetryScheduler &scheduler)
+{
+    QHash<int, MmsRetryScheduler::Entry>::iterator it = scheduler.m_entries.begin();
+    for (; it != scheduler.m_entries.end(); ++it)
+        it->due = 0;
+    scheduler.dispatchDue();
+}
+
+void Ut_MmsRetryScheduler::dispatchInOrder()
+{
+    MmsRetryScheduler scheduler;
+    connect(&scheduler, SIGNAL(dispatch(CommHistory::Event)), SLOT(onDispatch(CommHistory::Event)));
+
+    scheduler.defer(mmsEvent(1));
+    scheduler.defer(mmsEvent(2));
+    scheduler.defer(mmsEvent(3));
+    QCOMPARE(scheduler.depth(), 3);
+
+    // Limited number in flight at a time
+    QCOMPARE(m_dispatched, QList<int>() << 1 << 2);
+    QVERIFY(!scheduler.isDeferred(1));
+    QVERIFY(scheduler.isDeferred(3));
+
+    scheduler.sendFinished(1);
+    QCOMPARE(m_dispatched, QList<int>() << 1 << 2 << 3);
+    QVERIFY(!scheduler.contains(1));
+    QCOMPARE(scheduler.depth(), 2);
+
+    scheduler.sendFinished(2);
+    scheduler.sendFinished(3);
+    QCOMPARE(scheduler.depth(), 0);
+}
+
+void Ut_MmsRetryScheduler::suspend()
+{
+    MmsRetryScheduler scheduler;
+    connect(&scheduler, SIGNAL(dispatch(CommHistory::Event)), SLOT(onDispatch(CommHistory::Event)));
+
+    scheduler.suspend();
+    scheduler.defer(mmsEvent(1));
+    QTest::qWait(50);
+    QVERIFY(m_dispatched.isEmpty());
+    QVERIFY(scheduler.isDeferred(1));
+
+    scheduler.resume();
+    QCOMPARE(m_dispatched, QList<int>() << 1);
+}
+
+void Ut_MmsRetryScheduler::retryBackOff()
+{
+    MmsRetryScheduler scheduler;
+    connect(&scheduler, SIGNAL(dispatch(CommHistory::Event)), SLOT(onDispatch(CommHistory::Event)));
+
+    scheduler.defer(mmsEvent(1));
+    QCOMPARE(m_dispatched.size(), 1);
+
+    QVERIFY(scheduler.sendFailed(1));
+    QVERIFY(scheduler.isDeferred(1));
+    QVERIFY(scheduler.m_timer.isActive());
+
+    // Not retried right away
+    QTest::qWait(50);
+    QCOMPARE(m_dispatched.size(), 1);
+
+    qint64 first = scheduler.m_entries.value(1).due - scheduler.m_clock.elapsed();
+    expireDue(scheduler);
+    QCOMPARE(m_dispatched.size(), 2);
+
+    // The interval grows with every failed attempt
+    QVERIFY(scheduler.sendFailed(1));
+    qint64 second = scheduler.m_entries.value(1).due - scheduler.m_clock.elapsed();
+    QVERIFY(second > first);
+
+    // Failures of messages not in flight are not retried
+    QVERIFY(!scheduler.sendFailed(2));
+}
+
+void Ut_MmsRetryScheduler::deferDuringDispatch()
+{
+    MmsRetryScheduler scheduler;
+    m_scheduler = &scheduler;
+    m_deferOnDispatch = true;
+    connect(&scheduler, SIGNAL(dispatch(CommHistory::Event)), SLOT(onDispatch(CommHistory::Event)));
+
+    scheduler.defer(mmsEvent(1));
+
+    // Deferred again after being dispatched; waits instead of coming straight back
+    QTest::qWait(100);
+    QCOMPARE(m_dispatched, QList<int>() << 1);
+    QVERIFY(scheduler.isDeferred(1));
+    QVERIFY(scheduler.m_entries.value(1).due > scheduler.m_clock.elapsed());
+    QCOMPARE(scheduler.depth(), 1);
+}
+
+void Ut_MmsRetryScheduler::giveUp()
+{
+    MmsRetryScheduler scheduler;
+    connect(&scheduler, SIGNAL(dispatch(CommHistory::Event)), SLOT(onDispatch(CommHistory::Event)));
+
+    scheduler.defer(mmsEvent(1));
+    for (int i = 1; i < MAX_SEND_ATTEMPTS; i++) {
+        QVERIFY(scheduler.sendFailed(1));
+        expireDue(scheduler);
+        QCOMPARE(m_dispatched.size(), i + 1);
+    }
+
+    QVERIFY(!scheduler.sendFailed(1));
+    QVERIFY(!scheduler.contains(1));
+    QCOMPARE(scheduler.depth(), 0);
+}
+
+QTEST_MAIN(Ut_MmsRetryScheduler)
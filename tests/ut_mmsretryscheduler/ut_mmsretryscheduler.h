@@ -0,0 +1,65 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+
+#ifndef UT_MMSRETRYSCHEDULER_H
+#define UT_MMSRETRYSCHEDULER_H
+
+#include <QObject>
+#include <QList>
+
+#include <CommHistory/Event>
+
+class MmsRetryScheduler;
+
+class Ut_MmsRetryScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    Ut_MmsRetryScheduler();
+    ~Ut_MmsRetryScheduler();
+
+private Q_SLOTS:
+    void init();
+
+// Test functions
+private Q_SLOTS:
+    void dispatchInOrder();
+    void suspend();
+    void retryBackOff();
+    void deferDuringDispatch();
+    void giveUp();
+
+public Q_SLOTS:
+    void onDispatch(const CommHistory::Event &event);
+
+private:
+    // make retries due now instead of waiting for the back-off
+    void expireDue(MmsRetryScheduler &scheduler);
+
+    MmsRetryScheduler *m_scheduler;
+    QList<int> m_dispatched;
+    // defer messages again when dispatched, as when sending isn't allowed
+    bool m_deferOnDispatch;
+};
+
+#endif // UT_MMSRETRYSCHEDULER_H
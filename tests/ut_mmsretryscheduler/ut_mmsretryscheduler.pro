@@ -0,0 +1,50 @@
+###############################################################################
+#
+# This file is part of commhistory-daemon.
+#
+# Copyright (C) 2014 Jolla Ltd.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License version 2.1 as
+# published by the Free Software Foundation.
+#
+# This library is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+# or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+# License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library; if not, write to the Free Software Foundation, Inc.,
+# 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+#
+###############################################################################
+
+#-----------------------------------------------------------------------------
+# Project file for test ut_mmsretryscheduler
+#-----------------------------------------------------------------------------
+
+#-----------------------------------------------------------------------------
+# common test configuration
+#-----------------------------------------------------------------------------
+!include(../tests.pri) : error( "Unable to include test.pri" )
+
+#-----------------------------------------------------------------------------
+# test specific configuration
+#-----------------------------------------------------------------------------
+
+TARGET = ut_mmsretryscheduler
+
+TEST_SOURCES += $$COMMHISTORYDSRCDIR/mmsretryscheduler.cpp
+
+TEST_HEADERS += $$COMMHISTORYDSRCDIR/mmsretryscheduler.h
+
+HEADERS     += ut_mmsretryscheduler.h \
+            $$TEST_HEADERS
+
+SOURCES     += ut_mmsretryscheduler.cpp \
+            $$TEST_SOURCES
+
+DESTDIR = ../bin
+QT -= gui
+
+# End of File
@@ -0,0 +1,142 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+
+// INCLUDES
+#include "ut_mmstransactionjournal.h"
+
+// Qt includes
+#include <QDir>
+#include <QFile>
+#include <QTest>
+
+#include "mmstransactionjournal.h"
+
+Ut_MmsTransactionJournal::Ut_MmsTransactionJournal()
+    : m_path(QDir::tempPath() + QLatin1String("/ut_mmstransactionjournal/journal"))
+{
+}
+
+Ut_MmsTransactionJournal::~Ut_MmsTransactionJournal()
+{
+}
+
+/*!
+ * This function will be called before each testfunction is executed.
+ */
+void Ut_MmsTransactionJournal::init()
+{
+    QFile::remove(m_path);
+}
+
+/*!
+ * This unction will be called after every testfunction.
+ */
+void Ut_MmsTransactionJournal::cleanup()
+{
+    QFile::remove(m_path);
+}
+
+int Ut_MmsTransactionJournal::lineCount() const
+{
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+
+    return file.readAll().count('\n');
+}
+
+void Ut_MmsTransactionJournal::replayLastState()
+{
+    {
+        MmsTransactionJournal journal(m_path);
+        journal.record(1, MmsTransactionJournal::Notification);
+        journal.record(1, MmsTransactionJournal::Receiving);
+        journal.record(2, MmsTransactionJournal::Sending);
+        journal.record(3, MmsTransactionJournal::Notification);
+        journal.record(3, MmsTransactionJournal::Done);
+    }
+
+    MmsTransactionJournal journal(m_path);
+    QHash<int, MmsTransactionJournal::State> pending = journal.replay();
+    QCOMPARE(pending.size(), 2);
+    QCOMPARE(pending.value(1), MmsTransactionJournal::Receiving);
+    QCOMPARE(pending.value(2), MmsTransactionJournal::Sending);
+
+    // Replaying rewrites the journal with only the unfinished transactions
+    QCOMPARE(lineCount(), 2);
+}
+
+void Ut_MmsTransactionJournal::partialRecord()
+{
+    {
+        MmsTransactionJournal journal(m_path);
+        journal.record(1, MmsTransactionJournal::Sending);
+    }
+
+    // Cut short by a crash while writing
+    QFile file(m_path);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Append));
+    file.write("D 1");
+    file.close();
+
+    MmsTransactionJournal journal(m_path);
+    QHash<int, MmsTransactionJournal::State> pending = journal.replay();
+    QCOMPARE(pending.size(), 1);
+    QCOMPARE(pending.value(1), MmsTransactionJournal::Sending);
+}
+
+void Ut_MmsTransactionJournal::compact()
+{
+    MmsTransactionJournal journal(m_path);
+    journal.record(1, MmsTransactionJournal::Sending);
+    for (int i = 2; i < 200; i++) {
+        journal.record(i, MmsTransactionJournal::Notification);
+        journal.record(i, MmsTransactionJournal::Done);
+    }
+
+    // Rewritten as it grows, instead of keeping every record
+    QVERIFY(lineCount() < 100);
+
+    MmsTransactionJournal replayed(m_path);
+    QHash<int, MmsTransactionJournal::State> pending = replayed.replay();
+    QCOMPARE(pending.size(), 1);
+    QCOMPARE(pending.value(1), MmsTransactionJournal::Sending);
+}
+
+void Ut_MmsTransactionJournal::allDone()
+{
+    {
+        MmsTransactionJournal journal(m_path);
+        journal.record(1, MmsTransactionJournal::Notification);
+        journal.record(1, MmsTransactionJournal::Done);
+        // Done for an unknown transaction isn't recorded
+        journal.record(2, MmsTransactionJournal::Done);
+    }
+    QCOMPARE(lineCount(), 2);
+
+    MmsTransactionJournal journal(m_path);
+    QVERIFY(journal.replay().isEmpty());
+    QVERIFY(!QFile::exists(m_path));
+}
+
+QTEST_MAIN(Ut_MmsTransactionJournal)
@@ -0,0 +1,116 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+
+// INCLUDES
+#include "ut_modelpool.h"
+
+// Qt includes
+#include <QPointer>
+#include <QTest>
+
+#include <CommHistory/ConversationModel>
+#include <CommHistory/ClassZeroSMSModel>
+
+#include "modelpool.h"
+
+using namespace RTComLogger;
+
+Ut_ModelPool::Ut_ModelPool()
+{
+}
+
+Ut_ModelPool::~Ut_ModelPool()
+{
+}
+
+void Ut_ModelPool::shareConversationModel()
+{
+    ModelPool pool;
+
+    CommHistory::ConversationModel *model = pool.acquireConversationModel(1);
+    QVERIFY(model);
+    QCOMPARE(pool.acquireConversationModel(1), model);
+    QVERIFY(pool.acquireConversationModel(2) != model);
+    QCOMPARE(pool.m_entries.value(model).refs, 2);
+
+    CommHistory::ClassZeroSMSModel *classZero = pool.acquireClassZeroSMSModel();
+    QVERIFY(classZero);
+    QCOMPARE(pool.acquireClassZeroSMSModel(), classZero);
+}
+
+void Ut_ModelPool::reclaimIdle()
+{
+    ModelPool pool;
+    pool.m_idleTimeout = 0;
+
+    QPointer<CommHistory::ConversationModel> model = pool.acquireConversationModel(1);
+    QVERIFY(!pool.m_timer.isActive());
+
+    pool.release(model);
+    QVERIFY(pool.m_timer.isActive());
+
+    pool.reclaim();
+    QVERIFY(!pool.m_timer.isActive());
+    QVERIFY(pool.m_entries.isEmpty());
+    QVERIFY(!pool.m_conversationModels.contains(1));
+    QTRY_VERIFY(model.isNull());
+
+    // A later acquire loads a new model
+    QVERIFY(pool.acquireConversationModel(1));
+    QCOMPARE(pool.m_entries.size(), 1);
+}
+
+void Ut_ModelPool::keepHeld()
+{
+    ModelPool pool;
+    pool.m_idleTimeout = 0;
+
+    QPointer<CommHistory::ConversationModel> held = pool.acquireConversationModel(1);
+    pool.acquireConversationModel(1);
+    QPointer<CommHistory::ConversationModel> idle = pool.acquireConversationModel(2);
+
+    pool.release(held);
+    pool.release(idle);
+    pool.reclaim();
+
+    QCOMPARE(pool.acquireConversationModel(1), held.data());
+    QTRY_VERIFY(idle.isNull());
+    QCOMPARE(pool.m_entries.value(held).refs, 2);
+}
+
+void Ut_ModelPool::reclaimClassZero()
+{
+    ModelPool pool;
+    pool.m_idleTimeout = 0;
+
+    QPointer<CommHistory::ClassZeroSMSModel> model = pool.acquireClassZeroSMSModel();
+    pool.release(model);
+
+    // Only kept while it has unread flash messages
+    QCOMPARE(model->rowCount(), 0);
+    pool.reclaim();
+    QVERIFY(!pool.m_classZeroSMSModel);
+    QTRY_VERIFY(model.isNull());
+}
+
+QTEST_MAIN(Ut_ModelPool)
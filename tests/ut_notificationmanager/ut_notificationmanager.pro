@@ -40,12 +40,14 @@ TEST_SOURCES += $$COMMHISTORYDSRCDIR/notificationmanager.cpp \
                 $$COMMHISTORYDSRCDIR/notificationgroup.cpp \
                 $$COMMHISTORYDSRCDIR/personalnotification.cpp \
                 $$COMMHISTORYDSRCDIR/serialisable.cpp \
-                $$COMMHISTORYDSRCDIR/commhistoryservice.cpp
+                $$COMMHISTORYDSRCDIR/commhistoryservice.cpp \
+                $$COMMHISTORYDSRCDIR/groupchangedispatcher.cpp
 TEST_HEADERS += $$COMMHISTORYDSRCDIR/notificationmanager.h \
                 $$COMMHISTORYDSRCDIR/notificationgroup.h \
                 $$COMMHISTORYDSRCDIR/personalnotification.h \
                 $$COMMHISTORYDSRCDIR/serialisable.h \
-                $$COMMHISTORYDSRCDIR/commhistoryservice.h
+                $$COMMHISTORYDSRCDIR/commhistoryservice.h \
+                $$COMMHISTORYDSRCDIR/groupchangedispatcher.h
 
 HEADERS     += ut_notificationmanager.h \
             $$TEST_HEADERS
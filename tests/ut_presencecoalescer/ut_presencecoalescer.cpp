@@ -0,0 +1,127 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+
+// INCLUDES
+#include "ut_presencecoalescer.h"
+
+// Qt includes
+#include <QSignalSpy>
+#include <QTest>
+#include <QTime>
+
+#include "presencecoalescer.h"
+
+// constants
+// longer than the status message delay of the coalescer
+#define READY_TIMEOUT 5000
+// shorter than the window in which the coalescer reports changes together
+#define WINDOW_STEP 500
+
+using namespace RTComLogger;
+
+namespace {
+    bool waitSignal(QSignalSpy &spy, int msec)
+    {
+        QTime timer;
+        timer.start();
+        while (timer.elapsed() < msec && spy.isEmpty())
+            QCoreApplication::processEvents();
+
+        return !spy.isEmpty();
+    }
+}
+
+Ut_PresenceCoalescer::Ut_PresenceCoalescer()
+{
+}
+
+Ut_PresenceCoalescer::~Ut_PresenceCoalescer()
+{
+}
+
+void Ut_PresenceCoalescer::latestMessage()
+{
+    PresenceCoalescer coalescer;
+    QSignalSpy ready(&coalescer, SIGNAL(ready()));
+
+    coalescer.statusMessageChanged("a", "a-remote", "away", "lunch");
+    coalescer.statusMessageChanged("a", "a-remote", "lunch", "back soon");
+    QVERIFY(coalescer.takeReady().isEmpty());
+
+    QVERIFY(waitSignal(ready, READY_TIMEOUT));
+    QCOMPARE(ready.count(), 1);
+
+    QList<PresenceCoalescer::Change> changes = coalescer.takeReady();
+    QCOMPARE(changes.size(), 1);
+    QCOMPARE(changes.first().contactId, QString("a"));
+    QCOMPARE(changes.first().remoteId, QString("a-remote"));
+    QCOMPARE(changes.first().statusMessage, QString("back soon"));
+    QVERIFY(coalescer.takeReady().isEmpty());
+}
+
+void Ut_PresenceCoalescer::flapping()
+{
+    PresenceCoalescer coalescer;
+    QSignalSpy ready(&coalescer, SIGNAL(ready()));
+
+    coalescer.statusMessageChanged("a", "a", "away", "lunch");
+    coalescer.statusMessageChanged("a", "a", "lunch", "away");
+
+    QVERIFY(!waitSignal(ready, READY_TIMEOUT));
+    QVERIFY(coalescer.takeReady().isEmpty());
+}
+
+void Ut_PresenceCoalescer::window()
+{
+    PresenceCoalescer coalescer;
+    QSignalSpy ready(&coalescer, SIGNAL(ready()));
+
+    coalescer.statusMessageChanged("a", "a", QString(), "one");
+    QTest::qWait(WINDOW_STEP);
+    coalescer.statusMessageChanged("b", "b", QString(), "two");
+
+    QVERIFY(waitSignal(ready, READY_TIMEOUT));
+    QCOMPARE(coalescer.takeReady().size(), 2);
+
+    // nothing was left for another commit
+    ready.clear();
+    QVERIFY(!waitSignal(ready, READY_TIMEOUT));
+}
+
+void Ut_PresenceCoalescer::remove()
+{
+    PresenceCoalescer coalescer;
+    QSignalSpy ready(&coalescer, SIGNAL(ready()));
+
+    coalescer.statusMessageChanged("a", "a", QString(), "one");
+    coalescer.statusMessageChanged("b", "b", QString(), "two");
+    coalescer.remove("a");
+
+    QVERIFY(waitSignal(ready, READY_TIMEOUT));
+
+    QList<PresenceCoalescer::Change> changes = coalescer.takeReady();
+    QCOMPARE(changes.size(), 1);
+    QCOMPARE(changes.first().contactId, QString("b"));
+}
+
+QTEST_MAIN(Ut_PresenceCoalescer)
@@ -0,0 +1,47 @@
+/******************************************************************************
+**
+** This file is part of commhistory-daemon.
+**
+** Copyright (C) 2014 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+
+#ifndef UT_PRESENCECOALESCER_H
+#define UT_PRESENCECOALESCER_H
+
+#include <QObject>
+
+namespace RTComLogger {
+
+class Ut_PresenceCoalescer : public QObject
+{
+    Q_OBJECT
+public:
+    Ut_PresenceCoalescer();
+    ~Ut_PresenceCoalescer();
+
+// Test functions
+private Q_SLOTS:
+    void latestMessage();
+    void flapping();
+    void window();
+    void remove();
+};
+
+}
+#endif // UT_PRESENCECOALESCER_H
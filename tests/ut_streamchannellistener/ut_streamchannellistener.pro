@@ -39,10 +39,16 @@ INCLUDEPATH = ../stubs/ $${INCLUDEPATH}
 TARGET = ut_streamchannellistener
 
 TEST_SOURCES += $$COMMHISTORYDSRCDIR/streamchannellistener.cpp \
-                $$COMMHISTORYDSRCDIR/channellistener.cpp
+                $$COMMHISTORYDSRCDIR/channellistener.cpp \
+                $$COMMHISTORYDSRCDIR/callcheckpointscheduler.cpp \
+                $$COMMHISTORYDSRCDIR/calljournal.cpp \
+                $$COMMHISTORYDSRCDIR/recentcalls.cpp
 
 TEST_HEADERS += $$COMMHISTORYDSRCDIR/streamchannellistener.h \
-                $$COMMHISTORYDSRCDIR/channellistener.h
+                $$COMMHISTORYDSRCDIR/channellistener.h \
+                $$COMMHISTORYDSRCDIR/callcheckpointscheduler.h \
+                $$COMMHISTORYDSRCDIR/calljournal.h \
+                $$COMMHISTORYDSRCDIR/recentcalls.h
 
 HEADERS     += ut_streamchannellistener.h \
             $$TEST_HEADERS
@@ -52,6 +58,7 @@ SOURCES     += ut_streamchannellistener.cpp \
 
 DESTDIR = ../bin
 QT += dbus
+PKGCONFIG += mce
 LIBS += -lrt
 
 # End of File
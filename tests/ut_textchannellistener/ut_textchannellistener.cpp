@@ -27,6 +27,7 @@
 #include <QDebug>
 #include <QTest>
 #include <QTime>
+#include <QPointer>
 #include <QSignalSpy>
 #include <QUuid>
 
@@ -36,6 +37,7 @@
 #include "TelepathyQt/Message"
 #include "TelepathyQt/Connection"
 #include "TelepathyQt/ContactManager"
+#include "TelepathyQt/Presence"
 
 #include "TpExtensions/cli-connection.h" // stored messages if
 
@@ -43,6 +45,8 @@
 #include <CommHistory/SingleEventModel>
 
 #include "textchannellistener.h"
+#include "contactcache.h"
+#include "messagedata.h"
 #include "notificationmanager.h"
 
 // constants
@@ -57,6 +61,7 @@
 #define TARGET_HANDLE 1
 #define SELF_HANDLE 0
 #define IM_REMOTE_ID QLatin1String("td@jabber.org")
+#define SCROLLBACK_USERNAME QLatin1String("history@localhost")
 
 #define VCARD_CONTENT QLatin1String("BEGIN:VCARD\n" \
                                     "VERSION:2.1\n" \
@@ -65,6 +70,40 @@
                                     "END:VCARD")
 #define VCARD_NAME QLatin1String("ABcd 123")
 
+// Decoding a plain text message may allocate only what Tp::Message::text()
+// needs; reading header fields through the Tp::Message accessors again
+// would allocate a key string for each of them and fail this
+#define DECODE_ROUNDS 1000
+#define MAX_DECODE_ALLOCATIONS 6
+// refilling an event may allocate only for the timestamps it converts;
+// the text and token are shared with the decoded message
+#define MAX_FILL_ALLOCATIONS 4
+
+#if defined(__GLIBC__)
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+namespace {
+    // only the test thread counts; QtDBus and others allocate meanwhile
+    static __thread int allocationCount = 0;
+    static __thread bool countAllocations = false;
+}
+
+extern "C" void *malloc(size_t size)
+{
+    if (countAllocations)
+        allocationCount++;
+    return __libc_malloc(size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    if (countAllocations)
+        allocationCount++;
+    return __libc_realloc(ptr, size);
+}
+#endif
+
 using namespace RTComLogger;
 
 namespace {
@@ -613,7 +652,7 @@ void Ut_TextChannelListener::voicemail()
     CommHistoryTp::Client::ConnectionInterfaceStoredMessagesInterface* storedMessages =
             conn->interface<CommHistoryTp::Client::ConnectionInterfaceStoredMessagesInterface>();
     QVERIFY(storedMessages);
-    QVERIFY(storedMessages->ut_getExpungedMessages().contains(token));
+    QTRY_VERIFY(storedMessages->ut_getExpungedMessages().contains(token));
 
     // hide voicemail
     nm->voicemailNotifications = 0xBEEF;
@@ -626,7 +665,7 @@ void Ut_TextChannelListener::voicemail()
     QCOMPARE(nm->postedNotifications.size(), 0);
     QCOMPARE(nm->voicemailNotifications, 0);
 
-    QVERIFY(storedMessages->ut_getExpungedMessages().contains(token));
+    QTRY_VERIFY(storedMessages->ut_getExpungedMessages().contains(token));
 
     // hide voicemail
     nm->voicemailNotifications = 0xFA11;
@@ -639,7 +678,7 @@ void Ut_TextChannelListener::voicemail()
     QCOMPARE(nm->postedNotifications.size(), 0);
     QCOMPARE(nm->voicemailNotifications, 0);
 
-    QVERIFY(storedMessages->ut_getExpungedMessages().contains(token));
+    QTRY_VERIFY(storedMessages->ut_getExpungedMessages().contains(token));
 
     // hide voicemail
     nm->voicemailNotifications = 0xBEEB;
@@ -652,7 +691,7 @@ void Ut_TextChannelListener::voicemail()
     QCOMPARE(nm->postedNotifications.size(), 0);
     QCOMPARE(nm->voicemailNotifications, 0);
 
-    QVERIFY(storedMessages->ut_getExpungedMessages().contains(token));
+    QTRY_VERIFY(storedMessages->ut_getExpungedMessages().contains(token));
 
     // skype voicemail should be ignored
     nm->voicemailNotifications = 0xACE;
@@ -665,7 +704,7 @@ void Ut_TextChannelListener::voicemail()
     QCOMPARE(nm->postedNotifications.size(), 0);
     QCOMPARE(nm->voicemailNotifications, 0xACE);
 
-    QVERIFY(storedMessages->ut_getExpungedMessages().contains(token));
+    QTRY_VERIFY(storedMessages->ut_getExpungedMessages().contains(token));
 
     // non voice notifications should be ignored
     token = sendVoicemail(ch, "text", "jumps",
@@ -677,7 +716,7 @@ void Ut_TextChannelListener::voicemail()
     QCOMPARE(nm->postedNotifications.size(), 0);
     QCOMPARE(nm->voicemailNotifications, 0xACE);
 
-    QVERIFY(storedMessages->ut_getExpungedMessages().contains(token));
+    QTRY_VERIFY(storedMessages->ut_getExpungedMessages().contains(token));
 
     // show unknown number
     nm->voicemailNotifications = 0xCAB;
@@ -690,7 +729,7 @@ void Ut_TextChannelListener::voicemail()
     QCOMPARE(nm->postedNotifications.size(), 0);
     QCOMPARE(nm->voicemailNotifications, -1); // -1 == unknown number
 
-    QVERIFY(storedMessages->ut_getExpungedMessages().contains(token));
+    QTRY_VERIFY(storedMessages->ut_getExpungedMessages().contains(token));
 
     // show unknown number
     nm->voicemailNotifications = 0xCAB;
@@ -703,7 +742,7 @@ void Ut_TextChannelListener::voicemail()
     QCOMPARE(nm->postedNotifications.size(), 0);
     QCOMPARE(nm->voicemailNotifications, -1); // -1 == unknown number
 
-    QVERIFY(storedMessages->ut_getExpungedMessages().contains(token));
+    QTRY_VERIFY(storedMessages->ut_getExpungedMessages().contains(token));
 
 }
 
@@ -1139,4 +1178,286 @@ void Ut_TextChannelListener::supersedes()
     QCOMPARE(nm->postedNotifications.last().chatType, CommHistory::Group::ChatTypeP2P);
 }
 
+void Ut_TextChannelListener::scrollback()
+{
+    NotificationManager *nm = NotificationManager::instance();
+    QVERIFY(nm);
+    nm->postedNotifications.clear();
+
+    // setup connection
+    Tp::ConnectionPtr conn(new Tp::Connection());
+    conn->ut_setIsReady(true);
+
+    //setup account
+    Tp::AccountPtr acc(new Tp::Account(conn, IM_ACCOUNT_PATH));
+
+    //setup channel
+    Tp::ChannelPtr ch(new Tp::TextChannel(IM_CHANNEL_PATH));
+    ch->ut_setIsRequested(false);
+    ch->ut_setTargetHandleType(Tp::HandleTypeContact);
+    ch->ut_setTargetHandle(TARGET_HANDLE);
+    QVariantMap immProp;
+    immProp.insert(TELEPATHY_INTERFACE_CHANNEL ".TargetID", SCROLLBACK_USERNAME);
+    ch->ut_setImmutableProperties(immProp);
+    ch->ut_setConnection(conn);
+
+    Tp::MethodInvocationContextPtr<> ctx(new Tp::MethodInvocationContext<>());
+
+    TextChannelListener tcl(acc, ch, ctx);
+    waitInvocationContext(ctx, 5000);
+
+    QVERIFY(ctx->isFinished());
+    QVERIFY(!ctx->isError());
+
+    Tp::ContactPtr sender(new Tp::Contact());
+    sender->ut_setHandle(23);
+    sender->ut_setId(SCROLLBACK_USERNAME);
+
+    // replayed history is stored without notifications
+    Tp::ReceivedMessage msg(Tp::MessagePartList() << Tp::MessagePart() << Tp::MessagePart());
+    uint timestamp = QDateTime::currentDateTime().toTime_t() - 3600;
+    addMsgHeader(msg, 0, "pending-message-id", pendingMessageId++);
+    addMsgHeader(msg, 0, "message-sent", timestamp);
+    addMsgHeader(msg, 0, "message-type", (uint)Tp::ChannelTextMessageTypeNormal);
+    addMsgHeader(msg, 0, "scrollback", true);
+    QString token = QUuid::createUuid().toString();
+    addMsgHeader(msg, 0, "message-token", token);
+    addMsgHeader(msg, 1, "content-type", "text/plain");
+    addMsgHeader(msg, 1, "content", RECEIVED_MESSAGE);
+    msg.ut_setSender(sender);
+
+    Tp::TextChannelPtr::dynamicCast(ch)->ut_receiveMessage(msg);
+
+    CommHistory::Group g = fetchGroup(IM_ACCOUNT_PATH, SCROLLBACK_USERNAME, true);
+    QVERIFY(g.isValid());
+    QCOMPARE(g.lastMessageText(), RECEIVED_MESSAGE);
+
+    CommHistory::Event e = fetchEvent(g.lastEventId());
+    QCOMPARE(e.id(), g.lastEventId());
+    QCOMPARE(e.direction(), CommHistory::Event::Inbound);
+    QCOMPARE(e.freeText(), RECEIVED_MESSAGE);
+    QCOMPARE(e.startTime().toTime_t(), timestamp);
+    QCOMPARE(e.messageToken(), token);
+
+    QVERIFY(nm->postedNotifications.isEmpty());
+
+    // the same line replayed again on rejoin is not stored twice
+    Tp::ReceivedMessage replayed(Tp::MessagePartList() << Tp::MessagePart() << Tp::MessagePart());
+    addMsgHeader(replayed, 0, "pending-message-id", pendingMessageId++);
+    addMsgHeader(replayed, 0, "message-sent", timestamp);
+    addMsgHeader(replayed, 0, "message-type", (uint)Tp::ChannelTextMessageTypeNormal);
+    addMsgHeader(replayed, 0, "scrollback", true);
+    addMsgHeader(replayed, 0, "message-token", token);
+    addMsgHeader(replayed, 1, "content-type", "text/plain");
+    addMsgHeader(replayed, 1, "content", RECEIVED_MESSAGE);
+    replayed.ut_setSender(sender);
+
+    Tp::TextChannelPtr::dynamicCast(ch)->ut_receiveMessage(replayed);
+    QCoreApplication::processEvents();
+
+    g = fetchGroup(IM_ACCOUNT_PATH, SCROLLBACK_USERNAME, true);
+    QVERIFY(g.isValid());
+    QCOMPARE(g.lastEventId(), e.id());
+
+    QVERIFY(nm->postedNotifications.isEmpty());
+}
+
+void Ut_TextChannelListener::onlineContacts()
+{
+    Tp::ConnectionPtr conn(new Tp::Connection());
+    conn->ut_setIsReady(true);
+
+    Tp::AccountPtr acc(new Tp::Account(conn, IM_ACCOUNT_PATH));
+
+    Tp::ChannelPtr ch(new Tp::TextChannel(IM_CHANNEL_PATH));
+    ch->ut_setIsRequested(true);
+    ch->ut_setTargetHandleType(Tp::HandleTypeContact);
+    ch->ut_setTargetHandle(TARGET_HANDLE);
+    QVariantMap immProp;
+    immProp.insert(TELEPATHY_INTERFACE_CHANNEL ".TargetID", IM_USERNAME);
+    ch->ut_setImmutableProperties(immProp);
+    ch->ut_setConnection(conn);
+
+    Tp::MethodInvocationContextPtr<> ctx(new Tp::MethodInvocationContext<>());
+
+    TextChannelListener tcl(acc, ch, ctx);
+    waitInvocationContext(ctx, 5000);
+    QVERIFY(ctx->isFinished());
+
+    ContactCache *cache = ContactCache::forConnection(conn);
+    QVERIFY(cache);
+    tcl.m_Contacts = cache;
+
+    const QString offline = Tp::Presence::offline().status();
+    const QString available = QLatin1String("available");
+    const QString busy = QLatin1String("busy");
+
+    cache->m_presences.insert(QLatin1String("a@localhost"), ContactCache::Presence(available, QString()));
+    cache->m_presences.insert(QLatin1String("b@localhost"), ContactCache::Presence(offline, QString()));
+
+    tcl.addPresenceContact(QLatin1String("a@localhost"));
+    tcl.addPresenceContact(QLatin1String("b@localhost"));
+    tcl.addPresenceContact(QLatin1String("a@localhost"));
+    QCOMPARE(tcl.m_OnlineContacts, 1);
+    QVERIFY(!tcl.areRemotePartiesOffline());
+
+    cache->m_presences.insert(QLatin1String("a@localhost"), ContactCache::Presence(offline, QString()));
+    tcl.presenceChanged(QLatin1String("a@localhost"), 2, available, QString());
+    QCOMPARE(tcl.m_OnlineContacts, 0);
+    QVERIFY(tcl.areRemotePartiesOffline());
+
+    cache->m_presences.insert(QLatin1String("b@localhost"), ContactCache::Presence(available, QString()));
+    tcl.presenceChanged(QLatin1String("b@localhost"), 3, offline, QString());
+    QCOMPARE(tcl.m_OnlineContacts, 1);
+
+    // online to online does not count again
+    cache->m_presences.insert(QLatin1String("b@localhost"), ContactCache::Presence(busy, QString()));
+    tcl.presenceChanged(QLatin1String("b@localhost"), 3, available, QString());
+    QCOMPARE(tcl.m_OnlineContacts, 1);
+
+    tcl.removePresenceContact(QLatin1String("b@localhost"));
+    tcl.removePresenceContact(QLatin1String("b@localhost"));
+    QCOMPARE(tcl.m_OnlineContacts, 0);
+
+    // changes of contacts no longer in the channel are ignored
+    tcl.removePresenceContact(QLatin1String("a@localhost"));
+    cache->m_presences.insert(QLatin1String("a@localhost"), ContactCache::Presence(available, QString()));
+    tcl.presenceChanged(QLatin1String("a@localhost"), 2, offline, QString());
+    QCOMPARE(tcl.m_OnlineContacts, 0);
+    QVERIFY(cache->m_presenceListeners.isEmpty());
+}
+
+void Ut_TextChannelListener::contactsDropped()
+{
+    Tp::ConnectionPtr conn(new Tp::Connection());
+    conn->ut_setIsReady(true);
+
+    Tp::AccountPtr acc(new Tp::Account(conn, IM_ACCOUNT_PATH));
+
+    Tp::ChannelPtr ch(new Tp::TextChannel(IM_CHANNEL_PATH));
+    ch->ut_setIsRequested(true);
+    ch->ut_setTargetHandleType(Tp::HandleTypeContact);
+    ch->ut_setTargetHandle(TARGET_HANDLE);
+    QVariantMap immProp;
+    immProp.insert(TELEPATHY_INTERFACE_CHANNEL ".TargetID", IM_USERNAME);
+    ch->ut_setImmutableProperties(immProp);
+    ch->ut_setConnection(conn);
+
+    Tp::MethodInvocationContextPtr<> ctx(new Tp::MethodInvocationContext<>());
+
+    TextChannelListener tcl(acc, ch, ctx);
+    waitInvocationContext(ctx, 5000);
+    QVERIFY(ctx->isFinished());
+
+    QPointer<ContactCache> cache = ContactCache::forConnection(conn);
+    QVERIFY(cache);
+    tcl.m_Contacts = cache;
+
+    const QString offline = Tp::Presence::offline().status();
+    const QString available = QLatin1String("available");
+
+    // contacts without known presence are not counted as online
+    tcl.addPresenceContact(QLatin1String("unknown@localhost"));
+    QCOMPARE(tcl.m_OnlineContacts, 0);
+    tcl.removePresenceContact(QLatin1String("unknown@localhost"));
+    QCOMPARE(tcl.m_OnlineContacts, 0);
+
+    cache->m_presences.insert(QLatin1String("a@localhost"), ContactCache::Presence(available, QString()));
+    cache->m_presences.insert(QLatin1String("b@localhost"), ContactCache::Presence(available, QString()));
+    tcl.addPresenceContact(QLatin1String("a@localhost"));
+    tcl.addPresenceContact(QLatin1String("b@localhost"));
+    QCOMPARE(tcl.m_OnlineContacts, 2);
+
+    cache->onConnectionInvalidated();
+    QVERIFY(tcl.m_PresenceContacts.isEmpty());
+    QCOMPARE(tcl.m_OnlineContacts, 0);
+    QVERIFY(tcl.areRemotePartiesOffline());
+
+    // removing contacts after the drop doesn't go below zero
+    tcl.removePresenceContact(QLatin1String("a@localhost"));
+    QCOMPARE(tcl.m_OnlineContacts, 0);
+
+    // the next cache of the connection counts from scratch
+    QTRY_VERIFY(!cache);
+    ContactCache *next = ContactCache::forConnection(conn);
+    QVERIFY(next);
+    tcl.m_Contacts = next;
+    next->m_presences.insert(QLatin1String("a@localhost"), ContactCache::Presence(offline, QString()));
+    next->m_presences.insert(QLatin1String("b@localhost"), ContactCache::Presence(available, QString()));
+    tcl.addPresenceContact(QLatin1String("a@localhost"));
+    tcl.addPresenceContact(QLatin1String("b@localhost"));
+    QCOMPARE(tcl.m_OnlineContacts, 1);
+
+    next->m_presences.insert(QLatin1String("b@localhost"), ContactCache::Presence(offline, QString()));
+    tcl.presenceChanged(QLatin1String("b@localhost"), 3, available, QString());
+    QCOMPARE(tcl.m_OnlineContacts, 0);
+}
+
+void Ut_TextChannelListener::messageDecoding()
+{
+    Tp::ReceivedMessage msg(Tp::MessagePartList() << Tp::MessagePart() << Tp::MessagePart());
+
+    uint timestamp = QDateTime::currentDateTime().toTime_t();
+    addMsgHeader(msg, 0, "pending-message-id", 42u);
+    addMsgHeader(msg, 0, "message-sent", timestamp - 5);
+    addMsgHeader(msg, 0, "message-received", timestamp);
+    addMsgHeader(msg, 0, "message-type", (uint)Tp::ChannelTextMessageTypeAction);
+    QString token = QUuid::createUuid().toString();
+    addMsgHeader(msg, 0, "message-token", token);
+    addMsgHeader(msg, 1, "content-type", "text/plain");
+    addMsgHeader(msg, 1, "content", RECEIVED_MESSAGE);
+
+    MessageData data(msg);
+    QVERIFY(data.isReceived);
+    QCOMPARE(data.type, Tp::ChannelTextMessageTypeAction);
+    QCOMPARE(data.text, RECEIVED_MESSAGE);
+    QCOMPARE(data.token, token);
+    QCOMPARE(data.pendingId, 42u);
+    QCOMPARE(data.sent, timestamp - 5);
+    QCOMPARE(data.received, timestamp);
+    QCOMPARE(data.eventId, -1);
+    QVERIFY(!data.isScrollback);
+    QVERIFY(data.replaceType.isEmpty());
+    QVERIFY(data.vcard.isEmpty());
+
+    CommHistory::Event event;
+    data.fillEvent(event);
+    QCOMPARE(event.freeText(), RECEIVED_MESSAGE);
+    QCOMPARE(event.messageToken(), token);
+    QCOMPARE(event.startTime().toTime_t(), timestamp - 5);
+    QCOMPARE(event.endTime().toTime_t(), timestamp);
+
+#if defined(__GLIBC__)
+    allocationCount = 0;
+    countAllocations = true;
+    for (int i = 0; i < DECODE_ROUNDS; i++) {
+        MessageData decoded(msg);
+        Q_UNUSED(decoded)
+    }
+    countAllocations = false;
+
+    int perMessage = allocationCount / DECODE_ROUNDS;
+    qDebug() << "allocations per decoded message:" << perMessage;
+    QVERIFY(perMessage <= MAX_DECODE_ALLOCATIONS);
+
+    CommHistory::Event filled;
+    data.fillEvent(filled);
+
+    allocationCount = 0;
+    countAllocations = true;
+    for (int i = 0; i < DECODE_ROUNDS; i++)
+        data.fillEvent(filled);
+    countAllocations = false;
+
+    int perEvent = allocationCount / DECODE_ROUNDS;
+    qDebug() << "allocations per filled event:" << perEvent;
+    QVERIFY(perEvent <= MAX_FILL_ALLOCATIONS);
+#endif
+
+    QBENCHMARK {
+        MessageData decoded(msg);
+        Q_UNUSED(decoded)
+    }
+}
+
 QTEST_MAIN(Ut_TextChannelListener)
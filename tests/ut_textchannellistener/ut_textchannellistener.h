@@ -57,6 +57,10 @@ private Q_SLOTS:
     void groups();
     void receivingFromSelf();
     void supersedes();
+    void scrollback();
+    void onlineContacts();
+    void contactsDropped();
+    void messageDecoding();
 
 private:
     CommHistory::Group fetchGroup(const QString &localUid, const QString &remoteUid, bool wait);
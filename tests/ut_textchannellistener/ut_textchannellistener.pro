@@ -42,10 +42,30 @@ equals(QT_MAJOR_VERSION, 4): CONFIG += mlocale
 equals(QT_MAJOR_VERSION, 5): PKGCONFIG += mlocale5
 
 TEST_SOURCES += $$COMMHISTORYDSRCDIR/textchannellistener.cpp \
-                $$COMMHISTORYDSRCDIR/channellistener.cpp
+                $$COMMHISTORYDSRCDIR/channellistener.cpp \
+                $$COMMHISTORYDSRCDIR/conversationindex.cpp \
+                $$COMMHISTORYDSRCDIR/groupchangedispatcher.cpp \
+                $$COMMHISTORYDSRCDIR/contactcache.cpp \
+                $$COMMHISTORYDSRCDIR/presencecoalescer.cpp \
+                $$COMMHISTORYDSRCDIR/messagedata.cpp \
+                $$COMMHISTORYDSRCDIR/modelpool.cpp \
+                $$COMMHISTORYDSRCDIR/expungeaggregator.cpp \
+                $$COMMHISTORYDSRCDIR/commitretryqueue.cpp \
+                $$COMMHISTORYDSRCDIR/messagetokencheck.cpp \
+                $$COMMHISTORYDSRCDIR/commhistorydatabase.cpp
 
 TEST_HEADERS += $$COMMHISTORYDSRCDIR/textchannellistener.h \
-                $$COMMHISTORYDSRCDIR/channellistener.h
+                $$COMMHISTORYDSRCDIR/channellistener.h \
+                $$COMMHISTORYDSRCDIR/conversationindex.h \
+                $$COMMHISTORYDSRCDIR/groupchangedispatcher.h \
+                $$COMMHISTORYDSRCDIR/contactcache.h \
+                $$COMMHISTORYDSRCDIR/presencecoalescer.h \
+                $$COMMHISTORYDSRCDIR/messagedata.h \
+                $$COMMHISTORYDSRCDIR/modelpool.h \
+                $$COMMHISTORYDSRCDIR/expungeaggregator.h \
+                $$COMMHISTORYDSRCDIR/commitretryqueue.h \
+                $$COMMHISTORYDSRCDIR/messagetokencheck.h \
+                $$COMMHISTORYDSRCDIR/commhistorydatabase.h
 
 HEADERS     += ut_textchannellistener.h \
             $$TEST_HEADERS
@@ -54,7 +74,7 @@ SOURCES     += ut_textchannellistener.cpp \
             $$TEST_SOURCES
 
 DESTDIR = ../bin
-QT += dbus
+QT += dbus sql concurrent
 
 # End of File
 